@@ -0,0 +1,198 @@
+// ===================================================================================
+// Project:   Simulator Benchmarks for CH552 Touch Play
+// Version:   v1.0
+// License:   MIT License
+// ===================================================================================
+//
+// Description:
+// ------------
+// Replaces touch.c as main file for 'make bench'. The hot paths of the firmware
+// are called directly with prepared USB state, every call is timed with timer1
+// (16-bit, one count per machine cycle in ucsim) and the fastest and slowest
+// call of every benchmark is stored in BENCH_result. The run ends at
+// BENCH_done(), where tools/sim_bench.py stops the simulator and reads the
+// results from XRAM.
+//
+// USB SFRs are plain memory in the simulator, so the status registers the
+// hardware would set (USB_INT_ST, USB_RX_LEN, U_TOG_OK) are simply written
+// before every call. Interrupts stay disabled throughout, the interrupt
+// handlers are called as functions. Built with BENCH_SIM, the dual data
+// pointer copies run as C loops (ucsim's 8051 core stops at the CH55x DPTR1
+// opcode 0xA5), so their paths read somewhat slower than on the chip.
+
+#include "src/anim.h"
+#include "src/config.h"
+#include "src/gesture.h"
+#include "src/neo.h"
+#include "src/scan.h"
+#include "src/timebase.h"
+#include "src/touchmap.h"
+#include "src/usb_handler.h"
+#include "src/usb_hid.h"
+#include "src/usb_multitouch.h"
+#include "src/usb_relay.h"
+#include "src/usb_vendor.h"
+#include "bench.h"
+
+// ===================================================================================
+// Results and Timing
+// ===================================================================================
+__xdata BENCH_RESULT BENCH_result[BENCH_COUNT]; // read by tools/sim_bench.py
+__xdata uint16_t     BENCH_overhead;            // cycles of an empty measurement
+__xdata MT_REPORT    BENCH_report;              // report for HID_QUEUE
+
+extern __bit NEO_latchBusy;
+
+#define BENCH_start()   (TH1 = 0, TL1 = 0, TR1 = 1)
+#define BENCH_stop()    (TR1 = 0, ((uint16_t)TH1 << 8) | TL1)
+
+// Store the cycles of one call
+void BENCH_record(uint8_t id, uint16_t cycles) {
+  __xdata BENCH_RESULT* r = &BENCH_result[id];
+  cycles -= BENCH_overhead;
+  if(!r->calls || cycles < r->min) r->min = cycles;
+  if(cycles > r->max) r->max = cycles;
+  r->calls++;
+}
+
+#define BENCH_run(id, call) do {                \
+  uint16_t cycles;                              \
+  BENCH_start();                                \
+  call;                                         \
+  cycles = BENCH_stop();                        \
+  BENCH_record(BENCH_##id, cycles);             \
+} while(0)
+
+// The simulator is stopped here
+void BENCH_done(void) {
+  while(1);
+}
+
+// ===================================================================================
+// USB Helpers
+// ===================================================================================
+
+// Prepare a transfer completed interrupt for token and endpoint
+void BENCH_token(uint8_t token, uint8_t rxlen) {
+  USB_INT_ST   = token | bUIS_TOG_OK;
+  USB_RX_LEN   = rxlen;
+  U_TOG_OK     = 1;
+  UIF_TRANSFER = 1;
+}
+
+// Prepare a SETUP packet in EP0_buffer
+void BENCH_setup(uint8_t type, uint8_t req, uint16_t value, uint16_t len) {
+  USB_SetupBuf->bRequestType = type;
+  USB_SetupBuf->bRequest     = req;
+  USB_SetupBuf->wValueL      = (uint8_t)value;
+  USB_SetupBuf->wValueH      = (uint8_t)(value >> 8);
+  USB_SetupBuf->wIndexL      = 0;
+  USB_SetupBuf->wIndexH      = 0;
+  USB_SetupBuf->wLengthL     = (uint8_t)len;
+  USB_SetupBuf->wLengthH     = (uint8_t)(len >> 8);
+  BENCH_token(UIS_TOKEN_SETUP, 8);
+}
+
+// ACK all queued EP1 reports (not measured)
+void BENCH_drain(void) {
+  while(HID_queueDepth()) {
+    BENCH_token(UIS_TOKEN_IN | 1, 0);
+    USB_interrupt();
+  }
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+void main(void) {
+  uint8_t i, j;
+
+  // Setup, interrupts stay disabled
+  TB_init();
+  USB_EP_init();
+  EA = 0;
+  USB_ENUM_OK = 1;
+  MAP_load();
+  GES_init();
+  SCAN_init();
+  NEO_clearAll();
+  TMOD = (TMOD & 0x0F) | 0x10;                  // timer1 16-bit mode
+  for(i=0; i<BENCH_COUNT; i++) BENCH_result[i].calls = 0;
+  BENCH_overhead = 0;
+  BENCH_start();
+  BENCH_overhead = BENCH_stop();
+
+  // Scan engine
+  for(i=0; i<64; i++) BENCH_run(SCAN_IDLE, SCAN_interrupt());
+  for(i=0; i<8; i++) {
+    SCAN_force(0, !(i & 1));
+    for(j=0; j<=SCAN_DEBOUNCE; j++) BENCH_run(SCAN_EDGE, SCAN_interrupt());
+    while(SCAN_read() != SCAN_EV_NONE);
+  }
+
+  // Timebase
+  for(i=0; i<16; i++) BENCH_run(TB_TICK, TB_interrupt());
+
+  // EP0 control requests
+  for(i=0; i<8; i++) {
+    BENCH_setup(USB_REQ_TYP_IN, USB_GET_DESCRIPTOR, USB_DESCR_TYP_DEVICE << 8, 18);
+    BENCH_run(USB_SETUP, USB_interrupt());
+    BENCH_setup(USB_REQ_TYP_IN | USB_REQ_TYP_VENDOR, VEN_GET_INFO, 0, 9);
+    BENCH_run(USB_VENDOR, USB_interrupt());
+  }
+
+  // Report queue and EP1 IN
+  BENCH_report.reportId = REPORT_ID_TOUCH;
+  BENCH_report.count    = 1;
+  for(i=0; i<16; i++) {
+    BENCH_report.contact[0].x = i;
+    BENCH_run(HID_QUEUE, HID_tryQueueReport((__xdata uint8_t*)&BENCH_report,
+                                            sizeof(MT_REPORT), HID_TAG_NONE));
+    BENCH_run(HID_QUEUE, HID_tryQueueReport((__xdata uint8_t*)&BENCH_report,
+                                            sizeof(MT_REPORT), HID_TAG_NONE));
+    while(HID_queueDepth()) {
+      BENCH_token(UIS_TOKEN_IN | 1, 0);
+      BENCH_run(USB_EP1_ACK, USB_interrupt());
+    }
+  }
+
+  // Gesture frames
+  for(i=0; i<16; i++) {
+    GES_hold(0, !(i & 1));
+    BENCH_run(GES_FRAME, GES_sendFrame());
+    BENCH_drain();
+  }
+
+  // Relay frames (three contacts, the last one ends relay mode)
+  #ifdef RELAY_ENABLE
+  for(i=0; i<8; i++) {
+    __xdata uint8_t* f = EP2_buffer;
+    *f++ = REPORT_ID_RELAY;
+    *f++ = i;
+    *f++ = MT_MAX_CONTACTS | (i == 7 ? RLY_END : 0);
+    for(j=0; j<MT_MAX_CONTACTS; j++) {
+      *f++ = j + 1;
+      *f++ = RLY_TOUCH;
+      *f++ = j; *f++ = 0x10;
+      *f++ = i; *f++ = 0x10;
+      *f++ = 0x7F;
+    }
+    BENCH_token(UIS_TOKEN_OUT | 2, RLY_REPORT_SIZE);
+    BENCH_run(USB_RELAY, USB_interrupt());
+    BENCH_drain();
+  }
+  #endif
+
+  // Animation frames, all pixels in a rainbow (the most expensive effect)
+  for(j=0; j<NEO_COUNT; j++) ANIM_start(j, ANIM_RAINBOW, ANIM_LEVEL_MAX, 3);
+  for(i=0; i<8; i++) BENCH_run(ANIM_FRAME, ANIM_render(i + 1));
+
+  // NeoPixels
+  for(i=0; i<8; i++) {
+    for(j=0; j<NEO_COUNT; j++) NEO_writeColor(j, i, 25, 19);
+    NEO_latchBusy = 0;                          // no timer2 interrupt here
+    BENCH_run(NEO_UPDATE, NEO_update());
+  }
+
+  BENCH_done();
+}
@@ -0,0 +1,32 @@
+// ===================================================================================
+// Benchmark Table for the Simulator Benchmarks                               * v1.0 *
+// ===================================================================================
+//
+// One entry per benchmark: BENCH(name, isr), isr = 1 marks an interrupt path,
+// these count for the worst-case ISR length. bench.c expands the table into the
+// result array, tools/sim_bench.py reads the names from here in the same order.
+
+#pragma once
+#include <stdint.h>
+
+#define BENCH_TABLE(BENCH) \
+  BENCH(SCAN_IDLE,     1)   /* SCAN_interrupt, all keys stable */ \
+  BENCH(SCAN_EDGE,     1)   /* SCAN_interrupt, key edge debounced and posted */ \
+  BENCH(TB_TICK,       1)   /* TB_interrupt, millisecond tick */ \
+  BENCH(USB_SETUP,     1)   /* USB_interrupt, EP0 SETUP GET_DESCRIPTOR (device) */ \
+  BENCH(USB_VENDOR,    1)   /* USB_interrupt, EP0 SETUP VEN_GET_INFO */ \
+  BENCH(USB_EP1_ACK,   1)   /* USB_interrupt, EP1 IN ACK, next report armed */ \
+  BENCH(USB_RELAY,     1)   /* USB_interrupt, EP2 OUT relay frame */ \
+  BENCH(HID_QUEUE,     0)   /* HID_tryQueueReport, touch report */ \
+  BENCH(GES_FRAME,     0)   /* GES_sendFrame, one contact changed */ \
+  BENCH(ANIM_FRAME,    0)   /* ANIM_render, all pixels in a rainbow */ \
+  BENCH(NEO_UPDATE,    0)   /* NEO_update, all pixels changed */
+
+#define BENCH_ID(name, isr)   BENCH_##name,
+enum { BENCH_TABLE(BENCH_ID) BENCH_COUNT };
+
+typedef struct _BENCH_RESULT {
+  uint16_t calls;                       // number of measured calls
+  uint16_t min;                         // shortest call in machine cycles
+  uint16_t max;                         // longest call in machine cycles
+} BENCH_RESULT;
@@ -0,0 +1,1025 @@
+// ===================================================================================
+// Project:   Host Tests for CH552 Touch Play
+// Version:   v1.0
+// License:   MIT License
+// ===================================================================================
+//
+// Description:
+// ------------
+// Runs the firmware natively on the build machine for 'make host': touch.c and
+// the modules of src/ are compiled against the SFR mocks of host/host.h, the
+// main loop of touch.c runs unchanged. PWR_idle() (host/mock.c) calls HOST_tick()
+// once per scan tick, which plays the hardware: the millisecond tick, the USB
+// host polling the IN endpoints, the input pins of the running test and the scan
+// interrupt. A model of the touch host applies every touch report and checks it.
+//
+// Tests (in this order):
+// enum     enumeration: device, configuration, string and report descriptors,
+//          keyboard SET_IDLE
+// traces   random press/release traces with contact bounce and short glitches on
+//          every key that has a contact slot of its own (first PIN entry of the
+//          slot in SCAN_INPUTS), all keys at once
+// macro    a double tap program bound to the first key taps twice
+// vm       random macro programs on random key presses, all contacts are lifted
+//          once the default programs are restored
+// map      new random contact IDs while random keys are held
+// matrix   random matrix keys with random direct keys held (matrix build only,
+//          HOST_MATRIX of host/host.h)
+// recover  the host stops polling while a key is pressed: the supervisor
+//          re-attaches, the host resets the bus and enumerates again
+// ep0      random SETUP packets (with random OUT data) and random relay frames
+//
+// Checks:
+// - every touch report: report ID, length, contact count and status
+// - enum: the keyboard report repeated at the idle rate, not at rate 0
+// - enum, traces, macro, vm, map, matrix, recover: contact IDs unique in a frame,
+//   coordinates in range
+// - enum, traces, macro, vm: no gap longer than MT_KEYFRAME_MS while a contact
+//   touches, no second report in a row while nothing touches
+// - traces: a settled key matches its contact once the edge had time to reach
+//   the host, every settled press is exactly one touch down, glitches and
+//   bounces shorter than SCAN_DEBOUNCE are never reported
+// - map: every key seen with its new contact ID only, at most MT_MAX_CONTACTS
+//   contact states kept by the firmware
+// - matrix: every key accepted, also two keys of one column, every contact
+//   follows the keys of its slot
+// - recover: detached within SUP_EP1_MS of the stall (plus debounce), attached
+//   again after SUP_DETACH_MS, the pressed key is reported right after the new
+//   SET_CONFIGURATION, one re-attach counted
+// - every control transfer: no IN packet beyond EP0_SIZE, no data stage longer
+//   than wLength, no NAK within the data stage
+// The sanitizers (HOST_SAN in the makefile) catch everything out of bounds.
+// VEN_START_CRC is left out of the fuzzing, it reads code flash at the address
+// given by the host. The harness pulls the column of a pressed matrix key low
+// while its row is driven low, the idle USB D- line (P37) reads low.
+//
+// Operating Instructions:
+// -----------------------
+// make host                          build and run with the default counts, as
+//                                    configured and with the key matrix
+// make host HOST_ARGS="1000000 7"    one million traces, random seed 7
+// The run ends with exit code 1 if any check failed.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "src/config.h"
+#include "src/gesture.h"
+#include "src/gpio.h"
+#include "src/macro.h"
+#include "src/perf.h"
+#include "src/scan.h"
+#include "src/timebase.h"
+#include "src/touchmap.h"
+#include "src/usb_handler.h"
+#include "src/usb_hid.h"
+#include "src/usb_multitouch.h"
+#include "src/usb_vendor.h"
+
+void HOST_firmware(void);               // main() of touch.c
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define HOST_TICK_US      (1000000L / SCAN_RATE_HZ)   // scan tick
+#define HOST_SETTLE       8             // ms for a settled edge to reach the host
+#define HOST_KEYFRAME_MAX (MT_KEYFRAME_MS + 3)  // longest gap while touching
+#define HOST_MAX_ERRORS   10            // stop after this many failed checks
+#define HOST_ADDR(p)      ((uint16_t)(uintptr_t)(p))  // DMA address of a buffer
+
+#define HOST_CHK_FRAME    0x01          // unique IDs, coordinates in range
+#define HOST_CHK_TIMING   0x02          // keyframes while touching, no idle reports
+
+typedef struct _HOST_TEST {
+  const char* name;
+  uint8_t     checks;                   // HOST_CHK_FRAME, HOST_CHK_TIMING
+  uint8_t     (*run)(void);             // one scan tick, returns 0 when done
+} HOST_TEST;
+
+typedef struct _HOST_CONTACT {
+  uint8_t  touch;                       // contact touches
+  uint16_t x, y;                        // last position
+  uint32_t downs;                       // touch downs
+} HOST_CONTACT;
+
+typedef struct _HOST_KEY {
+  uint8_t  pin;                         // gpio.h pin
+  uint8_t  slot;                        // contact slot
+  uint8_t  level;                       // settled level (1: pressed)
+  uint8_t  raw;                         // pin level now
+  uint8_t  bounce;                      // level changes left before it settles
+  uint16_t left;                        // ticks left at the current pin level
+  uint32_t stable;                      // ticks since the pin settled
+  uint32_t presses;                     // settled presses
+  uint32_t downs;                       // touch downs of the contact before the test
+} HOST_KEY;
+
+// Keys driven by the tests: the first PIN entry of every slot
+#define HOST_PIN_ENTRY(pin, slot)         {pin, slot},
+#define HOST_MATRIX_ENTRY(row, pin, slot)
+static const struct {uint8_t pin, slot;} HOST_inputs[] = {
+  SCAN_INPUTS(HOST_PIN_ENTRY, HOST_MATRIX_ENTRY) {0xFF, 0xFF}
+};
+static volatile _Bool* const HOST_bit[16] = {
+  &PP10, &PP11, &PP12, &PP13, &PP14, &PP15, &PP16, &PP17,
+  &PP30, &PP31, &PP32, &PP33, &PP34, &PP35, &PP36, &PP37
+};
+static HOST_KEY HOST_key[GES_SLOTS];
+static uint8_t  HOST_keys;
+
+// All inputs in key order (row 0xFF: direct key) and the matrix keys pressed
+#ifdef SCAN_MATRIX_ROWS
+#define HOST_SCAN_PIN(pin, slot)          {0xFF, pin, slot},
+#define HOST_SCAN_MATRIX(row, pin, slot)  {row, pin, slot},
+static const struct {uint8_t row, pin, slot;} HOST_scanKey[] = {
+  SCAN_INPUTS(HOST_SCAN_PIN, HOST_SCAN_MATRIX)
+};
+static const uint8_t HOST_rowPin[] = {SCAN_MATRIX_ROWS};
+static uint16_t HOST_matDown;           // bit n: key n of SCAN_INPUTS pressed
+#endif
+
+static uint32_t HOST_traceCount = 20000;  // traces, the other counts follow
+static uint32_t HOST_seed = 1;
+static uint32_t HOST_errors;
+static uint32_t HOST_ms, HOST_us;       // simulated time
+static uint8_t  HOST_test;              // running test
+static const char* HOST_name;           // name of the running test
+static uint8_t  HOST_checks;            // checks of the running test
+static uint8_t  HOST_phase;             // state of the running test
+static uint32_t HOST_wait;              // ticks to wait before the next step
+static uint32_t HOST_count;             // iterations of the running test
+static clock_t  HOST_clock;
+
+static HOST_CONTACT HOST_contact[256];  // host state by contact ID
+static uint8_t  HOST_inFrame[256];      // status + 1 of the contacts of the frame
+static uint16_t HOST_frameX[256], HOST_frameY[256];
+static uint8_t  HOST_frameLeft;         // contacts still to come (hybrid mode)
+static uint8_t  HOST_touching;          // contacts touching
+static uint8_t  HOST_idleFrames;        // reports in a row with nothing touching
+static uint8_t  HOST_configured;        // host polls the IN endpoints
+static uint32_t HOST_lastReport;        // ms of the last touch frame
+static uint32_t HOST_reports;           // touch reports
+static uint32_t HOST_repeats;           // frames that changed nothing (keyframes)
+static uint32_t HOST_keyboard, HOST_consumer;   // EP3/EP4 reports
+static uint32_t HOST_changes;           // settled input changes
+
+// ===================================================================================
+// Helpers
+// ===================================================================================
+static uint32_t HOST_rand(void) {       // xorshift32
+  HOST_seed ^= HOST_seed << 13;
+  HOST_seed ^= HOST_seed >> 17;
+  HOST_seed ^= HOST_seed << 5;
+  return HOST_seed;
+}
+
+static uint32_t HOST_range(uint32_t lo, uint32_t hi) {
+  return lo + HOST_rand() % (hi - lo + 1);
+}
+
+static void HOST_exit(void) {
+  double s = (double)(clock() - HOST_clock) / CLOCKS_PER_SEC;
+  printf("%s: %lu ms simulated in %.2f s", HOST_errors ? "FAILED" : "All tests passed",
+         (unsigned long)HOST_ms, s);
+  if(s > 0) printf(" (%.0fx real time)", HOST_ms / 1000.0 / s);
+  if(HOST_errors) printf(", %lu failed checks", (unsigned long)HOST_errors);
+  printf("\n");
+  exit(HOST_errors ? 1 : 0);
+}
+
+static void HOST_fail(const char* fmt, ...) {
+  va_list ap;
+  printf("FAIL %s at %lu ms: ", HOST_name, (unsigned long)HOST_ms);
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  if(++HOST_errors >= HOST_MAX_ERRORS) HOST_exit();
+}
+
+// Drive a key pin (active low), both the port byte and the pin bit
+static void HOST_setPin(uint8_t pin, uint8_t pressed) {
+  volatile unsigned char* port = pin >= P30 ? &P3 : &P1;
+  uint8_t bit = 1 << (pin & 7);
+  if(pressed) *port &= ~bit;
+  else        *port |=  bit;
+  *HOST_bit[pin] = !pressed;
+}
+
+#ifdef SCAN_MATRIX_ROWS
+// Pull the column of every pressed matrix key low while the firmware drives its
+// row low, called right before the scan interrupt samples the ports
+static void HOST_columns(void) {
+  uint8_t i, pin;
+  for(i=0; i<SCAN_KEYS; i++)
+    if(HOST_scanKey[i].row != 0xFF) HOST_setPin(HOST_scanKey[i].pin, 0);
+  for(i=0; i<SCAN_KEYS; i++) {
+    if(HOST_scanKey[i].row == 0xFF || !(HOST_matDown & (1U << i))) continue;
+    pin = HOST_rowPin[HOST_scanKey[i].row];
+    if(!((pin >= P30 ? P3 : P1) & (1 << (pin & 7)))) HOST_setPin(HOST_scanKey[i].pin, 1);
+  }
+}
+#endif
+
+// ===================================================================================
+// USB Host
+// ===================================================================================
+
+// Completed transaction on an endpoint, as the USB engine reports it
+static void HOST_token(uint8_t token, uint8_t rxlen) {
+  USB_INT_ST   = token | bUIS_TOG_OK;
+  USB_RX_LEN   = rxlen;
+  U_TOG_OK     = 1;
+  UIF_TRANSFER = 1;
+  USB_interrupt();
+}
+
+// Run a control transfer on EP0, returns the length of the data stage or -1 if
+// the device stalled. IN data is stored in data (len bytes at most).
+static int HOST_control(uint8_t type, uint8_t req, uint16_t value, uint16_t index,
+                        uint16_t len, uint8_t* data) {
+  uint16_t total = 0;
+  uint8_t  n;
+
+  USB_SetupBuf->bRequestType = type;
+  USB_SetupBuf->bRequest     = req;
+  USB_SetupBuf->wValueL      = (uint8_t)value;
+  USB_SetupBuf->wValueH      = (uint8_t)(value >> 8);
+  USB_SetupBuf->wIndexL      = (uint8_t)index;
+  USB_SetupBuf->wIndexH      = (uint8_t)(index >> 8);
+  USB_SetupBuf->wLengthL     = (uint8_t)len;
+  USB_SetupBuf->wLengthH     = (uint8_t)(len >> 8);
+  HOST_token(UIS_TOKEN_SETUP, 8);
+
+  if((type & USB_REQ_TYP_IN) && len) {          // IN data stage, OUT status stage
+    while(1) {
+      if((UEP0_CTRL & MASK_UEP_T_RES) == UEP_T_RES_STALL) return -1;
+      if((UEP0_CTRL & MASK_UEP_T_RES) != UEP_T_RES_ACK) {
+        HOST_fail("request %02x/%02x NAKs the data stage after %u of %u bytes",
+                  type, req, total, len);
+        return -1;
+      }
+      n = UEP0_T_LEN;
+      if(n > EP0_SIZE) HOST_fail("request %02x/%02x sent a packet of %u bytes", type, req, n);
+      if(total + n > len) {
+        HOST_fail("request %02x/%02x sent %u bytes, wLength is %u", type, req, total + n, len);
+        return -1;
+      }
+      if(data) memcpy(data + total, EP0_buffer, n);
+      total += n;
+      HOST_token(UIS_TOKEN_IN, 0);
+      if(n < EP0_SIZE || total == len) break;   // short packet or all bytes
+    }
+    HOST_token(UIS_TOKEN_OUT, 0);
+  }
+  else {                                        // OUT data stage, IN status stage
+    while(total < len) {
+      if((UEP0_CTRL & MASK_UEP_R_RES) == UEP_R_RES_STALL) return -1;
+      n = len - total > EP0_SIZE ? EP0_SIZE : len - total;
+      memcpy(EP0_buffer, data + total, n);
+      HOST_token(UIS_TOKEN_OUT, n);
+      total += n;
+    }
+    if((UEP0_CTRL & MASK_UEP_T_RES) == UEP_T_RES_STALL) return -1;
+    HOST_token(UIS_TOKEN_IN, 0);
+  }
+  return total;
+}
+
+// ===================================================================================
+// Touch Host Model
+// ===================================================================================
+
+// Apply a complete frame: contacts missing from it are lifted
+static void HOST_applyFrame(void) {
+  uint8_t  before = HOST_touching, changed = 0;
+  uint16_t id;
+  HOST_CONTACT* c;
+
+  HOST_touching = 0;
+  for(id=0, c=HOST_contact; id<256; id++, c++) {
+    uint8_t touch = HOST_inFrame[id] == MT_TOUCH + 1;
+    if(touch && !c->touch) c->downs++;
+    if(touch != c->touch || (touch && (c->x != HOST_frameX[id] || c->y != HOST_frameY[id])))
+      changed = 1;
+    c->touch = touch;
+    if(touch) {
+      c->x = HOST_frameX[id];
+      c->y = HOST_frameY[id];
+      HOST_touching++;
+    }
+  }
+  if(!changed) HOST_repeats++;
+  if(HOST_checks & HOST_CHK_TIMING) {
+    if(before || HOST_touching) HOST_idleFrames = 0;
+    else if(HOST_idleFrames++) HOST_fail("touch report while nothing touches");
+  }
+  HOST_lastReport = HOST_ms;
+}
+
+// Touch report from EP1
+static void HOST_touchReport(__xdata uint8_t* buf, uint8_t len) {
+  __xdata MT_REPORT* r = (__xdata MT_REPORT*)buf;
+  __xdata MT_CONTACT* c;
+  uint8_t i, n;
+
+  HOST_reports++;
+  if(len != sizeof(MT_REPORT) || r->reportId != REPORT_ID_TOUCH) {
+    HOST_fail("touch report ID %u with %u bytes", r->reportId, len);
+    return;
+  }
+  if(!HOST_frameLeft) {                         // first report of a frame
+    if(r->count > MT_MAX_CONTACTS) {
+      HOST_fail("frame with %u contacts", r->count);
+      return;
+    }
+    memset(HOST_inFrame, 0, sizeof(HOST_inFrame));
+    HOST_frameLeft = r->count;
+  }
+  else if(r->count) HOST_fail("contact count %u in a continued frame", r->count);
+
+  n = HOST_frameLeft > MT_REPORT_CONTACTS ? MT_REPORT_CONTACTS : HOST_frameLeft;
+  for(i=0, c=r->contact; i<n; i++, c++) {
+    if(c->status != MT_TOUCH && c->status != MT_LIFT)
+      HOST_fail("contact %u with status %u", c->id, c->status);
+    if(HOST_checks & HOST_CHK_FRAME) {
+      if(HOST_inFrame[c->id]) HOST_fail("contact %u twice in a frame", c->id);
+      if(c->x > MT_LOGICAL_MAX || c->y > MT_LOGICAL_MAX)
+        HOST_fail("contact %u at %u/%u", c->id, c->x, c->y);
+    }
+    HOST_inFrame[c->id] = (c->status & MT_TOUCH) + 1;
+    HOST_frameX[c->id]  = c->x;
+    HOST_frameY[c->id]  = c->y;
+  }
+  HOST_frameLeft -= n;
+  if(!HOST_frameLeft) HOST_applyFrame();
+}
+
+// USB frame: the host polls the IN endpoints, armed reports are ACKed
+static void HOST_poll(void) {
+  uint8_t i;
+
+  if(!HOST_configured) return;
+  if((UEP1_CTRL & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    for(i=0; i<HID_QUEUE_SIZE && UEP1_DMA != HOST_ADDR(EP1_buffer[i]); i++);
+    if(i == HID_QUEUE_SIZE) HOST_fail("EP1 armed outside the report queue");
+    else HOST_touchReport(EP1_buffer[i], UEP1_T_LEN);
+    HOST_token(UIS_TOKEN_IN | 1, 0);
+  }
+  if((UEP3_CTRL & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    HOST_keyboard++;
+    HOST_token(UIS_TOKEN_IN | 3, 0);
+  }
+  if((UEP4_CTRL & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    HOST_consumer++;
+    HOST_token(UIS_TOKEN_IN | 4, 0);
+  }
+}
+
+// ===================================================================================
+// Test: Enumeration
+// ===================================================================================
+
+// Enumerate and configure the device as a host does, returns the length of the
+// configuration descriptor
+static uint16_t HOST_enumerate(void) {
+  uint8_t  d[1024];
+  uint16_t total;
+  int      n;
+  uint8_t  i;
+
+  n = HOST_control(USB_REQ_TYP_IN, USB_GET_DESCRIPTOR, USB_DESCR_TYP_DEVICE << 8, 0, 64, d);
+  if(n != 18 || d[0] != 18 || d[1] != USB_DESCR_TYP_DEVICE)
+    HOST_fail("device descriptor (%d bytes)", n);
+  HOST_control(USB_REQ_TYP_OUT, USB_SET_ADDRESS, 5, 0, 0, 0);
+  n = HOST_control(USB_REQ_TYP_IN, USB_GET_DESCRIPTOR, USB_DESCR_TYP_CONFIG << 8, 0, 9, d);
+  total = d[2] | (d[3] << 8);
+  if(n != 9 || d[1] != USB_DESCR_TYP_CONFIG || total > sizeof(d))
+    HOST_fail("configuration descriptor header (%d bytes)", n);
+  else if((n = HOST_control(USB_REQ_TYP_IN, USB_GET_DESCRIPTOR, USB_DESCR_TYP_CONFIG << 8,
+                            0, 0xFFFF, d)) != total)
+    HOST_fail("configuration descriptor: %d of %u bytes", n, total);
+  for(i=0; i<4; i++) {
+    n = HOST_control(USB_REQ_TYP_IN, USB_GET_DESCRIPTOR, (USB_DESCR_TYP_STRING << 8) | i,
+                     0x0409, 255, d);
+    if(n < 2 || n != d[0]) HOST_fail("string descriptor %u (%d bytes)", i, n);
+  }
+  for(i=0; i<HID_ITFS; i++) {
+    n = HOST_control(USB_REQ_TYP_IN | USB_REQ_RECIP_INTERF, USB_GET_DESCRIPTOR,
+                     USB_DESCR_TYP_REPORT << 8, i, sizeof(d), d);
+    if(n <= 0) HOST_fail("report descriptor of interface %u (%d bytes)", i, n);
+  }
+  HOST_control(USB_REQ_TYP_OUT, USB_SET_CONFIGURATION, 1, 0, 0, 0);
+  if(!USB_ENUM_OK) HOST_fail("not configured after SET_CONFIGURATION");
+  HOST_configured = 1;
+  return total;
+}
+
+// Enumerate, then set a keyboard idle rate of 100 ms for one second: the last
+// keyboard report is repeated at that rate, and no more once it is 0 again
+static uint8_t HOST_enum(void) {
+  static uint16_t total;
+  static uint32_t keyboard, repeats;
+
+  switch(HOST_phase) {
+    case 0:
+      total = HOST_enumerate();
+      HOST_control(USB_REQ_TYP_CLASS | USB_REQ_RECIP_INTERF, HID_SET_IDLE, 25 << 8,
+                   HID_ITF_KEYBOARD, 0, 0);
+      keyboard   = HOST_keyboard;
+      HOST_wait  = 1000;
+      HOST_phase = 1;
+      return 1;
+
+    case 1:
+      repeats = HOST_keyboard - keyboard;
+      if(repeats < 9 || repeats > 11)
+        HOST_fail("%lu keyboard reports in 1000 ms at an idle rate of 100 ms",
+                  (unsigned long)repeats);
+      HOST_control(USB_REQ_TYP_CLASS | USB_REQ_RECIP_INTERF, HID_SET_IDLE, 0,
+                   HID_ITF_KEYBOARD, 0, 0);
+      keyboard   = HOST_keyboard;
+      HOST_wait  = 1000;
+      HOST_phase = 2;
+      return 1;
+
+    default:
+      if(HOST_keyboard - keyboard > 1)
+        HOST_fail("%lu keyboard reports after SET_IDLE 0",
+                  (unsigned long)(HOST_keyboard - keyboard));
+      printf("enum     ok  configuration descriptor %u bytes, %lu keyboard repeats\n",
+             total, (unsigned long)repeats);
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: Key Traces
+// ===================================================================================
+
+// Ticks a settled level is held
+static uint16_t HOST_hold(uint8_t pressed) {
+  if(!(HOST_rand() & 7)) return HOST_range(SCAN_DEBOUNCE, pressed ? 400 : 100);
+  return HOST_range(SCAN_DEBOUNCE, 40);
+}
+
+// Pick the driven keys and release them
+static void HOST_initKeys(void) {
+  uint8_t i, j;
+  HOST_keys = 0;
+  for(i=0; HOST_inputs[i].pin != 0xFF; i++) {
+    for(j=0; j<HOST_keys && HOST_key[j].slot != HOST_inputs[i].slot; j++);
+    if(j < HOST_keys || MAC_bound(HOST_inputs[i].slot)) continue;
+    memset(&HOST_key[HOST_keys], 0, sizeof(HOST_KEY));
+    HOST_key[HOST_keys].pin  = HOST_inputs[i].pin;
+    HOST_key[HOST_keys].slot = HOST_inputs[i].slot;
+    HOST_setPin(HOST_inputs[i].pin, 0);
+    HOST_keys++;
+  }
+}
+
+// Advance the trace of a key by one tick. An edge bounces an even number of
+// times, shorter than SCAN_DEBOUNCE each, a settled level may see a glitch.
+static void HOST_keyTick(HOST_KEY* k, uint8_t stop) {
+  if(k->left && --k->left) {
+    if(!k->bounce && k->stable >= SCAN_DEBOUNCE && k->left > 2 * SCAN_DEBOUNCE
+       && !(HOST_rand() & 127)) {
+      k->raw    = !k->level;                    // glitch
+      k->bounce = 1;
+      k->left   = HOST_range(1, SCAN_DEBOUNCE - 1);
+    }
+  }
+  else if(k->bounce) {
+    k->raw = !k->raw;
+    k->left = --k->bounce ? HOST_range(1, SCAN_DEBOUNCE - 1) : HOST_hold(k->level);
+  }
+  else if(!(stop && !k->level)) {               // next edge
+    k->level  = !k->level;
+    k->raw    = k->level;
+    k->bounce = 2 * HOST_range(0, 3);
+    k->left   = k->bounce ? HOST_range(1, SCAN_DEBOUNCE - 1) : HOST_hold(k->level);
+    k->stable = 0;
+    if(k->level) k->presses++;
+    HOST_changes++;
+  }
+  if(k->raw == k->level && !k->bounce) k->stable++;
+  else k->stable = 0;
+  HOST_setPin(k->pin, k->raw);
+}
+
+// Compare a settled key with its contact
+static void HOST_checkKey(HOST_KEY* k) {
+  uint8_t id = MAP_table[k->slot].id;
+  HOST_CONTACT* c = &HOST_contact[id];
+  if(k->stable < SCAN_DEBOUNCE + HOST_SETTLE) return;
+  if(c->touch != k->level)
+    HOST_fail("key of slot %u %s, contact %u %s", k->slot, k->level ? "pressed" : "released",
+              id, c->touch ? "touches" : "lifted");
+  else if(c->downs - k->downs != k->presses)
+    HOST_fail("key of slot %u pressed %lu times, contact %u down %lu times", k->slot,
+              (unsigned long)k->presses, id, (unsigned long)(c->downs - k->downs));
+  else return;
+  k->downs = c->downs - k->presses;             // report once
+}
+
+static uint8_t HOST_traces(void) {
+  uint32_t presses = 0, reports;
+  uint8_t  i;
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_initKeys();
+      for(i=0; i<HOST_keys; i++) HOST_key[i].downs = HOST_contact[MAP_table[HOST_key[i].slot].id].downs;
+      HOST_changes = 0;
+      HOST_count   = HOST_reports;
+      HOST_phase   = 1;
+      // fall through
+    case 1:
+      for(i=0; i<HOST_keys; i++) presses += HOST_key[i].presses;
+      for(i=0; i<HOST_keys; i++) {
+        HOST_keyTick(&HOST_key[i], presses >= HOST_traceCount);
+        HOST_checkKey(&HOST_key[i]);
+      }
+      if(presses < HOST_traceCount) return 1;
+      for(i=0; i<HOST_keys; i++) {
+        if(HOST_key[i].level || HOST_key[i].stable < SCAN_DEBOUNCE + HOST_SETTLE) return 1;
+      }
+      HOST_wait  = 2 * HOST_KEYFRAME_MAX;       // keyframe after the last lift
+      HOST_phase = 2;
+      return 1;
+
+    default:
+      if(HOST_touching) HOST_fail("%u contacts touch with all keys released", HOST_touching);
+      reports = HOST_reports - HOST_count;
+      printf("traces   ok  %lu traces on %u keys, %lu input changes, %lu touch reports"
+             " (%.3f per change, %lu keyframes)\n", (unsigned long)HOST_traceCount, HOST_keys,
+             (unsigned long)HOST_changes, (unsigned long)reports,
+             HOST_changes ? (double)reports / HOST_changes : 0.0, (unsigned long)HOST_repeats);
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: Macro Programs
+// ===================================================================================
+
+// Double tap at 1000/1000, see MACRO_DEFAULTS in config.h
+static const uint8_t HOST_doubleTap[] = {
+  MAC_DOWN, 0, 0xE8, 0x03, 0xE8, 0x03,  MAC_WAIT, 30, 0,  MAC_UP, 0,  MAC_WAIT, 30, 0,
+  MAC_LOOP, 2, 14,  MAC_END
+};
+
+static uint8_t HOST_macro(void) {
+  uint8_t id;
+  HOST_KEY* k = &HOST_key[0];
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_initKeys();
+      if(!HOST_keys || k->slot) {
+        printf("macro    --  no key on slot 0\n");
+        return 0;
+      }
+      memset(&MAC_staging, MAC_NONE, sizeof(MAC_staging));
+      memset(MAC_staging.code, MAC_END, sizeof(MAC_staging.code));
+      MAC_staging.bind[0] = 0;
+      memcpy(MAC_staging.code, HOST_doubleTap, sizeof(HOST_doubleTap));
+      if(!MAC_request(0)) HOST_fail("macro update refused");
+      HOST_phase = 1;
+      return 1;
+
+    case 1:
+      if(MAC_busy()) return 1;
+      k->downs = HOST_contact[MAP_table[0].id].downs;
+      HOST_setPin(k->pin, 1);
+      HOST_wait  = 20;
+      HOST_phase = 2;
+      return 1;
+
+    case 2:
+      HOST_setPin(k->pin, 0);
+      HOST_wait  = 300;
+      HOST_phase = 3;
+      return 1;
+
+    case 3:
+      id = MAP_table[0].id;
+      if(HOST_contact[id].downs - k->downs != 2 || HOST_contact[id].touch
+         || HOST_contact[id].x != 1000 || HOST_contact[id].y != 1000)
+        HOST_fail("double tap: contact %u down %lu times, at %u/%u, %s", id,
+                  (unsigned long)(HOST_contact[id].downs - k->downs), HOST_contact[id].x,
+                  HOST_contact[id].y, HOST_contact[id].touch ? "touches" : "lifted");
+      MAC_request(1);
+      HOST_phase = 4;
+      return 1;
+
+    default:
+      if(MAC_busy()) return 1;
+      printf("macro    ok  double tap program\n");
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: Random Macro Programs
+// ===================================================================================
+static uint8_t HOST_vm(void) {
+  uint8_t i;
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_initKeys();
+      HOST_count = 0;
+      HOST_phase = 1;
+      // fall through
+    case 1:                                     // random programs, opcodes are likely
+      for(i=0; i<MAP_KEYS; i++)
+        MAC_staging.bind[i] = HOST_rand() & 3 ? HOST_rand() % MAC_CODE_SIZE : MAC_NONE;
+      for(i=0; i<MAC_CODE_SIZE; i++)
+        MAC_staging.code[i] = HOST_rand() & 1 ? HOST_rand() % (MAC_LOOP + 1) : HOST_rand();
+      if(!MAC_request(0)) HOST_fail("macro update refused");
+      HOST_phase = 2;
+      return 1;
+
+    case 2:
+      if(MAC_busy()) return 1;
+      for(i=0; i<HOST_keys; i++) HOST_setPin(HOST_key[i].pin, HOST_rand() & 1);
+      HOST_wait  = HOST_range(1, 60);
+      HOST_phase = 3;
+      return 1;
+
+    case 3:
+      for(i=0; i<HOST_keys; i++) HOST_setPin(HOST_key[i].pin, 0);
+      HOST_wait  = HOST_range(20, 200);
+      HOST_phase = 4;
+      return 1;
+
+    case 4:                                     // defaults stop all programs
+      MAC_request(1);
+      HOST_phase = 5;
+      return 1;
+
+    case 5:
+      if(MAC_busy()) return 1;
+      HOST_wait  = 2 * HOST_KEYFRAME_MAX;
+      HOST_phase = 6;
+      return 1;
+
+    default:
+      if(HOST_touching) HOST_fail("%u contacts touch after program %lu", HOST_touching,
+                                  (unsigned long)HOST_count);
+      if(++HOST_count < HOST_traceCount / 20 + 1) {
+        HOST_phase = 1;
+        return 1;
+      }
+      printf("vm       ok  %lu random programs, %lu keyboard reports\n",
+             (unsigned long)HOST_count, (unsigned long)HOST_keyboard);
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: Touch Map Updates
+// ===================================================================================
+extern __xdata uint8_t MT_knownCount;
+
+// New random contact IDs while random keys are held, the host must see the keys
+// with their new IDs only, the old IDs lifted
+static uint8_t HOST_map(void) {
+  uint8_t i, j, id, pressed;
+  HOST_KEY* k;
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_initKeys();
+      HOST_count = 0;
+      HOST_phase = 1;
+      // fall through
+    case 1:
+      for(i=0, k=HOST_key; i<HOST_keys; i++, k++) {
+        k->level = HOST_rand() & 1;
+        HOST_setPin(k->pin, k->level);
+      }
+      HOST_wait  = HOST_range(0, 40);           // map change while the edges settle
+      HOST_phase = 2;
+      return 1;
+
+    case 2:
+      memcpy(&MAP_staging, &MAP_data, sizeof(MAP_staging));
+      for(i=0; i<MAP_KEYS; i++) {
+        do {                                    // unique IDs
+          id = HOST_rand();
+          for(j=0; j<i && MAP_staging.key[j].id != id; j++);
+        } while(j < i);
+        MAP_staging.key[i].id = id;
+      }
+      if(!MAP_request(0)) HOST_fail("map update refused");
+      HOST_phase = 3;
+      return 1;
+
+    case 3:
+      if(MAP_busy()) return 1;
+      HOST_wait  = 2 * SCAN_DEBOUNCE + 2 * HOST_SETTLE;
+      HOST_phase = 4;
+      return 1;
+
+    case 4:
+      for(i=0, pressed=0, k=HOST_key; i<HOST_keys; i++, k++) {
+        id = MAP_table[k->slot].id;
+        if(HOST_contact[id].touch != k->level)
+          HOST_fail("key of slot %u %s, contact %u %s after map %lu", k->slot,
+                    k->level ? "pressed" : "released", id,
+                    HOST_contact[id].touch ? "touches" : "lifted", (unsigned long)HOST_count);
+        pressed += k->level;
+        HOST_setPin(k->pin, 0);
+        k->level = 0;
+      }
+      if(HOST_touching != pressed)
+        HOST_fail("%u contacts touch with %u keys pressed", HOST_touching, pressed);
+      if(MT_knownCount > MT_MAX_CONTACTS) HOST_fail("%u known contacts", MT_knownCount);
+      HOST_wait  = HOST_range(0, 40);
+      HOST_phase = ++HOST_count < HOST_traceCount / 20 + 1 ? 1 : 5;
+      return 1;
+
+    case 5:                                     // back to the default map
+      MAP_request(1);
+      HOST_phase = 6;
+      return 1;
+
+    case 6:
+      if(MAP_busy()) return 1;
+      HOST_wait  = 2 * HOST_KEYFRAME_MAX;
+      HOST_phase = 7;
+      return 1;
+
+    default:
+      if(HOST_touching) HOST_fail("%u contacts touch with the default map", HOST_touching);
+      printf("map      ok  %lu maps with new contact IDs\n", (unsigned long)HOST_count);
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: Key Matrix
+// ===================================================================================
+#ifdef SCAN_MATRIX_ROWS
+
+// Random sets of up to two matrix keys (two keys of one row, of one column or
+// diagonal, never a phantom key) with random direct keys held and the idle D-
+// line low, every fourth set two keys of one column with all direct keys held.
+// Every key must be accepted, every contact must follow the keys of its slot.
+static uint8_t HOST_matrix(void) {
+  static uint16_t down;
+  static uint32_t columns;
+  uint8_t i, j, n, touch;
+  uint16_t matKeys = 0;
+
+  for(i=0; i<SCAN_KEYS; i++)
+    if(HOST_scanKey[i].row != 0xFF) matKeys |= 1U << i;
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_count = 0;
+      columns    = 0;
+      HOST_phase = 1;
+      // fall through
+    case 1:
+      down = 0;
+      if(!(HOST_count & 3)) {                   // two keys of one column
+        do i = HOST_range(0, SCAN_KEYS - 1); while(!(matKeys & (1U << i)));
+        for(j=0; j<SCAN_KEYS; j++)
+          if(j != i && (matKeys & (1U << j)) && HOST_scanKey[j].pin == HOST_scanKey[i].pin)
+            break;
+        if(j < SCAN_KEYS) down = (1U << i) | (1U << j) | ~matKeys;
+        columns++;
+      }
+      else {
+        for(n=HOST_range(0, 2); n; n--) {
+          do i = HOST_range(0, SCAN_KEYS - 1); while(!(matKeys & (1U << i)));
+          down |= 1U << i;
+        }
+        down |= HOST_rand() & ~matKeys;
+      }
+      down &= (1U << SCAN_KEYS) - 1;
+      HOST_matDown = down & matKeys;
+      for(i=0; i<SCAN_KEYS; i++)
+        if(HOST_scanKey[i].row == 0xFF) HOST_setPin(HOST_scanKey[i].pin, (down >> i) & 1);
+      HOST_wait  = sizeof(HOST_rowPin) * (SCAN_DEBOUNCE + 1) + HOST_SETTLE;
+      HOST_phase = 2;
+      return 1;
+
+    case 2:
+      if((uint16_t)SCAN_state != down)
+        HOST_fail("keys 0x%04x pressed, 0x%04x accepted", down, (uint16_t)SCAN_state);
+      for(i=0; i<MAP_KEYS; i++) {
+        if(MAC_bound(i)) continue;
+        for(j=0, touch=0; j<SCAN_KEYS; j++)
+          if(HOST_scanKey[j].slot == i && (down & (1U << j))) touch = 1;
+        if(HOST_contact[MAP_table[i].id].touch != touch)
+          HOST_fail("keys 0x%04x pressed, contact of slot %u %s", down, i,
+                    touch ? "lifted" : "touches");
+      }
+      HOST_phase = ++HOST_count < HOST_traceCount / 20 + 1 ? 1 : 3;
+      if(HOST_phase == 1) return 1;
+      down = HOST_matDown = 0;                  // release all
+      for(i=0; i<SCAN_KEYS; i++)
+        if(HOST_scanKey[i].row == 0xFF) HOST_setPin(HOST_scanKey[i].pin, 0);
+      HOST_wait = sizeof(HOST_rowPin) * (SCAN_DEBOUNCE + 1) + 2 * HOST_KEYFRAME_MAX;
+      return 1;
+
+    default:
+      if(SCAN_state || HOST_touching)
+        HOST_fail("%u contacts touch with all keys released", HOST_touching);
+      printf("matrix   ok  %lu key sets, %lu with two keys in one column\n",
+             (unsigned long)HOST_count, (unsigned long)columns);
+      return 0;
+  }
+}
+#endif
+
+// ===================================================================================
+// Test: USB Recovery
+// ===================================================================================
+
+// The host stops polling while a key is pressed, the supervisor must re-attach
+// within SUP_EP1_MS, the host resets the bus, enumerates again and sees the key
+static uint8_t HOST_recover(void) {
+  static uint32_t start, detach, attach, back, reattaches;
+  HOST_KEY* k = &HOST_key[0];
+  uint8_t   id;
+
+  switch(HOST_phase) {
+    case 0:
+      HOST_initKeys();
+      if(!HOST_keys) {
+        printf("recover  --  no key without macro\n");
+        return 0;
+      }
+      reattaches      = PERF_stats.reattaches;
+      HOST_configured = 0;                      // host stops polling
+      HOST_setPin(k->pin, 1);
+      start      = HOST_ms;
+      HOST_phase = 1;
+      return 1;
+
+    case 1:
+      if(USB_CTRL & bUC_DEV_PU_EN) {
+        if(HOST_ms - start <= SUP_EP1_MS + 2 * SCAN_DEBOUNCE + HOST_SETTLE) return 1;
+        HOST_fail("still attached %lu ms after the host stopped polling",
+                  (unsigned long)(HOST_ms - start));
+        return 0;
+      }
+      detach     = HOST_ms;
+      HOST_phase = 2;
+      return 1;
+
+    case 2:
+      if(!(USB_CTRL & bUC_DEV_PU_EN)) {
+        if(HOST_ms - detach <= SUP_DETACH_MS + 2) return 1;
+        HOST_fail("detached for %lu ms", (unsigned long)(HOST_ms - detach));
+        return 0;
+      }
+      attach = HOST_ms;
+      memset(HOST_contact, 0, sizeof(HOST_contact));    // host dropped the device
+      HOST_frameLeft = 0;
+      HOST_touching  = 0;
+      UIF_BUS_RST    = 1;                       // bus reset, enumerate again
+      USB_interrupt();
+      UIF_BUS_RST    = 0;                       // the bit is not part of USB_INT_FG here
+      HOST_enumerate();
+      HOST_phase = 3;
+      return 1;
+
+    case 3:                                     // first frame or keyframe
+      id = MAP_table[k->slot].id;
+      if(!HOST_contact[id].touch) {
+        if(HOST_ms - attach <= 2 * HOST_KEYFRAME_MAX) return 1;
+        HOST_fail("contact %u lifted after re-enumeration with the key pressed", id);
+      }
+      back = HOST_ms;
+      if(PERF_stats.reattaches != (uint8_t)(reattaches + 1))
+        HOST_fail("%u re-attaches counted", (uint8_t)(PERF_stats.reattaches - reattaches));
+      HOST_setPin(k->pin, 0);
+      HOST_wait  = 2 * HOST_KEYFRAME_MAX;
+      HOST_phase = 4;
+      return 1;
+
+    default:
+      if(HOST_touching) HOST_fail("%u contacts touch with all keys released", HOST_touching);
+      printf("recover  ok  detached %lu ms after the host stopped polling, attached after"
+             " %lu ms, touch screen back %lu ms after the stall\n",
+             (unsigned long)(detach - start), (unsigned long)(attach - detach),
+             (unsigned long)(back - start));
+      return 0;
+  }
+}
+
+// ===================================================================================
+// Test: EP0 and Relay Fuzzing
+// ===================================================================================
+static const uint8_t HOST_types[] = {
+  0x00, 0x01, 0x02, 0x80, 0x81, 0x82, 0x21, 0xA1, 0x40, 0xC0
+};
+
+static uint8_t HOST_ep0(void) {
+  static uint32_t stalls, frames;
+  uint8_t  data[512], type, req;
+  uint16_t value, index, len, i;
+
+  if(!(HOST_rand() % 8)) {                        // relay frame
+    len = HOST_range(0, EP2_SIZE);
+    for(i=0; i<len; i++) EP2_buffer[i] = HOST_rand();
+    if(HOST_rand() & 3) EP2_buffer[0] = REPORT_ID_RELAY;
+    HOST_token(UIS_TOKEN_OUT | 2, len);
+    frames++;
+  }
+  else {
+    type  = HOST_rand() & 7 ? HOST_types[HOST_rand() % sizeof(HOST_types)] : HOST_rand();
+    req   = HOST_rand() & 3 ? HOST_rand() % 0x14 : HOST_rand();
+    value = HOST_rand() & 1 ? HOST_rand() : ((HOST_rand() % 4) << 8) | (HOST_rand() % 4);
+    index = HOST_rand() & 1 ? HOST_rand() % 4 : HOST_rand();
+    len   = HOST_rand() & 1 ? HOST_rand() % 16 : HOST_rand() % sizeof(data);
+    if((type & USB_REQ_TYP_MASK) == USB_REQ_TYP_VENDOR && req == VEN_START_CRC)
+      req = VEN_GET_CRC;                        // reads code flash at wValue
+    for(i=0; i<len; i++) data[i] = HOST_rand();
+    if(HOST_control(type, req, value, index, len, data) < 0) stalls++;
+  }
+  if(++HOST_count < HOST_traceCount) return 1;
+  printf("ep0      ok  %lu transfers (%lu stalled), %lu relay frames\n",
+         (unsigned long)(HOST_count - frames), (unsigned long)stalls, (unsigned long)frames);
+  return 0;
+}
+
+static const HOST_TEST HOST_tests[] = {
+  {"enum",   HOST_CHK_FRAME | HOST_CHK_TIMING, HOST_enum},
+  {"traces", HOST_CHK_FRAME | HOST_CHK_TIMING, HOST_traces},
+  {"macro",  HOST_CHK_FRAME | HOST_CHK_TIMING, HOST_macro},
+  {"vm",     HOST_CHK_FRAME | HOST_CHK_TIMING, HOST_vm},
+  {"map",    HOST_CHK_FRAME,                   HOST_map},
+  #ifdef SCAN_MATRIX_ROWS
+  {"matrix", HOST_CHK_FRAME,                   HOST_matrix},
+  #endif
+  {"recover", HOST_CHK_FRAME,                   HOST_recover},
+  {"ep0",    0,                                HOST_ep0},
+};
+#define HOST_TESTS (sizeof(HOST_tests) / sizeof(HOST_tests[0]))
+
+// ===================================================================================
+// Scan Tick (called by PWR_idle() of the main loop)
+// ===================================================================================
+void HOST_tick(void) {
+  HOST_us += HOST_TICK_US;
+  while(HOST_us >= 1000) {                      // millisecond tick and USB frame
+    HOST_us -= 1000;
+    HOST_ms++;
+    TB_interrupt();
+    if(!(HOST_ms % USB_POLL_INTERVAL)) HOST_poll();
+  }
+  if((HOST_checks & HOST_CHK_TIMING) && HOST_touching
+     && HOST_ms - HOST_lastReport > HOST_KEYFRAME_MAX) {
+    HOST_fail("no touch report for %lu ms while touching",
+              (unsigned long)(HOST_ms - HOST_lastReport));
+    HOST_lastReport = HOST_ms;
+  }
+  if(HOST_wait) HOST_wait--;
+  else if(!HOST_tests[HOST_test].run()) {       // next test
+    HOST_phase = 0;
+    HOST_count = 0;
+    if(++HOST_test == HOST_TESTS) HOST_exit();
+    HOST_name   = HOST_tests[HOST_test].name;
+    HOST_checks = HOST_tests[HOST_test].checks;
+  }
+  #ifdef SCAN_MATRIX_ROWS
+  HOST_columns();
+  #endif
+  SCAN_interrupt();
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+int main(int argc, char** argv) {
+  uint8_t i;
+
+  setvbuf(stdout, 0, _IOLBF, 0);                // keep the lines before an abort
+  if(argc > 1) HOST_traceCount = strtoul(argv[1], 0, 0);
+  if(argc > 2) HOST_seed = strtoul(argv[2], 0, 0);
+  if(!HOST_traceCount) HOST_traceCount = 1;
+  if(!HOST_seed) HOST_seed = 1;
+  printf("Host tests: %lu traces, seed %lu\n", (unsigned long)HOST_traceCount,
+         (unsigned long)HOST_seed);
+
+  memset(HOST_flash, 0xFF, sizeof(HOST_flash)); // erased data flash
+  P1 = 0xFF;                                    // pull-ups: keys released, encoder
+  P3 = 0xFF;                                    // at rest
+  for(i=0; i<16; i++) *HOST_bit[i] = 1;
+  HOST_setPin(P37, 1);                          // USB idle: D- low
+  HOST_name   = HOST_tests[0].name;
+  HOST_checks = HOST_tests[0].checks;
+  HOST_clock  = clock();
+  HOST_firmware();                              // HOST_tick() ends the run
+  return 1;
+}
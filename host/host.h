@@ -0,0 +1,64 @@
+// ===================================================================================
+// Host Build Mocks for CH551, CH552 and CH554                                * v1.0 *
+// ===================================================================================
+//
+// Forced include of the host build (make host, gcc -include host/host.h): the
+// SDCC storage classes and SFR types are mapped to plain C, so src/ch554.h
+// declares every SFR, SFR bit and endpoint buffer as an ordinary variable. The
+// firmware reads and writes them as on the chip, the test harness (host/host.c)
+// sets the status registers the hardware would set and reads back what the
+// firmware armed. SFR bits and their SFR bytes are separate variables here, the
+// harness drives and reads the ports as bytes (P1, P3), as the scan engine does.
+//
+// Code that only compiles for the 8051 (inline assembly) is left out with
+// HOST_BUILD, the drivers that only work on the chip (flash.c, power.c) are
+// replaced by host/mock.c.
+//
+// Differences to the chip that matter for the tests:
+// - int is 32 bits wide, char is unsigned as with SDCC (-funsigned-char)
+// - structs are packed as with SDCC (-fpack-struct=1)
+// - interrupts are function calls made by the harness, nothing preempts the
+//   main loop, so EA and the IE bits have no effect
+
+#pragma once
+#include <stdint.h>
+
+#ifdef HOST_BUILD
+
+// Storage classes and memory spaces
+#define __xdata
+#define __code          const
+#define __idata
+#define __data
+#define __pdata
+#define __near
+#define __at(addr)
+
+// SFR types
+#define __bit           _Bool
+#define __sbit          volatile _Bool
+#define __sfr           volatile unsigned char
+#define __sfr16         volatile unsigned short
+#define __sfr32         volatile unsigned long
+
+// Function attributes
+#define __interrupt(n)
+#define __using(n)
+#define __reentrant
+#define __critical
+#define __naked
+
+// Test harness
+void HOST_tick(void);                   // next scan tick (called by PWR_idle())
+extern __xdata uint8_t HOST_flash[128]; // data flash
+
+// Matrix build (make host runs it after the default build): the example matrix of
+// src/config.h, rows P10, P35 and columns P12, P13, next to the direct keys
+#ifdef HOST_MATRIX
+#define SCAN_INPUTS(PIN, MATRIX) \
+  PIN(PIN_KEY1, 0) PIN(PIN_KEY2, 1) PIN(PIN_KEY3, 2) PIN(PIN_ENC_SW, 2) \
+  MATRIX(0, P12, 0) MATRIX(0, P13, 1) MATRIX(1, P12, 2) MATRIX(1, P13, 2)
+#define SCAN_MATRIX_ROWS  P10, P35
+#endif
+
+#endif
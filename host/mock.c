@@ -0,0 +1,55 @@
+// ===================================================================================
+// Host Build Drivers for CH551, CH552 and CH554                              * v1.0 *
+// ===================================================================================
+//
+// Replaces the drivers that only work on the chip in the host build: the data
+// flash is an array, PWR_idle() hands over to the test harness for the next
+// scan tick instead of waiting for timer0.
+
+#include "src/flash.h"
+#include "src/power.h"
+#include "src/system.h"
+
+// ===================================================================================
+// Data Flash
+// ===================================================================================
+__xdata uint8_t HOST_flash[128];                // erased by the harness
+
+uint8_t FLASH_read(uint8_t addr) {
+  return addr < sizeof(HOST_flash) ? HOST_flash[addr] : 0xFF;
+}
+
+uint8_t FLASH_write(uint8_t addr, uint8_t data) {
+  if(addr >= sizeof(HOST_flash)) return 0;      // no ROM_ADDR_OK
+  HOST_flash[addr] = data;
+  return 1;
+}
+
+// ===================================================================================
+// Power Management
+// ===================================================================================
+volatile uint8_t PWR_wakeLatency;
+
+void PWR_idle(void) {
+  HOST_tick();                                  // harness runs one scan tick
+}
+
+void PWR_suspendIrq(void) {
+}
+
+void PWR_reportQueued(void) {
+}
+
+// ===================================================================================
+// System Functions
+// ===================================================================================
+// External definitions of the inline functions of system.h (C99 inline), for
+// calls gcc does not inline
+extern void CLK_config(void);
+extern void CLK_external(void);
+extern void CLK_inernal(void);
+extern void WDT_start(void);
+extern void WDT_stop(void);
+extern void RST_now(void);
+extern void BOOT_now(void);
+extern void BOOT_prepare(void);
@@ -0,0 +1,167 @@
+// ===================================================================================
+// NeoPixel Animation Engine for CH551, CH552 and CH554                       * v1.0 *
+// ===================================================================================
+
+#include "anim.h"
+#include "neo.h"
+#include "timebase.h"
+#include "usb_hid.h"
+
+// ===================================================================================
+// Variables and Tables
+// ===================================================================================
+#if ANIM_FRAME_MS < 1 || ANIM_FRAME_MS > 255
+  #error ANIM_FRAME_MS must be within 1..255 ms!
+#endif
+
+__xdata ANIM_PIXEL ANIM_pixel[NEO_COUNT];       // pixel states
+__xdata uint8_t    ANIM_frames;                 // frame ticks not rendered yet
+
+// Level -> brightness, gamma 2.2
+__code uint8_t ANIM_gamma[ANIM_LEVEL_MAX + 1] = {
+    0,   0,   0,   0,   1,   1,   1,   2,   3,   4,   4,   5,   7,   8,   9,  11,
+   13,  14,  16,  18,  20,  23,  25,  28,  31,  33,  36,  40,  43,  46,  50,  54,
+   57,  61,  66,  70,  74,  79,  84,  89,  94,  99, 105, 110, 116, 122, 128, 134,
+  140, 147, 153, 160, 167, 174, 182, 189, 197, 205, 213, 221, 229, 238, 246, 255
+};
+
+// Crossfade between two primaries over 64 hue steps, sine shaped
+__code uint8_t ANIM_ramp[64] = {
+    0,   6,  13,  19,  25,  32,  38,  44,  51,  57,  63,  69,  75,  81,  87,  93,
+   99, 105, 111, 116, 122, 128, 133, 138, 144, 149, 154, 159, 164, 169, 173, 178,
+  183, 187, 191, 195, 199, 203, 207, 211, 214, 218, 221, 224, 227, 230, 232, 235,
+  237, 240, 242, 244, 245, 247, 249, 250, 251, 252, 253, 254, 254, 255, 255, 255
+};
+
+// Color channel c scaled by brightness b (255: c)
+#define ANIM_scale(c, b)  ((uint8_t)(((uint16_t)(c) * (b) + (c)) >> 8))
+
+// ===================================================================================
+// Start and Set Pixels
+// ===================================================================================
+
+// Frame tick (timer callback), rendered by ANIM_poll()
+void ANIM_step(void) {
+  if(ANIM_frames < 0xFF) ANIM_frames++;
+}
+
+void ANIM_init(void) {
+  uint8_t i;
+  for(i=0; i<NEO_COUNT; i++) {
+    ANIM_pixel[i].effect = ANIM_OFF;
+    ANIM_pixel[i].flags  = 0;
+    ANIM_pixel[i].level  = 0;
+    ANIM_pixel[i].phase  = 0;
+  }
+  ANIM_frames = 0;
+  TB_start(TB_TMR_ANIM, ANIM_FRAME_MS, ANIM_FRAME_MS, ANIM_step);
+}
+
+void ANIM_color(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b) {
+  __xdata ANIM_PIXEL* a = &ANIM_pixel[pixel];
+  a->r = r;
+  a->g = g;
+  a->b = b;
+}
+
+// Hue 0..191 in three phases, as NEO_writeHue()
+void ANIM_hue(uint8_t pixel, uint8_t hue) {
+  uint8_t s = ANIM_ramp[hue & 63];
+  uint8_t n = ANIM_ramp[63 - (hue & 63)];
+  ANIM_pixel[pixel].phase = hue;
+  switch(hue >> 6) {
+    case 0:   ANIM_color(pixel, n, s, 0); break;
+    case 1:   ANIM_color(pixel, 0, n, s); break;
+    default:  ANIM_color(pixel, s, 0, n); break;
+  }
+}
+
+// A flash is a fade that starts at full level, a pulse starts dark, a rainbow
+// starts at the hue of the last ANIM_hue()
+void ANIM_start(uint8_t pixel, uint8_t effect, uint8_t level, uint8_t speed) {
+  __xdata ANIM_PIXEL* a = &ANIM_pixel[pixel];
+  a->target = level > ANIM_LEVEL_MAX ? ANIM_LEVEL_MAX : level;
+  a->speed  = speed;
+  if(effect == ANIM_FLASH) {
+    a->level = ANIM_LEVEL_MAX;
+    effect   = ANIM_FADE;
+  }
+  else if(effect == ANIM_PULSE) a->phase = 0;
+  a->effect = effect;
+}
+
+// Key feedback, only edges of the touch state start an effect
+void ANIM_key(uint8_t pixel, uint8_t touching) {
+  __xdata ANIM_PIXEL* a = &ANIM_pixel[pixel];
+  if(pixel >= NEO_COUNT || !touching == !(a->flags & ANIM_TOUCHING)) return;
+  if(touching) {
+    a->flags |= ANIM_TOUCHING;
+    ANIM_color(pixel, ANIM_KEY_COLOR);
+    ANIM_start(pixel, ANIM_KEY_TOUCH, ANIM_KEY_LEVEL, ANIM_KEY_SPEED);
+  }
+  else {
+    a->flags &= ~ANIM_TOUCHING;
+    ANIM_start(pixel, ANIM_FADE, 0, ANIM_KEY_SPEED);
+  }
+}
+
+// ===================================================================================
+// Render Frames
+// ===================================================================================
+
+// One step of frames for every pixel, NEO_writeColor() marks changed pixels
+void ANIM_render(uint8_t frames) {
+  __xdata ANIM_PIXEL* a = ANIM_pixel;
+  uint16_t step, hue;
+  uint8_t  i, level, b;
+
+  for(i=0; i<NEO_COUNT; i++, a++) {
+    step = (uint16_t)a->speed * frames;
+    if(step > 0xFF) step = 0xFF;
+    switch(a->effect) {
+      case ANIM_OFF:
+        level = 0;
+        break;
+
+      case ANIM_FADE:
+        level = a->level;
+        if(level < a->target)
+          level = a->target - level > step ? level + step : a->target;
+        else if(level > a->target)
+          level = level - a->target > step ? level - step : a->target;
+        if(level == a->target) a->effect = level ? ANIM_SOLID : ANIM_OFF;
+        break;
+
+      case ANIM_PULSE:                           // triangle 0..63..0 per 256 steps
+        a->phase += step;
+        level = (a->phase & 0x80 ? 0xFF - a->phase : a->phase) >> 1;
+        level = ((uint16_t)level * (a->target + 1)) >> 6;
+        break;
+
+      case ANIM_RAINBOW:
+        hue = a->phase + step;
+        while(hue >= 192) hue -= 192;
+        ANIM_hue(i, hue);
+        level = a->target;
+        break;
+
+      default:                                   // ANIM_SOLID
+        level = a->target;
+        break;
+    }
+    a->level = level;
+    b = ANIM_gamma[level];
+    NEO_writeColor(i, ANIM_scale(a->r, b), ANIM_scale(a->g, b), ANIM_scale(a->b, b));
+  }
+}
+
+// Reports first: frames wait while a report is queued or in flight, but no
+// longer than ANIM_DEFER_MAX frames
+void ANIM_poll(void) {
+  if(HID_queueDepth() && ANIM_frames <= ANIM_DEFER_MAX) return;
+  if(ANIM_frames) {
+    ANIM_render(ANIM_frames < ANIM_CATCHUP ? ANIM_frames : ANIM_CATCHUP);
+    ANIM_frames = 0;
+  }
+  NEO_update();                                  // only if a pixel changed
+}
@@ -0,0 +1,73 @@
+// ===================================================================================
+// NeoPixel Animation Engine for CH551, CH552 and CH554                       * v1.0 *
+// ===================================================================================
+//
+// Per pixel effects rendered into the NeoPixel buffer on a fixed frame tick
+// (ANIM_FRAME_MS, software timer TB_TMR_ANIM). Every pixel has a color and a
+// level (0..ANIM_LEVEL_MAX), the level runs through a gamma table in code flash
+// before it scales the color:
+//
+// ANIM_OFF      pixel dark, nothing to render
+// ANIM_SOLID    color at the target level
+// ANIM_FADE     level moves towards the target by 'speed' per frame, then solid
+// ANIM_FLASH    level jumps to ANIM_LEVEL_MAX, then fades to the target
+// ANIM_PULSE    level swings between 0 and the target, 'speed' sets the rate
+// ANIM_RAINBOW  hue cycles by 'speed' per frame at the target level, the hue
+//               comes from a crossfade table in code flash
+//
+// Frames are rendered by ANIM_poll() in the main loop, never while a touch
+// report is queued or in flight, so the pixels do not compete with the reports.
+// Frames missed meanwhile are caught up in a single render step (at most
+// ANIM_CATCHUP frames), the cost of a render is fixed by NEO_COUNT. A frame is
+// pushed out only if a pixel changed (NEO_update()). After ANIM_DEFER_MAX
+// deferred frames the pixels are rendered anyway, a host that stopped polling
+// does not freeze them.
+//
+// Functions available:
+// --------------------
+// ANIM_init()              all pixels off, start the frame timer (after TB_init())
+// ANIM_color(p, r, g, b)   set the color of pixel p
+// ANIM_hue(p, hue)         set the color of pixel p from a hue (0..191)
+// ANIM_start(p, effect, level, speed)
+//                          start an effect on pixel p with target level
+// ANIM_key(p, touching)    key feedback: ANIM_KEY_TOUCH on touch, fade out on
+//                          release (only on changes, see config.h)
+// ANIM_poll()              render and send pending frames, call from main loop
+// ANIM_render(frames)      advance all pixels by frames and render them
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#define ANIM_OFF        0               // effects
+#define ANIM_SOLID      1
+#define ANIM_FADE       2
+#define ANIM_FLASH      3
+#define ANIM_PULSE      4
+#define ANIM_RAINBOW    5
+
+#define ANIM_LEVEL_MAX  63              // full level
+#define ANIM_CATCHUP    8               // frames caught up at most in one render
+#define ANIM_DEFER_MAX  4               // frames deferred at most for reports
+
+#define ANIM_TOUCHING   0x01            // key of the pixel touches (ANIM_key)
+
+typedef struct _ANIM_PIXEL {
+  uint8_t effect;                       // ANIM_OFF ... ANIM_RAINBOW
+  uint8_t flags;                        // ANIM_TOUCHING
+  uint8_t r, g, b;                      // color at full level
+  uint8_t level;                        // current level
+  uint8_t target;                       // target level
+  uint8_t speed;                        // level or phase steps per frame
+  uint8_t phase;                        // pulse phase or hue (0..191)
+} ANIM_PIXEL;
+
+extern __xdata ANIM_PIXEL ANIM_pixel[NEO_COUNT];
+
+void ANIM_init(void);                   // all pixels off, start frame timer
+void ANIM_color(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b);  // set color
+void ANIM_hue(uint8_t pixel, uint8_t hue);                        // color from hue
+void ANIM_start(uint8_t pixel, uint8_t effect, uint8_t level, uint8_t speed);
+void ANIM_key(uint8_t pixel, uint8_t touching);   // key feedback
+void ANIM_poll(void);                   // render pending frames, send pixels
+void ANIM_render(uint8_t frames);       // advance and render all pixels
@@ -18,12 +18,125 @@
 #define PIN_ENC_B           P30         // pin connected to knob outB
 #define NEO_COUNT           3           // number of NeoPixels
 
+// Input scan configuration
+#define SCAN_RATE_HZ        1000      // key and encoder sample rate in Hz
+#define SCAN_DEBOUNCE       5         // stable samples required for a key edge
+#define SCAN_QUEUE_SIZE     16        // event queue size (power of 2)
+
+// Input table (see src/scan.h), one entry per key in key order: PIN(pin, slot)
+// for a key to GND, MATRIX(row, pin, slot) for a key between a row of
+// SCAN_MATRIX_ROWS and a column pin. The slot is the contact (touch map key) the
+// key drives. Example 2x2 matrix on the free pins P10, P35 (rows), P12, P13
+// (columns): MATRIX(0, P12, 0) MATRIX(0, P13, 1) MATRIX(1, P12, 2) ...
+// The matrix build of the host tests brings its own table (host/host.h).
+#ifndef SCAN_INPUTS
+#define SCAN_INPUTS(PIN, MATRIX) \
+  PIN(PIN_KEY1, 0)                    /* key 1 */ \
+  PIN(PIN_KEY2, 1)                    /* key 2 */ \
+  PIN(PIN_KEY3, 2)                    /* key 3 */ \
+  PIN(PIN_ENC_SW, 2)                  /* encoder switch, shares the contact of key 3 */
+//#define SCAN_MATRIX_ROWS  P10, P35  // row pins of the key matrix, comma separated
+#endif
+
+// Rotary encoder configuration
+#define ENC_STEPS_PER_DETENT 4        // quadrature transitions per detent
+#define ENC_ACCEL                     // enable velocity-based acceleration
+#define ENC_ACCEL_MS        60        // detents closer than this are accelerated
+#define ENC_ACCEL_MAX       4         // maximum acceleration factor
+
 // NeoPixel configuration
 #define NEO_GRB                       // type of pixel: NEO_GRB or NEO_RGB
+#define NEO_IRQ_GAP                   // allow interrupts between pixels
+#define NEO_GAP_US          40        // a longer gap resends the frame (must be below
+                                      // the reset time of the pixels)
+
+// Pixel animations (see src/anim.h), the pixel of every contact slot shows its
+// touch state
+#define ANIM_FRAME_MS       20        // animation frame period in ms (1..255)
+#define ANIM_KEY_COLOR      50, 38, 0 // key feedback color (r, g, b) at full level
+#define ANIM_KEY_TOUCH      ANIM_FLASH // effect on touch: ANIM_FLASH, ANIM_FADE,
+                                      // ANIM_SOLID, ANIM_PULSE or ANIM_RAINBOW
+#define ANIM_KEY_LEVEL      48        // level while touching (0..63)
+#define ANIM_KEY_SPEED      6         // level steps per frame (flash decay, fades)
+
+// Display profile (see src/screen.h), screen pixels are mapped to the logical
+// touch range with it. More profiles can be selected via USB vendor request.
+#define DISPLAY_WIDTH       1080      // comma 3
+#define DISPLAY_HEIGHT      2160
+#define DISPLAY_ROTATION    SCR_ROT_0
+#define DISPLAY_OFFSET_X    0         // calibration offsets in logical units
+#define DISPLAY_OFFSET_Y    0
+#define DISPLAY_PROFILES \
+  SCR_PROFILE(2160, 1080, SCR_ROT_90, 0, 0) /* comma 3, landscape */
+
+// Touch map defaults (id, pressure, x, y), can be changed via USB vendor request.
+// SCR_PX(px, py) gives the logical x, y of a pixel of the display profile.
+#define MAP_KEYS            3         // number of mapped keys
+#define MAP_DEFAULTS \
+  {0x01, 0x7F, SCR_PX(110, 108)},     /* key 1: bookmark button */ \
+  {0x02, 0x7F, SCR_PX(540, 1080)},    /* key 2: center */ \
+  {0x03, 0x7F, SCR_PX(911, 2003)}     /* key 3 / encoder switch: experimental toggle */
+
+// Gesture defaults (type, frames, dx, dy), can be changed via USB vendor request.
+// GES_TAP on an encoder direction keeps it as mouse wheel. Example swipe up by
+// 40% within 150 frames: {GES_SWIPE, 150, 0, -4000}
+#define MAP_GESTURE_DEFAULTS \
+  {GES_TAP, 0, 0, 0},                 /* key 1 */ \
+  {GES_TAP, 0, 0, 0},                 /* key 2 */ \
+  {GES_TAP, 0, 0, 0},                 /* key 3 / encoder switch */ \
+  {GES_TAP, 0, 0, 0},                 /* encoder clockwise */ \
+  {GES_TAP, 0, 0, 0}                  /* encoder counter-clockwise */
 
-// Touchkey configuration
+// Macro programs (see src/macro.h), can be changed via USB vendor request. The
+// bindings hold the start of the program of every key in the code, MAC_NONE
+// keeps the key on its gesture. Example double tap on key 1 (bind 0):
+// MAC_DOWN,0, 0xE8,0x03, 0xE8,0x03,  MAC_WAIT, 30,0,  MAC_UP,0,  MAC_WAIT, 30,0,
+// MAC_LOOP,2,14,  MAC_END
+#define MACRO_ENABLE                  // run macro programs bound to keys
+#define MACRO_DEFAULTS \
+  {MAC_NONE, MAC_NONE, MAC_NONE},     /* bindings of key 1..3 */ \
+  {MAC_END}                           /* code */
+
+// Multitouch report configuration
+#define MT_MAX_CONTACTS     3         // number of contacts (fingers) supported
+#define MT_PARALLEL_MODE              // all contacts in one report, comment out for hybrid mode
+#define MT_LOGICAL_MAX      10000     // coordinate range 0..MT_LOGICAL_MAX (max 32767)
+#define MT_PRESSURE                   // report contact pressure
+//#define MT_WIDTH_HEIGHT             // report contact width and height
+#define MT_CONTACT_WIDTH    200       // contact width in logical units
+#define MT_CONTACT_HEIGHT   200       // contact height in logical units
+#define MT_KEYFRAME_MS      50        // repeat full state while touching (Linux
+                                      // releases contacts not reported for 100ms)
+
+// Latency instrumentation (see src/perf.h)
+#define PERF_ENABLE                   // measure key edge -> host ACK latency
+
+// HID transmit queue configuration
+#define HID_QUEUE_SIZE      4         // number of pending reports (power of 2)
+#define HID_COALESCE                  // replace newest pending report with same tag
+#define HID_SEND_MS         10        // HID_sendReport() gives up after this long
+
+// Fault supervisor (see src/supervisor.h)
+#define SUP_WDT_MS          50        // watchdog reset if the main loop stalls this long
+#define SUP_EP1_MS          40        // re-attach if the host leaves a report this long
+#define SUP_ENUM_MS         1000      // re-attach if not configured this long after reset
+#define SUP_ENUM_RETRIES    3         // enumeration re-attaches until configured
+#define SUP_DETACH_MS       10        // pull-up off for this long on re-attach
+
+// Relay mode (see src/usb_relay.h): the host streams contact frames to EP2 OUT
+#define RELAY_ENABLE                  // forward host frames to the touch screen report
+#define RELAY_TIMEOUT_MS    500       // leave relay mode without frames for this long
+
+// Touchkey configuration (see src/touchkey.h). PIN_TOUCH is TIN4 and shares P16
+// with key 3, enabling the driver turns key 3 into a sealed touch pad.
+//#define TOUCH_ENABLE                // sample touch keys instead of their key pins
+#define TOUCH_KEYS          1         // number of touch keys (1..4)
+#define TOUCH_CHANNELS      4         // TouchKey channels (TIN0..TIN5), comma separated
+#define TOUCH_SCAN_KEYS     SCAN_KEY3 // scan keys replaced by touch keys, comma separated
 #define TOUCH_TH_LOW        2000      // key pressed threshold
 #define TOUCH_TH_HIGH       2400      // key released threshold
+#define TOUCH_DEBOUNCE      2         // samples beyond a threshold for an edge
+#define TOUCH_DRIFT_MS      200       // baseline follows by at most 1 count per period
 
 // USB device descriptor
 #define USB_VENDOR_ID       0x6666    // VID: Prototype
@@ -32,6 +145,14 @@
 
 // USB configuration descriptor
 #define USB_MAX_POWER_mA    50        // max power in mA
+#define USB_REMOTE_WAKEUP             // encoder can wake up a suspended host
+
+// USB endpoint configuration
+#define USB_POLL_INTERVAL   1         // polling interval of all endpoints in ms (1..255)
+#define EP1_SIZE            64        // EP1 IN (touch screen) max packet size (8..64)
+#define EP2_SIZE            64        // EP2 OUT (touch screen) max packet size (8..64)
+#define EP3_SIZE            8         // EP3 IN (boot keyboard) max packet size (8..64)
+#define EP4_SIZE            8         // EP4 IN (consumer control/mouse) max packet size (8..64)
 
 // USB descriptor strings
 #define MANUFACTURER_STR    'm','i','n','d','f','l','a','k','e','s'
@@ -1,6 +1,10 @@
 // ===================================================================================
-// Delay Functions for CH551, CH552 and CH554                                 * v1.1 *
+// Delay Functions for CH551, CH552 and CH554                                 * v1.2 *
 // ===================================================================================
+//
+// Blocking delays on the timer2 timebase (TB_init() must have been called). Only
+// meant for code that has to wait anyway (e.g. before entering the bootloader),
+// everything else schedules a software timer (see timebase.h).
 
 #pragma once
 #include <stdint.h>
@@ -0,0 +1,38 @@
+// ===================================================================================
+// Data Flash Functions for CH551, CH552 and CH554                            * v1.0 *
+// ===================================================================================
+
+#include "flash.h"
+
+// ===================================================================================
+// Read Byte from Data Flash
+// ===================================================================================
+uint8_t FLASH_read(uint8_t addr) {
+  ROM_ADDR_H = DATA_FLASH_ADDR >> 8;
+  ROM_ADDR_L = addr << 1;                         // data flash uses even addresses
+  ROM_CTRL   = ROM_CMD_READ;
+  return ROM_DATA_L;
+}
+
+// ===================================================================================
+// Write Byte to Data Flash
+// ===================================================================================
+uint8_t FLASH_write(uint8_t addr, uint8_t data) {
+  uint8_t ok = 0;
+  SAFE_MOD    = 0x55;
+  SAFE_MOD    = 0xAA;                             // enter safe mode
+  GLOBAL_CFG |= bDATA_WE;                         // enable data flash write
+  SAFE_MOD    = 0x00;                             // terminate safe mode
+  ROM_ADDR_H  = DATA_FLASH_ADDR >> 8;
+  ROM_ADDR_L  = addr << 1;
+  ROM_DATA_L  = data;
+  if(ROM_STATUS & bROM_ADDR_OK) {                 // valid address?
+    ROM_CTRL  = ROM_CMD_WRITE;                    // write byte
+    ok = !(ROM_STATUS & bROM_CMD_ERR);
+  }
+  SAFE_MOD    = 0x55;
+  SAFE_MOD    = 0xAA;                             // enter safe mode
+  GLOBAL_CFG &= ~bDATA_WE;                        // disable data flash write
+  SAFE_MOD    = 0x00;                             // terminate safe mode
+  return ok;
+}
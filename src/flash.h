@@ -0,0 +1,19 @@
+// ===================================================================================
+// Data Flash Functions for CH551, CH552 and CH554                            * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// FLASH_read(addr)         read byte from data flash (addr: 0..127)
+// FLASH_write(addr, data)  write byte to data flash (returns 0 on failure)
+//
+// The 128 bytes of data flash are byte-writable, no erase is needed. The CPU is
+// stalled while a byte is programmed, so write larger blocks byte by byte from
+// the main loop instead of all at once.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+
+uint8_t FLASH_read(uint8_t addr);                 // read byte from data flash
+uint8_t FLASH_write(uint8_t addr, uint8_t data);  // write byte to data flash
@@ -0,0 +1,194 @@
+// ===================================================================================
+// Gesture Engine for CH551, CH552 and CH554                                  * v1.2 *
+// ===================================================================================
+
+#include "gesture.h"
+#include "timebase.h"
+#include "usb_multitouch.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#if GES_SLOTS > MT_MAX_CONTACTS
+  #error MAP_KEYS must not exceed MT_MAX_CONTACTS!
+#endif
+
+__xdata GES_SLOT GES_slot[GES_SLOTS];   // contact slots
+__bit            GES_dirty;             // frame needs to be sent
+
+void GES_step(void);
+
+// ===================================================================================
+// Start and Release
+// ===================================================================================
+
+// Release all slots and start the frame timer, call after MAP_load() and
+// TB_init()
+void GES_init(void) {
+  uint8_t i;
+  for(i=0; i<GES_SLOTS; i++) {
+    GES_slot[i].flags = 0;
+    GES_slot[i].type  = GES_TAP;
+    GES_slot[i].x     = (int32_t)MAP_table[i].x << 8;
+    GES_slot[i].y     = (int32_t)MAP_table[i].y << 8;
+  }
+  GES_dirty = 1;                        // report all contacts lifted
+  TB_start(TB_TMR_GESTURE, USB_POLL_INTERVAL, USB_POLL_INTERVAL, GES_step);
+}
+
+// Start gesture g on slot at the contact position of the slot's key
+void GES_start(uint8_t slot, uint8_t g) {
+  __xdata GES_SLOT*    s  = &GES_slot[slot];
+  __xdata MAP_GESTURE* ge = &MAP_gesture[g];
+  uint16_t frames = ge->frames ? ge->frames : 1;
+
+  s->type    = ge->type;
+  s->gesture = g;
+  s->flags  |= GES_TOUCH;
+  s->left    = 0;
+  s->x       = (int32_t)MAP_table[slot].x << 8;
+  s->y       = (int32_t)MAP_table[slot].y << 8;
+  if(s->type != GES_TAP) {
+    s->flags |= GES_ACTIVE;
+    s->left   = frames;
+  }
+  if(s->type == GES_SWIPE) {
+    s->vx = ((int32_t)ge->dx << 8) / frames;
+    s->vy = ((int32_t)ge->dy << 8) / frames;
+    s->ax = 0;
+    s->ay = 0;
+  }
+  else if(s->type == GES_FLICK) {                // sum of n * a over all frames = d
+    s->ax = ((int32_t)ge->dx << 9) / ((uint32_t)frames * (frames + 1));
+    s->ay = ((int32_t)ge->dy << 9) / ((uint32_t)frames * (frames + 1));
+    s->vx = s->ax;
+    s->vy = s->ay;
+  }
+  GES_dirty = 1;
+}
+
+// Key state of a slot changed. Taps and finished holds lift on release, swipes
+// and flicks always run to the end.
+void GES_hold(uint8_t slot, uint8_t held) {
+  __xdata GES_SLOT* s = &GES_slot[slot];
+
+  if(held) {
+    if(s->flags & GES_HELD) return;
+    s->flags |= GES_HELD;
+    if(!(s->flags & (GES_ACTIVE | GES_PLACED))) GES_start(slot, slot);
+    return;
+  }
+  if(!(s->flags & GES_HELD)) return;
+  s->flags &= ~GES_HELD;
+  if(s->flags & GES_PLACED) return;
+  if((s->flags & GES_TOUCH) && !(s->flags & GES_ACTIVE)
+                            && (s->type == GES_TAP || s->type == GES_HOLD)) {
+    s->flags &= ~GES_TOUCH;
+    GES_dirty = 1;
+  }
+}
+
+// Start the gesture of an encoder detent, returns 0 if the direction has no
+// gesture (steps are left to the caller). Detents while the slot is busy are
+// dropped.
+uint8_t GES_encoder(int8_t steps) {
+  uint8_t g;
+  if(!steps) return 0;
+  g = steps > 0 ? MAP_GES_CW : MAP_GES_CCW;
+  if(MAP_gesture[g].type == GES_TAP) return 0;
+  if(!(GES_slot[GES_ENC_SLOT].flags & (GES_HELD | GES_TOUCH | GES_PLACED)))
+    GES_start(GES_ENC_SLOT, g);
+  return 1;
+}
+
+// ===================================================================================
+// Place Slots Directly
+// ===================================================================================
+
+// Touch the contact of a slot at x/y, a running gesture of the slot is stopped
+void GES_place(uint8_t slot, uint16_t x, uint16_t y) {
+  __xdata GES_SLOT* s = &GES_slot[slot];
+  s->flags = (s->flags & GES_HELD) | GES_PLACED | GES_TOUCH;
+  s->x     = (int32_t)x << 8;
+  s->y     = (int32_t)y << 8;
+  GES_dirty = 1;
+}
+
+// Lift the contact of a placed slot, it stays at its position
+void GES_lift(uint8_t slot) {
+  if(!(GES_slot[slot].flags & GES_TOUCH)) return;
+  GES_slot[slot].flags &= ~GES_TOUCH;
+  GES_dirty = 1;
+}
+
+// Lift the contact of a placed slot and hand it back to its key
+void GES_free(uint8_t slot) {
+  GES_lift(slot);
+  GES_slot[slot].flags &= ~GES_PLACED;
+}
+
+// ===================================================================================
+// Advance Running Gestures
+// ===================================================================================
+
+// Clamp a position (8 fractional bits) to the logical range
+uint16_t GES_clamp(int32_t p) {
+  p >>= 8;
+  if(p < 0) return 0;
+  if(p > MT_LOGICAL_MAX) return MT_LOGICAL_MAX;
+  return (uint16_t)p;
+}
+
+// One frame (timer callback): move swipes/flicks, lift finished gestures one
+// frame after the last position
+void GES_step(void) {
+  __xdata GES_SLOT* s = GES_slot;
+  uint8_t i;
+
+  for(i=0; i<GES_SLOTS; i++, s++) {
+    if(!(s->flags & GES_ACTIVE)) continue;
+    if(!s->left) {                               // finished
+      s->flags &= ~GES_ACTIVE;
+      if((s->type == GES_HOLD) && (s->flags & GES_HELD)) continue; // lift on release
+      s->flags &= ~GES_TOUCH;
+      GES_dirty = 1;
+      continue;
+    }
+    s->left--;
+    if(s->type < GES_SWIPE) continue;            // hold does not move
+    if(s->left) {
+      s->x  += s->vx;
+      s->y  += s->vy;
+      s->vx += s->ax;
+      s->vy += s->ay;
+    }
+    else {                                       // last frame: exact end point
+      s->x = ((int32_t)MAP_table[i].x + MAP_gesture[s->gesture].dx) << 8;
+      s->y = ((int32_t)MAP_table[i].y + MAP_gesture[s->gesture].dy) << 8;
+    }
+    GES_dirty = 1;
+  }
+}
+
+// ===================================================================================
+// Send Frame
+// ===================================================================================
+// Queue one frame with the contacts of all slots, returns 0 if the queue is
+// full (GES_dirty stays set, the next call sends the newest state).
+uint8_t GES_sendFrame(void) {
+  __xdata GES_SLOT* s = GES_slot;
+  uint8_t i;
+
+  MT_beginFrame();
+  for(i=0; i<GES_SLOTS; i++, s++) {
+    if(s->flags & GES_TOUCH)
+      MT_addContact(MAP_table[i].id, MT_TOUCH, MAP_table[i].pressure,
+                    GES_clamp(s->x), GES_clamp(s->y));
+    else
+      MT_addContact(MAP_table[i].id, MT_LIFT, 0,
+                    GES_clamp(s->x), GES_clamp(s->y));
+  }
+  if(!MT_sendFrame()) return 0;
+  GES_dirty = 0;
+  return 1;
+}
@@ -0,0 +1,73 @@
+// ===================================================================================
+// Gesture Engine for CH551, CH552 and CH554                                  * v1.2 *
+// ===================================================================================
+//
+// Turns key and encoder events into timed contact trajectories. Every key owns
+// one contact slot, its gesture comes from the touch map (MAP_gesture):
+//
+// GES_TAP      contact touches while the key is held (plain tap or long press)
+// GES_HOLD     contact touches for at least 'frames' frames, or longer while held
+// GES_SWIPE    contact moves at constant speed by dx/dy within 'frames' frames,
+//              then lifts, no matter when the key is released
+// GES_FLICK    like GES_SWIPE, but accelerating, so it lifts at full speed
+//
+// A detent of the encoder runs MAP_gesture[MAP_GES_CW] or [MAP_GES_CCW] on the
+// slot of the last key (which the encoder switch shares) if that slot is idle.
+// If the gesture of a direction is GES_TAP, the detent is left to the caller
+// (mouse wheel).
+//
+// Trajectories advance once per USB frame (USB_POLL_INTERVAL) from a periodic
+// software timer (TB_TMR_GESTURE), so their timing does not depend on the main
+// loop as long as TB_poll() is called. Positions are kept with 8 fractional
+// bits and are stepped by additions only, the end point is always hit exactly.
+//
+// A slot can also be placed directly (macro programs, see macro.h), it then
+// ignores its key and gestures until it is freed again.
+//
+// Functions available:
+// --------------------
+// GES_init()               release all slots
+// GES_hold(slot, held)     key state of a slot changed
+// GES_encoder(steps)       start encoder gesture, returns 0 if steps are not used
+// GES_sendFrame()          queue a frame with all slots (returns 0 if queue is full)
+// GES_touching(slot)       check if the contact of a slot touches
+// GES_place(slot, x, y)    touch the contact of a slot at x/y (slot is taken over)
+// GES_lift(slot)           lift the contact of a taken over slot
+// GES_free(slot)           lift the contact and hand the slot back to its key
+// GES_dirty                set when a frame needs to be sent
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+#include "touchmap.h"
+
+#define GES_SLOTS       MAP_KEYS        // one contact slot per key
+#define GES_ENC_SLOT    (MAP_KEYS - 1)  // slot used by encoder gestures
+
+#define GES_HELD        0x01            // key of the slot is held
+#define GES_ACTIVE      0x02            // gesture is running
+#define GES_TOUCH       0x04            // contact touches
+#define GES_PLACED      0x08            // slot is placed directly (macro)
+
+typedef struct _GES_SLOT {
+  uint8_t  type;                        // gesture type
+  uint8_t  gesture;                     // index of the gesture in MAP_gesture
+  uint8_t  flags;                       // GES_HELD, GES_ACTIVE, GES_TOUCH, GES_PLACED
+  uint16_t left;                        // frames left
+  int32_t  x, y;                        // position (8 fractional bits)
+  int32_t  vx, vy;                      // step per frame
+  int32_t  ax, ay;                      // step increment per frame (flick)
+} GES_SLOT;
+
+extern __xdata GES_SLOT GES_slot[GES_SLOTS];
+extern __bit GES_dirty;                 // frame needs to be sent
+
+#define GES_touching(s) (GES_slot[s].flags & GES_TOUCH)
+
+void GES_init(void);                    // release all slots
+void GES_hold(uint8_t slot, uint8_t held); // key state of slot changed
+uint8_t GES_encoder(int8_t steps);      // start encoder gesture
+uint8_t GES_sendFrame(void);            // queue frame with all slots
+void GES_place(uint8_t slot, uint16_t x, uint16_t y); // touch slot at x/y
+void GES_lift(uint8_t slot);            // lift placed slot
+void GES_free(uint8_t slot);            // hand placed slot back to its key
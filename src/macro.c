@@ -0,0 +1,262 @@
+// ===================================================================================
+// Macro Interpreter for CH551, CH552 and CH554                               * v1.0 *
+// ===================================================================================
+
+#include "macro.h"
+
+#ifdef MACRO_ENABLE
+
+#include "anim.h"
+#include "flash.h"
+#include "gesture.h"
+#include "timebase.h"
+#include "usb_hid.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define MAC_IDLE        0               // nothing to do
+#define MAC_PENDING     1               // MAC_staging holds new programs
+#define MAC_DEFAULT     2               // restore the default programs
+#define MAC_WRITING     3               // writing MAC_data to data flash
+
+#define MAC_RUN         0x01            // interpreter flags: program running
+#define MAC_KEYUP       0x02            // key stroke must be released
+
+#if MAP_KEYS * 6 + MAP_GESTURES * 7 + 2 > MAC_FLASH_ADDR
+  #error Touch map overlaps the macro programs in data flash!
+#endif
+#if GES_SLOTS > 8
+  #error Macro slot mask holds 8 slots only!
+#endif
+
+typedef struct _MAC_VM {
+  uint8_t  flags;                       // MAC_RUN, MAC_KEYUP
+  uint8_t  pc;                          // next opcode in MAC_data.code
+  uint8_t  loops;                       // loop passes left
+  uint8_t  slots;                       // slots placed by the program (bit mask)
+  uint16_t wait;                        // frames left to wait
+} MAC_VM;
+
+__code MAC_DATA  MAC_default = {MACRO_DEFAULTS};
+
+__xdata MAC_DATA MAC_data;                      // active programs
+__xdata MAC_DATA MAC_staging;                   // staging buffer for new programs
+__xdata MAC_VM   MAC_vm[MAP_KEYS];              // one interpreter per key
+volatile uint8_t MAC_state;                     // update state
+__xdata uint8_t  MAC_writePos;                  // next step of the flash write
+__xdata uint8_t  MAC_writeSum;                  // sum of the bytes written so far
+
+void MAC_step(void);
+
+// ===================================================================================
+// Load Programs from Data Flash
+// ===================================================================================
+// Also starts the step timer, call after TB_init()
+void MAC_load(void) {
+  __xdata uint8_t* dst = (__xdata uint8_t*)&MAC_data;
+  __code  uint8_t* src = (__code uint8_t*)&MAC_default;
+  uint8_t i, sum = 0;
+
+  MAC_state = MAC_IDLE;
+  for(i=0; i<MAP_KEYS; i++) MAC_vm[i].flags = 0;
+  for(i=MAC_SIZE; i; i--) *dst++ = *src++;        // start with defaults
+  TB_start(TB_TMR_MACRO, USB_POLL_INTERVAL, USB_POLL_INTERVAL, MAC_step);
+  if(FLASH_read(MAC_FLASH_ADDR) != MAC_MAGIC) return;
+  for(i=1; i<=MAC_SIZE; i++) sum += FLASH_read(MAC_FLASH_ADDR + i);
+  if(sum != FLASH_read(MAC_FLASH_ADDR + MAC_SIZE + 1)) return;
+  dst = (__xdata uint8_t*)&MAC_data;
+  for(i=1; i<=MAC_SIZE; i++) *dst++ = FLASH_read(MAC_FLASH_ADDR + i);
+}
+
+// ===================================================================================
+// Start and Stop Programs
+// ===================================================================================
+
+// Run the program bound to key from the start, returns 0 if there is none. A
+// running program keeps running.
+uint8_t MAC_start(uint8_t key) {
+  __xdata MAC_VM* vm = &MAC_vm[key];
+  if(!MAC_bound(key)) return 0;
+  if(vm->flags & MAC_RUN) return 1;
+  vm->flags = MAC_RUN;
+  vm->pc    = MAC_data.bind[key];
+  vm->loops = 0;
+  vm->slots = 0;
+  vm->wait  = 0;
+  return 1;
+}
+
+// Hand the slots of a program back to their keys
+void MAC_stop(__xdata MAC_VM* vm) {
+  uint8_t i;
+  for(i=0; i<GES_SLOTS; i++) {
+    if(vm->slots & (1 << i)) GES_free(i);
+  }
+  vm->flags = 0;
+}
+
+// ===================================================================================
+// Interpreter
+// ===================================================================================
+
+// Get the 16-bit argument at pc
+uint16_t MAC_word(uint8_t pc) {
+  return MAC_data.code[pc] | ((uint16_t)MAC_data.code[pc + 1] << 8);
+}
+
+// Run one step of a program, returns 0 when it ended
+uint8_t MAC_run(__xdata MAC_VM* vm) {
+  __xdata uint8_t* kbd;
+  uint8_t pc, op, slot, ops = MAC_OPS_PER_STEP;
+
+  if(vm->wait) {                                 // still waiting
+    vm->wait--;
+    return 1;
+  }
+  if(vm->flags & MAC_KEYUP) {                    // release key stroke
+    kbd = HID_keyboardBuffer();
+    if(!kbd) return 1;                           // busy, try next frame
+    for(op=0; op<KBD_REPORT_SIZE; op++) kbd[op] = 0;
+    HID_commitKeyboard();
+    vm->flags &= ~MAC_KEYUP;
+    return 1;
+  }
+
+  while(ops--) {
+    pc = vm->pc;
+    if(pc >= MAC_CODE_SIZE) return 0;            // ran off the end
+    op   = MAC_data.code[pc];
+    if(pc + 2 > MAC_CODE_SIZE) return 0;         // last byte: end or cut off
+    slot = MAC_data.code[pc + 1];
+    switch(op) {
+      case MAC_DOWN:
+      case MAC_MOVE:
+        if(pc + 6 > MAC_CODE_SIZE || slot >= GES_SLOTS) return 0;
+        if(op == MAC_DOWN || ((vm->slots & (1 << slot)) && GES_touching(slot))) {
+          GES_place(slot, MAC_word(pc + 2), MAC_word(pc + 4));
+          vm->slots |= 1 << slot;
+        }
+        vm->pc += 6;
+        return 1;
+
+      case MAC_UP:
+        if(slot >= GES_SLOTS) return 0;
+        if(vm->slots & (1 << slot)) GES_lift(slot);
+        vm->pc += 2;
+        return 1;
+
+      case MAC_WAIT:
+        if(pc + 3 > MAC_CODE_SIZE) return 0;
+        vm->wait = (MAC_word(pc + 1) + USB_POLL_INTERVAL - 1) / USB_POLL_INTERVAL;
+        if(vm->wait) vm->wait--;                 // this step is the first frame
+        vm->pc += 3;
+        return 1;
+
+      case MAC_KEY:
+        kbd = HID_keyboardBuffer();
+        if(!kbd) return 1;                       // busy, try next frame
+        for(op=0; op<KBD_REPORT_SIZE; op++) kbd[op] = 0;
+        kbd[2] = slot;                           // usage
+        HID_commitKeyboard();
+        vm->flags |= MAC_KEYUP;
+        vm->pc += 2;
+        return 1;
+
+      case MAC_LED:
+        if(pc + 3 > MAC_CODE_SIZE || slot >= NEO_COUNT) return 0;
+        if(MAC_data.code[pc + 2] == 0xFF) ANIM_start(slot, ANIM_OFF, 0, 0);
+        else {
+          ANIM_hue(slot, MAC_data.code[pc + 2]);
+          ANIM_start(slot, ANIM_SOLID, ANIM_LEVEL_MAX, 0);
+        }
+        vm->pc += 3;
+        break;
+
+      case MAC_LOOP:
+        if(pc + 3 > MAC_CODE_SIZE) return 0;
+        if(!slot) vm->pc -= MAC_data.code[pc + 2];        // forever
+        else {
+          if(!vm->loops) vm->loops = slot;
+          if(--vm->loops) vm->pc -= MAC_data.code[pc + 2];
+          else vm->pc += 3;
+        }
+        break;
+
+      default:                                   // MAC_END or invalid opcode
+        return 0;
+    }
+  }
+  return 1;                                      // opcode limit reached
+}
+
+// One frame (timer callback): advance all running programs
+void MAC_step(void) {
+  __xdata MAC_VM* vm = MAC_vm;
+  uint8_t i;
+  for(i=0; i<MAP_KEYS; i++, vm++) {
+    if(!(vm->flags & MAC_RUN)) continue;
+    if(!MAC_run(vm) && !(vm->flags & MAC_KEYUP)) MAC_stop(vm);
+  }
+}
+
+// ===================================================================================
+// Request Update (called from the USB interrupt)
+// ===================================================================================
+uint8_t MAC_request(uint8_t defaults) {
+  if(MAC_state) return 0;                         // previous update still running
+  MAC_state = defaults ? MAC_DEFAULT : MAC_PENDING;
+  return 1;
+}
+
+// ===================================================================================
+// Apply Pending Update and Write it to Data Flash
+// ===================================================================================
+// Running programs are stopped first. Only one data flash byte is written per
+// call, like MAP_poll().
+void MAC_poll(void) {
+  uint8_t i, data;
+
+  switch(MAC_state) {
+    case MAC_IDLE:
+      return;
+
+    case MAC_PENDING:
+    case MAC_DEFAULT:
+      for(i=0; i<MAP_KEYS; i++) {
+        if(MAC_vm[i].flags) MAC_stop(&MAC_vm[i]);
+      }
+      if(MAC_state == MAC_PENDING) {
+        __xdata uint8_t* src = (__xdata uint8_t*)&MAC_staging;
+        __xdata uint8_t* dst = (__xdata uint8_t*)&MAC_data;
+        for(i=MAC_SIZE; i; i--) *dst++ = *src++;
+      }
+      else {
+        __code  uint8_t* src = (__code uint8_t*)&MAC_default;
+        __xdata uint8_t* dst = (__xdata uint8_t*)&MAC_data;
+        for(i=MAC_SIZE; i; i--) *dst++ = *src++;
+      }
+      FLASH_write(MAC_FLASH_ADDR, 0x00);          // invalidate stored programs
+      MAC_writePos = 1;
+      MAC_writeSum = 0;
+      MAC_state    = MAC_WRITING;
+      return;
+
+    case MAC_WRITING:
+      if(MAC_writePos <= MAC_SIZE) {
+        data = ((__xdata uint8_t*)&MAC_data)[MAC_writePos - 1];
+        MAC_writeSum += data;
+        FLASH_write(MAC_FLASH_ADDR + MAC_writePos++, data);
+      }
+      else if(MAC_writePos == MAC_SIZE + 1) {
+        FLASH_write(MAC_FLASH_ADDR + MAC_writePos++, MAC_writeSum);
+      }
+      else {
+        FLASH_write(MAC_FLASH_ADDR, MAC_MAGIC);   // programs are valid now
+        MAC_state = MAC_IDLE;
+      }
+      return;
+  }
+}
+
+#endif // MACRO_ENABLE
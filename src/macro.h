@@ -0,0 +1,93 @@
+// ===================================================================================
+// Macro Interpreter for CH551, CH552 and CH554                               * v1.0 *
+// ===================================================================================
+//
+// Every key can be bound to a small bytecode program that plays a touch
+// sequence, key strokes and pixel colors. The programs are kept in data flash
+// behind the touch map and can be replaced by vendor request (VEN_SET_MACRO)
+// without reflashing. Each key has its own interpreter, programs advance one step
+// per USB frame from a periodic software timer (TB_TMR_MACRO), so they never
+// block scanning or USB.
+//
+// Opcodes (arguments follow the opcode byte, 16-bit values are LE):
+// -----------------------------------------------------------------
+// MAC_END   0x00                   end of program, lift all contacts it placed
+// MAC_DOWN  0x01 slot x y          touch the contact of slot at x/y
+// MAC_MOVE  0x02 slot x y          move the contact of slot if it touches
+// MAC_UP    0x03 slot              lift the contact of slot
+// MAC_WAIT  0x04 ms                wait ms milliseconds (at least one frame)
+// MAC_KEY   0x05 usage             tap keyboard key (release one frame later)
+// MAC_LED   0x06 pixel hue         set pixel to hue (0..191, 0xFF: off)
+// MAC_LOOP  0x07 count back        jump back by 'back' bytes until the loop ran
+//                                  count times (0: forever), loops do not nest
+//
+// Contacts are addressed by gesture slot (0..GES_SLOTS-1), contact ID and
+// pressure come from the touch map, so the IDs stay unique within
+// MT_MAX_CONTACTS. A slot placed by a program ignores its key and gestures until
+// the program ends. DOWN, MOVE, UP, WAIT and KEY end a step, END, LED and LOOP
+// do not (at most MAC_OPS_PER_STEP opcodes per step).
+//
+// Program blob (MAC_SIZE bytes, VEN_GET_MACRO/VEN_SET_MACRO):
+// -----------------------------------------------------------
+// bind[MAP_KEYS]           start of the program of every key in code, 0xFF: none
+// code[MAC_CODE_SIZE]      the programs
+//
+// Functions available:
+// --------------------
+// MAC_load()               load programs from data flash (defaults if invalid)
+// MAC_start(key)           run the program of key, returns 0 if it has none
+// MAC_bound(key)           check if a program is bound to key
+// MAC_poll()               apply a pending update, write it to data flash
+// MAC_busy()               check if an update is pending or being written
+// MAC_request(defaults)    flag MAC_staging (or the defaults) as new programs
+//
+// The following must be defined in config.h:
+// MACRO_ENABLE             - (optional) enable the interpreter
+// MACRO_DEFAULTS           - initializer for the default blob (bindings, then code)
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+#include "touchmap.h"
+
+#define MAC_END         0x00            // opcodes
+#define MAC_DOWN        0x01
+#define MAC_MOVE        0x02
+#define MAC_UP          0x03
+#define MAC_WAIT        0x04
+#define MAC_KEY         0x05
+#define MAC_LED         0x06
+#define MAC_LOOP        0x07
+
+#define MAC_NONE        0xFF            // key has no program
+#define MAC_MAGIC       0x50            // 'P': programs valid
+#define MAC_FLASH_ADDR  64              // data flash: magic, blob, 8-bit sum
+#define MAC_SIZE        (128 - MAC_FLASH_ADDR - 2)
+#define MAC_CODE_SIZE   (MAC_SIZE - MAP_KEYS)
+#define MAC_OPS_PER_STEP 8              // opcodes per step at most
+
+typedef struct _MAC_DATA {
+  uint8_t bind[MAP_KEYS];               // program start of every key
+  uint8_t code[MAC_CODE_SIZE];          // bytecode
+} MAC_DATA;
+
+#ifdef MACRO_ENABLE
+extern __xdata MAC_DATA MAC_data;               // active programs
+extern __xdata MAC_DATA MAC_staging;            // staging buffer for new programs
+extern volatile uint8_t MAC_state;              // update state machine
+
+#define MAC_bound(k)    (MAC_data.bind[k] != MAC_NONE)
+#define MAC_busy()      (MAC_state)
+
+void MAC_load(void);                    // load programs from data flash
+uint8_t MAC_start(uint8_t key);         // run program of key
+void MAC_poll(void);                    // apply pending update
+uint8_t MAC_request(uint8_t defaults);  // new programs in MAC_staging
+#else
+#define MAC_load()
+#define MAC_start(k)    0
+#define MAC_bound(k)    0
+#define MAC_poll()
+#define MAC_busy()      0
+#define MAC_request(d)  0
+#endif
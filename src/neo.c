@@ -1,5 +1,5 @@
 // ===================================================================================
-// NeoPixel (Addressable LED) Functions for CH551, CH552 and CH554            * v1.2 *
+// NeoPixel (Addressable LED) Functions for CH551, CH552 and CH554            * v1.3 *
 // ===================================================================================
 //
 // Basic control functions for 800kHz addressable LEDs (NeoPixel). A simplified
@@ -11,6 +11,12 @@
 // NEO_COUNT - total number of pixels
 // System clock frequency must be at least 6 MHz.
 //
+// Optional settings in config.h:
+// NEO_IRQ_GAP - re-enable interrupts between pixels
+// NEO_GAP_US  - longest gap between pixels (below the reset time of the pixels)
+//
+// The latch time is a deadline on the timer2 timebase (TB_init() first).
+//
 // Further information:     https://github.com/wagiminator/ATtiny13-NeoController
 // 2023 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -18,10 +24,20 @@
 // Libraries, Variables and Constants
 // ===================================================================================
 #include "neo.h"
+#include "perf.h"
+#include "timebase.h"
 
 #define NEOPIN PIN_asm(PIN_NEO)             // convert PIN_NEO for inline assembly
 __xdata uint8_t NEO_buffer[3 * NEO_COUNT];  // pixel buffer
 __xdata uint8_t *ptr;                       // pixel buffer pointer
+__xdata uint8_t NEO_dirty;                  // number of leading pixels to be resent
+
+#define NEO_LATCH_US 282                    // latch time (+1 for partial microsecond)
+#ifndef NEO_GAP_US
+  #define NEO_GAP_US 40                     // longest gap between pixels
+#endif
+__xdata uint16_t NEO_latchDue;              // end of latch time of last transmission
+__bit NEO_latchBusy;                        // pixels are latching
 
 // ===================================================================================
 // Protocol Delays
@@ -30,52 +46,55 @@ __xdata uint8_t *ptr;                       // pixel buffer pointer
 // - T0H (HIGH-time for "0"-bit) must be max.  500ns
 // - T1H (HIGH-time for "1"-bit) must be min.  625ns
 // - TCT (total clock time) must be      min. 1150ns
-// The bit transmission loop takes 11 clock cycles.
+// The bit transmission loop takes 11 clock cycles plus the delays, T0H is the
+// 2 cycles of "mov NEOPIN, c", T1H 4 cycles plus the T1H delay. The number of
+// nops per system clock is checked against the conditions below, so a clock
+// that does not fit fails at compile time instead of on the pixels.
 #if F_CPU == 24000000       // 24 MHz system clock
-  #define T1H_DELAY \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop                     // 15 - 4 = 11 clock cycles for min 625ns
-  #define TCT_DELAY \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop                     // 28 - 11 - 11 = 6 clock cycles for min 1150ns
+  #define NEO_T1H_NOPS  11          // 15 - 4 = 11 clock cycles for min 625ns
+  #define NEO_TCT_NOPS  6           // 28 - 11 - 11 = 6 clock cycles for min 1150ns
 #elif F_CPU == 16000000     // 16 MHz system clock
-  #define T1H_DELAY \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop             \
-    nop                     // 10 - 4 = 6 clock cycles for min 625ns
-  #define TCT_DELAY \
-    nop             \
-    nop                     // 19 - 6 - 11 = 2 clock cycles for min 1150ns
+  #define NEO_T1H_NOPS  6           // 10 - 4 = 6 clock cycles for min 625ns
+  #define NEO_TCT_NOPS  2           // 19 - 6 - 11 = 2 clock cycles for min 1150ns
 #elif F_CPU == 12000000     // 12 MHz system clock
-  #define T1H_DELAY \
-    nop             \
-    nop             \
-    nop             \
-    nop                     // 8 - 4 = 4 clock cycles for min 625ns
-  #define TCT_DELAY         // 14 - 4 - 11 < 0 clock cycles for min 1150ns
-#elif F_CPU == 6000000      // 13 MHz system clock
-  #define T1H_DELAY         // 4 - 4 = 0 clock cycles for min 625ns
-  #define TCT_DELAY         // 7 - 0 - 11 < 0 clock cycles for min 1150ns
+  #define NEO_T1H_NOPS  4           // 8 - 4 = 4 clock cycles for min 625ns
+  #define NEO_TCT_NOPS  0           // 14 - 4 - 11 < 0 clock cycles for min 1150ns
+#elif F_CPU == 6000000      // 6 MHz system clock
+  #define NEO_T1H_NOPS  0           // 4 - 4 = 0 clock cycles for min 625ns
+  #define NEO_TCT_NOPS  0           // 7 - 0 - 11 < 0 clock cycles for min 1150ns
 #else
   #error Unsupported system clock frequency for NeoPixels!
 #endif
 
+#define NEO_MHZ       (F_CPU / 1000000)
+#if 2 * 1000 > 500 * NEO_MHZ
+  #error System clock too slow for NeoPixel T0H (max 500ns)!
+#endif
+#if (4 + NEO_T1H_NOPS) * 1000 < 625 * NEO_MHZ
+  #error NEO_T1H_NOPS too short for NeoPixel T1H (min 625ns)!
+#endif
+#if (11 + NEO_T1H_NOPS + NEO_TCT_NOPS) * 1000 < 1150 * NEO_MHZ
+  #error NEO_TCT_NOPS too short for NeoPixel TCT (min 1150ns)!
+#endif
+
+#define NEO_NOPS(n)   NEO_NOPS_(n)
+#define NEO_NOPS_(n)  NEO_NOPS_##n
+#define NEO_NOPS_0
+#define NEO_NOPS_1    nop
+#define NEO_NOPS_2    NEO_NOPS_1  nop
+#define NEO_NOPS_3    NEO_NOPS_2  nop
+#define NEO_NOPS_4    NEO_NOPS_3  nop
+#define NEO_NOPS_5    NEO_NOPS_4  nop
+#define NEO_NOPS_6    NEO_NOPS_5  nop
+#define NEO_NOPS_7    NEO_NOPS_6  nop
+#define NEO_NOPS_8    NEO_NOPS_7  nop
+#define NEO_NOPS_9    NEO_NOPS_8  nop
+#define NEO_NOPS_10   NEO_NOPS_9  nop
+#define NEO_NOPS_11   NEO_NOPS_10 nop
+
+#define T1H_DELAY     NEO_NOPS(NEO_T1H_NOPS)
+#define TCT_DELAY     NEO_NOPS(NEO_TCT_NOPS)
+
 // ===================================================================================
 // Send a Data Byte to the Pixels String
 // ===================================================================================
@@ -84,6 +103,7 @@ __xdata uint8_t *ptr;                       // pixel buffer pointer
 // transmission of the individual bytes is less than the pixel's latch time.
 void NEO_sendByte(uint8_t data) {
   data;                 // stop unreferenced argument warning
+  #ifndef HOST_BUILD    // host build (make host) has no pixels
   __asm
     .even
     mov  r7, #8         ; 2 CLK - 8 bits to transfer
@@ -97,18 +117,63 @@ void NEO_sendByte(uint8_t data) {
     TCT_DELAY           ; y CLK - TCT delay
     djnz r7, 01$        ; 2/4|5|6 CLK - repeat for all bits
   __endasm;
+  #endif
+}
+
+// ===================================================================================
+// Check if Pixels are Ready (Latch Time of Last Update is Over)
+// ===================================================================================
+uint8_t NEO_ready(void) {
+  if(NEO_latchBusy && !TB_expiredUs(NEO_latchDue)) return 0;
+  NEO_latchBusy = 0;
+  return 1;
 }
 
 // ===================================================================================
 // Write Buffer to Pixels
 // ===================================================================================
+// Only the pixels up to the last changed one are sent. Nothing happens if no
+// pixel has changed or the pixels are still latching the previous update, the
+// caller just tries again later. Interrupts are only blocked while a single
+// pixel is sent if NEO_IRQ_GAP is defined. An interrupt served between two
+// pixels for longer than NEO_GAP_US may have latched the pixels mid-frame, the
+// rest of the frame is dropped then and the whole frame is sent again by the
+// next call once the latch time is over.
 void NEO_update(void) {
   uint8_t i;
+  __bit ea;
+  #ifdef NEO_IRQ_GAP
+  uint16_t gap = 0;
+  #endif
+  if(!NEO_dirty || !NEO_ready()) return;
   ptr = NEO_buffer;
+  ea = EA;
+  #ifdef NEO_IRQ_GAP
+  for(i=NEO_dirty; i; i--) {
+    EA = 0;
+    PERF_irqOff();
+    if((i != NEO_dirty) && ((uint16_t)(TB_microsIsr() - gap) > NEO_GAP_US)) {
+      PERF_irqOn();                         // gap too long, send all again
+      EA = ea;
+      break;
+    }
+    NEO_sendByte(*ptr++);
+    NEO_sendByte(*ptr++);
+    NEO_sendByte(*ptr++);
+    gap = TB_microsIsr();
+    PERF_irqOn();
+    EA = ea;                                // pending interrupts are served here
+  }
+  #else
   EA = 0;
-  for(i=3*NEO_COUNT; i; i--) NEO_sendByte(*ptr++);
-  EA = 1;
-  NEO_latch();
+  PERF_irqOff();
+  for(i=3*NEO_dirty; i; i--) NEO_sendByte(*ptr++);
+  PERF_irqOn();
+  EA = ea;
+  #endif
+  if(!i) NEO_dirty = 0;                     // all sent
+  NEO_latchDue  = TB_afterUs(NEO_LATCH_US);
+  NEO_latchBusy = 1;
 }
 
 // ===================================================================================
@@ -118,21 +183,26 @@ void NEO_clearAll(void) {
   uint8_t i;
   ptr = NEO_buffer;
   for(i=3*NEO_COUNT; i; i--) *ptr++ = 0;
+  NEO_dirty = NEO_COUNT;
   NEO_update();
 }
 
 // ===================================================================================
 // Write Color to a Single Pixel in Buffer
 // ===================================================================================
+// The pixel is only marked dirty if its color actually changes.
 void NEO_writeColor(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b) {
   ptr = NEO_buffer + (3 * pixel);
   #if defined (NEO_GRB)
+    if(ptr[0] == g && ptr[1] == r && ptr[2] == b) return;
     *ptr++ = g; *ptr++ = r; *ptr = b;
   #elif defined (NEO_RGB)
+    if(ptr[0] == r && ptr[1] == g && ptr[2] == b) return;
     *ptr++ = r; *ptr++ = g; *ptr = b;
   #else
     #error Wrong or missing NeoPixel type definition!
   #endif
+  if(pixel >= NEO_dirty) NEO_dirty = pixel + 1;
 }
 
 // ===================================================================================
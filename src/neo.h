@@ -1,5 +1,5 @@
 // ===================================================================================
-// NeoPixel (Addressable LED) Functions for CH551, CH552 and CH554            * v1.2 *
+// NeoPixel (Addressable LED) Functions for CH551, CH552 and CH554            * v1.3 *
 // ===================================================================================
 //
 // Basic control functions for 800kHz addressable LEDs (NeoPixel). A simplified
@@ -11,6 +11,15 @@
 // NEO_COUNT - total number of pixels
 // System clock frequency must be at least 6 MHz.
 //
+// Optional settings in config.h:
+// NEO_IRQ_GAP - re-enable interrupts between pixels
+// NEO_GAP_US  - longest gap between pixels (below the reset time of the pixels),
+//               a frame with a longer gap is sent again
+//
+// NEO_update() does not wait for the latch time, it sets a deadline on the
+// timer2 timebase instead (TB_init() must have been called). NEO_latch() is a
+// blocking wait for code that cannot use the timebase.
+//
 // Further information:     https://github.com/wagiminator/ATtiny13-NeoController
 // 2023 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -25,7 +34,8 @@
 
 void NEO_sendByte(uint8_t data);                                      // send a single byte to the pixels
 void NEO_clearAll(void);                                              // clear all pixels
-void NEO_update(void);                                                // write buffer to pixels
+void NEO_update(void);                                                // write changed pixels (non-blocking)
+uint8_t NEO_ready(void);                                              // check if latch time is over
 void NEO_writeColor(uint8_t pixel, uint8_t r, uint8_t g, uint8_t b);  // write color to pixel in buffer
 void NEO_writeHue(uint8_t pixel, uint8_t hue, uint8_t bright);        // hue (0..191), brightness (0..2)
 void NEO_clearPixel(uint8_t pixel);                                   // clear one pixel in buffer
\ No newline at end of file
@@ -0,0 +1,101 @@
+// ===================================================================================
+// Latency Instrumentation for CH551, CH552 and CH554                         * v1.0 *
+// ===================================================================================
+
+#include "perf.h"
+#include "timebase.h"
+#include "usb_hid.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define PERF_IDLE         0             // waiting for a key edge
+#define PERF_EDGE         1             // key edge seen, waiting for a report
+#define PERF_QUEUED       2             // report queued, waiting for the ACK
+
+#if PERF_SAMPLES & (PERF_SAMPLES - 1)
+  #error PERF_SAMPLES must be a power of 2!
+#endif
+
+__xdata PERF_STATS PERF_stats;          // statistics
+__xdata uint16_t   PERF_edgeTime;       // timestamp of key edge
+__xdata uint16_t   PERF_queueTime;      // timestamp of report queueing
+__xdata uint16_t   PERF_offTime;        // timestamp of interrupts disabled
+__xdata uint8_t    PERF_pending;        // EP1 IN completions until our report
+volatile uint8_t   PERF_state;          // measurement state
+
+// ===================================================================================
+// Clear Statistics
+// ===================================================================================
+// Called from the main loop and from the USB interrupt (vendor request), the
+// static variables (nooverlay) are only used with the interrupts blocked.
+#pragma save
+#pragma nooverlay
+void PERF_reset(void) {
+  __xdata uint8_t* p;
+  uint8_t i;
+  __bit ea = EA;
+  EA = 0;
+  p = (__xdata uint8_t*)&PERF_stats;
+  for(i=offsetof(PERF_STATS, readyMs); i; i--) *p++ = 0;
+  PERF_stats.minUs = 0xFFFF;
+  PERF_state = PERF_IDLE;
+  EA = ea;
+}
+
+#ifdef PERF_ENABLE
+// ===================================================================================
+// Measurement Hooks
+// ===================================================================================
+// All hooks share TB_microsIsr() and static variables (nooverlay). The edge and
+// ACK hooks only run in interrupts, the IRQ hooks with EA = 0. The queue hook
+// runs in the main loop and in the USB interrupt, it blocks the interrupts.
+void PERF_keyEdge(void) {
+  if(PERF_state != PERF_IDLE) return;   // measurement in progress
+  PERF_edgeTime = TB_microsIsr();
+  PERF_state    = PERF_EDGE;
+}
+
+// The report is ACKed with the completion of every transfer in front of it
+// (queued or in flight) plus its own.
+void PERF_reportQueued(void) {
+  __bit ea = EA;
+  EA = 0;
+  if(PERF_state == PERF_EDGE) {
+    PERF_queueTime = TB_microsIsr();
+    PERF_pending   = HID_queueDepth();
+    PERF_state     = PERF_QUEUED;
+  }
+  EA = ea;
+}
+
+void PERF_reportDone(void) {
+  uint16_t now, total;
+  uint8_t i;
+  if(!PERF_stats.readyMs) PERF_stats.readyMs = TB_ms;
+  if((PERF_state != PERF_QUEUED) || --PERF_pending) return;
+  now   = TB_microsIsr();
+  total = now - PERF_edgeTime;
+  PERF_stats.ring[PERF_stats.head].edgeToQueue = PERF_queueTime - PERF_edgeTime;
+  PERF_stats.ring[PERF_stats.head].queueToAck  = now - PERF_queueTime;
+  PERF_stats.head = (PERF_stats.head + 1) & (PERF_SAMPLES - 1);
+  if(total < PERF_stats.minUs) PERF_stats.minUs = total;
+  if(total > PERF_stats.maxUs) PERF_stats.maxUs = total;
+  PERF_stats.sumUs += total;
+  PERF_stats.count++;
+  for(i=0; (i < PERF_BUCKETS - 1) && (total >= (250 << i)); i++);
+  PERF_stats.hist[i]++;
+  PERF_state = PERF_IDLE;
+}
+
+void PERF_irqOff(void) {
+  PERF_offTime = TB_microsIsr();
+}
+
+void PERF_irqOn(void) {
+  uint16_t t = TB_microsIsr() - PERF_offTime;
+  if(t > PERF_stats.irqOffMaxUs) PERF_stats.irqOffMaxUs = t;
+  PERF_stats.irqOffSumUs += t;
+}
+#endif
+#pragma restore
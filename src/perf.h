@@ -0,0 +1,81 @@
+// ===================================================================================
+// Latency Instrumentation for CH551, CH552 and CH554                         * v1.0 *
+// ===================================================================================
+//
+// Measures the time from a debounced key edge to the queueing of the next
+// input report and from there to the host ACK of that report (EP1 IN complete).
+// Only one measurement runs at a time. Timestamps come from the timer2 timebase.
+//
+// Hooks (empty macros unless PERF_ENABLE is defined in config.h):
+// -----------------------------------------------------------------
+// PERF_keyEdge()           key edge accepted (scan interrupt)
+// PERF_reportQueued()      input report queued or sent (with USB interrupt masked)
+// PERF_reportDone()        EP1 IN transfer completed (USB interrupt)
+// PERF_reportDropped()     report rejected, queue full
+// PERF_reportCoalesced()   pending report replaced by a newer one
+// PERF_irqOff()            interrupts have just been disabled (NEO_update)
+// PERF_irqOn()             interrupts are about to be enabled again
+//
+// Functions available:
+// --------------------
+// PERF_reset()             clear all statistics
+// PERF_stats               statistics, readable by vendor request VEN_GET_PERF
+//
+// Average latency is sumUs / count, histogram bucket i counts total latencies
+// below 250us << i, the last bucket everything above. readyMs is the boot time
+// up to the first touch report the host took (touch screen usable). It and the
+// recovery counters behind it (set by the supervisor) are kept by PERF_reset().
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+#define PERF_SAMPLES      8             // size of the sample ring (power of 2)
+#define PERF_BUCKETS      8             // number of histogram buckets
+
+typedef struct _PERF_SAMPLE {
+  uint16_t edgeToQueue;                 // key edge -> report queued in us
+  uint16_t queueToAck;                  // report queued -> host ACK in us
+} PERF_SAMPLE;
+
+typedef struct _PERF_STATS {
+  uint16_t count;                       // number of measured reports
+  uint16_t minUs;                       // minimum edge -> ACK latency
+  uint16_t maxUs;                       // maximum edge -> ACK latency
+  uint32_t sumUs;                       // sum of all edge -> ACK latencies
+  uint16_t hist[PERF_BUCKETS];          // latency histogram
+  uint16_t dropped;                     // reports rejected (queue full)
+  uint16_t coalesced;                   // pending reports replaced
+  uint16_t irqOffMaxUs;                 // longest EA = 0 section in NEO_update
+  uint32_t irqOffSumUs;                 // total time with EA = 0 in NEO_update
+  uint8_t  head;                        // next slot in sample ring
+  PERF_SAMPLE ring[PERF_SAMPLES];       // last samples
+  uint16_t readyMs;                     // start of main() -> first EP1 IN ACK in ms
+  uint8_t  resetCause;                  // RST_FLAG_* of the last reset
+  uint8_t  wdtResets;                   // watchdog resets since power-on
+  uint8_t  reattaches;                  // soft USB re-attaches (supervisor.h)
+} PERF_STATS;
+
+extern __xdata PERF_STATS PERF_stats;
+
+void PERF_reset(void);
+
+#ifdef PERF_ENABLE
+void PERF_keyEdge(void);
+void PERF_reportQueued(void);
+void PERF_reportDone(void);
+void PERF_irqOff(void);
+void PERF_irqOn(void);
+#define PERF_reportDropped()    PERF_stats.dropped++
+#define PERF_reportCoalesced()  PERF_stats.coalesced++
+#else
+#define PERF_keyEdge()
+#define PERF_reportQueued()
+#define PERF_reportDone()
+#define PERF_irqOff()
+#define PERF_irqOn()
+#define PERF_reportDropped()
+#define PERF_reportCoalesced()
+#endif
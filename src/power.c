@@ -0,0 +1,115 @@
+// ===================================================================================
+// Power Management for CH551, CH552 and CH554                                * v1.0 *
+// ===================================================================================
+
+#include "power.h"
+#include "gpio.h"
+#include "scan.h"
+#include "supervisor.h"
+#include "system.h"
+#include "timebase.h"
+#include "usb_hid.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define PWR_WAKE_PINS     (WAKE_INT | WAKE_RXD0)  // P3.3 (ENC_SW) and P3.0 (ENC_B)
+#define PWR_RESUME_MS     2                       // remote wakeup K-state (1..15ms)
+
+volatile uint8_t PWR_wakeLatency;                 // wake-to-report latency in ticks
+__xdata uint8_t  PWR_wakeTick;                    // scan tick at wake-up
+__xdata uint8_t  PWR_tracking;                    // 1: awake, 2: report queued
+__xdata uint8_t  PWR_lastTick;                    // last tick seen by PWR_idle()
+volatile __bit   PWR_suspendDue;                  // bus suspended (USB interrupt)
+
+static void PWR_suspend(void);
+
+// ===================================================================================
+// Wait for the Next Scan Tick
+// ===================================================================================
+// All inputs are sampled by the scan interrupt, so nothing the main loop
+// reacts to can change between two ticks. Also finishes the latency measurement
+// once the first report after a wake-up has been picked up by the host, and
+// powers down if the bus has been suspended.
+void PWR_idle(void) {
+  if(PWR_suspendDue) PWR_suspend();
+  while(SCAN_ticks == PWR_lastTick);
+  PWR_lastTick = SCAN_ticks;
+  if((PWR_tracking == 2) && !HID_busy()) {
+    PWR_wakeLatency = PWR_lastTick - PWR_wakeTick;
+    PWR_tracking = 0;
+  }
+}
+
+// ===================================================================================
+// Start Latency Measurement with the First Report after Wake-up
+// ===================================================================================
+void PWR_reportQueued(void) {
+  if(PWR_tracking == 1) PWR_tracking = 2;
+}
+
+// ===================================================================================
+// USB Suspend Handler
+// ===================================================================================
+// The USB interrupt only flags the suspend, so it stays short and the other
+// interrupts keep running. The main loop powers down from PWR_idle().
+#pragma save
+#pragma nooverlay
+void PWR_suspendIrq(void) {
+  PWR_suspendDue = 1;
+}
+#pragma restore
+
+// Power-down is repeated until either the host resumes the bus or, if the host
+// enabled remote wakeup, a wake-up key is active. In the latter case resume
+// signaling (K-state) is driven on the bus. The watchdog stands still in
+// power-down (no clock), it is fed on every wake-up as the main loop does not
+// run meanwhile. The interrupts of a wake-up are served right away.
+static void PWR_suspend(void) {
+  uint8_t led;
+
+  PWR_suspendDue = 0;
+  if(!(USB_MIS_ST & bUMS_SUSPEND)) return;        // resumed already
+
+  led = PIN_read(PIN_LED);
+  PIN_high(PIN_LED);                              // LED off while suspended
+
+  SAFE_MOD = 0x55;
+  SAFE_MOD = 0xAA;
+  WAKE_enable(WAKE_USB);                          // wake by bus activity
+  #ifdef USB_REMOTE_WAKEUP
+  if(USB_REMOTE_WAKE) {
+    SAFE_MOD = 0x55;
+    SAFE_MOD = 0xAA;
+    WAKE_enable(PWR_WAKE_PINS);                   // wake by encoder switch/turn
+  }
+  #endif
+
+  while(USB_MIS_ST & bUMS_SUSPEND) {
+    SLEEP_now();                                  // power-down until wake-up event
+    __asm__("nop");
+    __asm__("nop");
+    SUP_feed();
+    #ifdef USB_REMOTE_WAKEUP
+    if(USB_REMOTE_WAKE && (!PIN_read(PIN_ENC_SW) || !PIN_read(PIN_ENC_B))) {
+      UDEV_CTRL |= bUD_LOW_SPEED;                 // drive K-state (resume)
+      TB_waitMs(PWR_RESUME_MS + 1);               // at least PWR_RESUME_MS
+      UDEV_CTRL &= ~bUD_LOW_SPEED;                // back to full speed J-state
+      break;
+    }
+    #endif
+  }
+
+  SAFE_MOD = 0x55;
+  SAFE_MOD = 0xAA;
+  WAKE_disable(WAKE_USB);
+  #ifdef USB_REMOTE_WAKEUP
+  SAFE_MOD = 0x55;
+  SAFE_MOD = 0xAA;
+  WAKE_disable(PWR_WAKE_PINS);
+  #endif
+
+  if(!led) PIN_low(PIN_LED);                      // restore LED
+  PWR_wakeTick = SCAN_ticks;                      // start latency measurement
+  PWR_tracking = 1;
+}
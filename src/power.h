@@ -0,0 +1,38 @@
+// ===================================================================================
+// Power Management for CH551, CH552 and CH554                                * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// PWR_idle()               wait until the next scan tick (nothing can change before),
+//                          power down while the bus is suspended (until resume or
+//                          wake key)
+// PWR_suspendIrq()         USB suspend handler, flags the suspend for PWR_idle()
+// PWR_reportQueued()       tell latency tracking that an input report was queued
+// PWR_wakeLatency          ticks from the last wake-up to the first delivered report
+//
+// The CH55x has no CPU idle mode, only power-down (PCON.PD) which stops all
+// clocks including USB and the timers. The main loop therefore paces itself on
+// the scan ticks, and power-down is only entered while the bus is suspended.
+//
+// While suspended the chip can only be woken by USB activity, RXD0 (P3.0) low
+// and INT1 (P3.3) low, so remote wakeup works with the encoder switch and by
+// turning the encoder. The other keys are not connected to wake-up capable pins.
+//
+// The following must be defined in config.h:
+// PIN_LED, PIN_ENC_SW, PIN_ENC_B
+// USB_REMOTE_WAKEUP - (optional) allow the host to enable remote wakeup
+//
+// PWR_suspendIrq() is called from the USB interrupt (USB_SUSPEND_handler), the
+// power-down itself runs in the main loop, so no interrupt is blocked meanwhile.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+extern volatile uint8_t PWR_wakeLatency;  // last wake-to-report latency in scan ticks
+
+void PWR_idle(void);                      // wait until the next scan tick
+void PWR_suspendIrq(void);                // USB suspend handler
+void PWR_reportQueued(void);              // an input report has been queued
@@ -0,0 +1,278 @@
+// ===================================================================================
+// Timer-Driven Input Scan Engine for CH551, CH552 and CH554                  * v1.1 *
+// ===================================================================================
+
+#include "scan.h"
+#include "gpio.h"
+#include "perf.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define SCAN_TICKS        (F_CPU / 12 / SCAN_RATE_HZ)   // timer0 runs at Fsys/12
+#define SCAN_RELOAD       (65536 - SCAN_TICKS)
+
+#if SCAN_TICKS < 100 || SCAN_TICKS > 65535
+  #error SCAN_RATE_HZ out of range for this system clock!
+#endif
+#if SCAN_QUEUE_SIZE & (SCAN_QUEUE_SIZE - 1)
+  #error SCAN_QUEUE_SIZE must be a power of 2!
+#endif
+#if SCAN_KEYS < 1 || SCAN_KEYS > 16
+  #error SCAN_INPUTS must declare 1 to 16 keys!
+#endif
+#define SCAN_BAD_PIN(pin, slot)           || (slot) >= MAP_KEYS
+#define SCAN_BAD_MATRIX(row, pin, slot)   || (slot) >= MAP_KEYS
+#if 0 SCAN_INPUTS(SCAN_BAD_PIN, SCAN_BAD_MATRIX)
+  #error SCAN_INPUTS slot out of range (0 .. MAP_KEYS - 1)!
+#endif
+
+__xdata uint8_t  SCAN_queue[SCAN_QUEUE_SIZE];           // event queue
+volatile uint8_t SCAN_head, SCAN_tail;                  // queue write/read index
+volatile SCAN_MASK SCAN_state;                          // debounced states
+volatile uint8_t SCAN_ticks;                            // sample counter
+volatile SCAN_MASK SCAN_forced;                         // keys pressed by self-test
+volatile SCAN_MASK SCAN_ext;                            // keys driven by other drivers
+SCAN_MASK        SCAN_counting;                         // keys with debounce running
+__xdata uint8_t  SCAN_count[SCAN_KEYS];                 // debounce counters
+
+// Input table: contact slots, matrix keys
+#define SCAN_SLOT_PIN(pin, slot)          slot,
+#define SCAN_SLOT_MATRIX(row, pin, slot)  slot,
+__code uint8_t SCAN_slot[] = {SCAN_INPUTS(SCAN_SLOT_PIN, SCAN_SLOT_MATRIX)};
+
+#define SCAN_IS_PIN(pin, slot)            0,
+#define SCAN_IS_MATRIX(row, pin, slot)    1,
+__code uint8_t SCAN_isMatrix[] = {SCAN_INPUTS(SCAN_IS_PIN, SCAN_IS_MATRIX)};
+
+// Sample the keys, in = pressed pins (bit n: pin n of the gpio.h enumeration)
+#define SCAN_GET_PIN(pin, slot) \
+  if(in & (1U << (pin))) raw |= mask; \
+  mask <<= 1;
+#define SCAN_GET_MATRIX(row, pin, slot) \
+  if(SCAN_mat[row] & (1U << (pin))) raw |= mask; \
+  mask <<= 1;
+
+#ifdef SCAN_MATRIX_ROWS
+__code uint8_t   SCAN_rowPin[] = {SCAN_MATRIX_ROWS};    // row pins
+#define SCAN_ROWS (sizeof(SCAN_rowPin))
+__code uint8_t   SCAN_pinBit[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+__xdata uint16_t SCAN_mat[SCAN_ROWS];                   // accepted columns per row
+__xdata uint16_t SCAN_matRaw[SCAN_ROWS];                // columns of the current cycle
+__xdata uint8_t  SCAN_row;                              // row driven low
+SCAN_MASK        SCAN_matKeys;                          // keys in the matrix
+
+// Column pins of the matrix keys, the other pins of the ports (direct keys, rows,
+// encoder, USB) read the same in every row and must not count as columns
+#define SCAN_COL_PIN(pin, slot)
+#define SCAN_COL_MATRIX(row, pin, slot)   | (1U << (pin))
+#define SCAN_COLUMNS      (0 SCAN_INPUTS(SCAN_COL_PIN, SCAN_COL_MATRIX))
+
+// Drive a row low or release it (quasi-bidirectional pins with pull-up), the
+// port latch is changed by read-modify-write so the other pins are not touched
+#pragma save
+#pragma nooverlay
+static void SCAN_drive(uint8_t row, uint8_t low) {
+  uint8_t pin = SCAN_rowPin[row];
+  uint8_t bit = SCAN_pinBit[pin & 7];
+  if(pin >= P30) {
+    if(low) P3 &= ~bit;
+    else    P3 |= bit;
+  }
+  else {
+    if(low) P1 &= ~bit;
+    else    P1 |= bit;
+  }
+}
+#pragma restore
+#endif
+
+volatile int8_t  SCAN_encSteps;                         // encoder step accumulator
+__xdata uint8_t  SCAN_encState;                         // last two A/B samples
+__xdata int8_t   SCAN_encSub;                           // transitions within detent
+__xdata uint8_t  SCAN_encIdle;                          // ticks since last detent
+
+#define ENC_ACCEL_TICKS   (ENC_ACCEL_MS * 1L * SCAN_RATE_HZ / 1000)
+#if defined(ENC_ACCEL) && (ENC_ACCEL_TICKS < 1 || ENC_ACCEL_TICKS > 255)
+  #error ENC_ACCEL_MS out of range for this scan rate!
+#endif
+
+// Quadrature transition table, index: (A_old B_old A_new B_new), +1 = clockwise.
+// Invalid transitions (both pins changed, i.e. bounces or missed samples) count 0.
+__code int8_t SCAN_encTable[16] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+
+// ===================================================================================
+// Setup Timer0 and Start Scanning
+// ===================================================================================
+void SCAN_init(void) {
+  #ifdef SCAN_MATRIX_ROWS
+  uint8_t i;
+  #endif
+
+  SCAN_head  = 0;
+  SCAN_tail  = 0;
+  SCAN_state = 0;
+  SCAN_forced = 0;
+  SCAN_ext    = 0;
+  SCAN_counting = 0;
+  #ifdef SCAN_MATRIX_ROWS
+  SCAN_matKeys = 0;
+  for(i=0; i<SCAN_KEYS; i++)
+    if(SCAN_isMatrix[i]) SCAN_matKeys |= (SCAN_MASK)1 << i;
+  for(i=0; i<SCAN_ROWS; i++) {
+    SCAN_mat[i] = 0;
+    SCAN_drive(i, 0);
+  }
+  SCAN_row = 0;
+  SCAN_drive(0, 1);                                     // first row
+  #endif
+  SCAN_encSteps = 0;
+  SCAN_encSub   = 0;
+  SCAN_encIdle  = 255;
+  SCAN_encState = (PIN_read(PIN_ENC_A) ? 2 : 0) | (PIN_read(PIN_ENC_B) ? 1 : 0);
+  TMOD = (TMOD & ~(bT0_M1 | bT0_M0)) | bT0_M0;          // timer0 16-bit mode, Fsys/12
+  TH0  = (uint8_t)(SCAN_RELOAD >> 8);
+  TL0  = (uint8_t)SCAN_RELOAD;
+  TF0  = 0;                                             // clear interrupt flag
+  ET0  = 1;                                             // enable timer0 interrupt
+  TR0  = 1;                                             // start timer0
+}
+
+// ===================================================================================
+// Read Next Event from Queue
+// ===================================================================================
+uint8_t SCAN_read(void) {
+  uint8_t ev;
+  if(SCAN_head == SCAN_tail) return SCAN_EV_NONE;       // queue empty
+  ev = SCAN_queue[SCAN_tail & (SCAN_QUEUE_SIZE - 1)];
+  SCAN_tail++;
+  return ev;
+}
+
+// ===================================================================================
+// Read and Clear Encoder Steps
+// ===================================================================================
+int8_t SCAN_readEncoder(void) {
+  int8_t steps;
+  ET0 = 0;
+  steps = SCAN_encSteps;
+  SCAN_encSteps = 0;
+  ET0 = 1;
+  return steps;
+}
+
+// ===================================================================================
+// Post Key Edge
+// ===================================================================================
+// Queues the event and flips the state of the key, returns 0 if the queue is
+// full. Called from interrupts of the same priority only.
+#pragma save
+#pragma nooverlay
+uint8_t SCAN_post(uint8_t key, uint8_t pressed) {
+  if((uint8_t)(SCAN_head - SCAN_tail) >= SCAN_QUEUE_SIZE) return 0; // queue full
+  SCAN_queue[SCAN_head & (SCAN_QUEUE_SIZE - 1)] = pressed ? (SCAN_EV_PRESS | key)
+                                                          : (SCAN_EV_RELEASE | key);
+  SCAN_head++;
+  SCAN_state ^= (SCAN_MASK)1 << key;                    // accept edge
+  PERF_keyEdge();
+  return 1;
+}
+
+// ===================================================================================
+// Timer0 Interrupt Service Routine
+// ===================================================================================
+// An edge is only accepted after SCAN_DEBOUNCE equal samples. If the queue is
+// full, the state is not flipped so the edge is posted again on the next tick
+// and no release can get lost.
+void SCAN_interrupt(void) {
+  SCAN_MASK raw, diff, mask, sampled;
+  uint16_t in;
+  uint8_t i;
+  int8_t step;
+
+  TH0 = (uint8_t)(SCAN_RELOAD >> 8);                    // reload timer0
+  TL0 = (uint8_t)SCAN_RELOAD;
+  SCAN_ticks++;
+
+  // Read both ports at once (active low)
+  in = ~(((uint16_t)P3 << 8) | P1);
+
+  // Store the columns of the driven row and drive the next one, a full cycle
+  // is accepted unless two rows share more than one pressed column (ghosting)
+  sampled = ~(SCAN_MASK)0;
+  #ifdef SCAN_MATRIX_ROWS
+  SCAN_matRaw[SCAN_row] = in & SCAN_COLUMNS;
+  SCAN_drive(SCAN_row, 0);
+  if(++SCAN_row >= SCAN_ROWS) {
+    SCAN_row = 0;
+    for(i=0; i<SCAN_ROWS; i++) {
+      uint8_t j;
+      for(j=0; j<SCAN_ROWS; j++) {
+        uint16_t shared = SCAN_matRaw[i] & SCAN_matRaw[j];
+        if((i != j) && (shared & (shared - 1))) break;  // ambiguous, keep last state
+      }
+      if(j == SCAN_ROWS) SCAN_mat[i] = SCAN_matRaw[i];
+    }
+  }
+  else sampled = ~SCAN_matKeys;                         // no new matrix sample yet
+  SCAN_drive(SCAN_row, 1);
+  #endif
+
+  // Sample all keys, add keys pressed by self-test
+  raw  = 0;
+  mask = 1;
+  SCAN_INPUTS(SCAN_GET_PIN, SCAN_GET_MATRIX)
+  raw |= SCAN_forced;
+  raw = (raw & ~SCAN_ext) | (SCAN_state & SCAN_ext);    // not sampled here
+
+  // Decode the encoder
+  i = (SCAN_encState << 2) & 0x0C;
+  if(!(in & (1U << PIN_ENC_A))) i |= 2;
+  if(!(in & (1U << PIN_ENC_B))) i |= 1;
+  SCAN_encState = i;
+  SCAN_encSub  += SCAN_encTable[i];
+  step = 0;
+  if(SCAN_encSub >= ENC_STEPS_PER_DETENT)       step =  1;
+  else if(SCAN_encSub <= -ENC_STEPS_PER_DETENT) step = -1;
+  #if ENC_STEPS_PER_DETENT == 4
+  else if((i & 3) == 3) {                               // resync in rest position
+    if(SCAN_encSub >= 2)       step =  1;
+    else if(SCAN_encSub <= -2) step = -1;
+    SCAN_encSub = 0;
+  }
+  #endif
+  if(step) {
+    SCAN_encSub = 0;
+    #ifdef ENC_ACCEL
+    if(SCAN_encIdle < (uint8_t)ENC_ACCEL_TICKS)         // turning fast -> accelerate
+      step *= ENC_ACCEL_MAX - (int8_t)((uint16_t)SCAN_encIdle * (ENC_ACCEL_MAX - 1)
+                                                   / (uint8_t)ENC_ACCEL_TICKS);
+    #endif
+    SCAN_encIdle = 0;
+    if(step > 0) SCAN_encSteps = SCAN_encSteps > 127 - step ? 127 : SCAN_encSteps + step;
+    else SCAN_encSteps = SCAN_encSteps < -127 - step ? -127 : SCAN_encSteps + step;
+  }
+  if(SCAN_encIdle < 255) SCAN_encIdle++;
+
+  // Run the debounce state machines of the keys that changed or are still
+  // settling, matrix keys only when the matrix was sampled
+  diff = (raw ^ SCAN_state) & sampled;
+  if(!(diff | SCAN_counting)) return;                   // all stable
+  mask = 1;
+  for(i=0; i<SCAN_KEYS; i++, mask <<= 1) {
+    if(!(sampled & mask)) continue;
+    if(!(diff & mask)) {
+      SCAN_count[i] = 0;                                // stable, nothing to do
+      SCAN_counting &= ~mask;
+      continue;
+    }
+    SCAN_counting |= mask;
+    if(++SCAN_count[i] < SCAN_DEBOUNCE) continue;       // not stable long enough
+    SCAN_count[i] = SCAN_DEBOUNCE - 1;
+    if(SCAN_post(i, raw & mask)) {                      // else queue full, retry
+      SCAN_count[i] = 0;
+      SCAN_counting &= ~mask;
+    }
+  }
+}
+#pragma restore
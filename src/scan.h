@@ -0,0 +1,108 @@
+// ===================================================================================
+// Timer-Driven Input Scan Engine for CH551, CH552 and CH554                  * v1.1 *
+// ===================================================================================
+//
+// The keys and the rotary encoder are sampled from the timer0 interrupt at a
+// fixed rate. Every key runs its own debounce state machine, accepted edges are
+// posted as events into a queue which is drained by the main loop. The main loop
+// never has to wait, so press-to-report latency is only limited by the USB
+// polling interval. The encoder is decoded by a quadrature state machine into a
+// signed step accumulator, fast turns are accelerated.
+//
+// The keys are declared by the input table SCAN_INPUTS in config.h, in key order
+// (up to 16 keys). Every entry names the contact slot (touch map key) the key
+// drives, several keys may share a slot:
+//   PIN(pin, slot)           key between pin and GND (internal pull-up)
+//   MATRIX(row, pin, slot)   key between row pin number row of SCAN_MATRIX_ROWS and
+//                            column pin (internal pull-up)
+// The table expands to unrolled code: every tick reads P1 and P3 once and tests
+// one bit per key, the debounce state machines only run for keys that changed.
+// The matrix drives one row low per tick and reads the columns of it on the next
+// tick, so matrix keys are sampled every SCAN_MATRIX_ROWS ticks and debounced
+// over SCAN_DEBOUNCE of these samples. Without diodes, three pressed keys on the
+// corners of a rectangle make the fourth one read pressed as well. Rows that
+// share more than one pressed column keep their last state until the ambiguity
+// is gone, so no ghost key is ever reported.
+//
+// Functions available:
+// --------------------
+// SCAN_init()              setup timer0 and start scanning
+// SCAN_available()         number of events waiting in the queue
+// SCAN_read()              read next event from the queue (SCAN_EV_NONE if empty)
+// SCAN_isPressed(key)      debounced state of key (0 .. SCAN_KEYS - 1)
+// SCAN_slot[key]           contact slot driven by key
+// SCAN_readEncoder()       read and clear encoder steps (+: clockwise, -: counter-cw)
+// SCAN_ticks               free-running 8-bit counter, incremented every sample
+// SCAN_force(key, on)      hold key pressed (self-test), debounced like a real key
+// SCAN_post(key, pressed)  post an edge of a key driven by another driver (interrupt)
+// SCAN_ext                 keys driven by other drivers, their pins are not sampled
+//
+// Events:
+// -------
+// SCAN_EV_PRESS   | key     key has been pressed
+// SCAN_EV_RELEASE | key     key has been released
+//
+// The following must be defined in config.h:
+// SCAN_INPUTS(PIN, MATRIX) - input table, see above
+// SCAN_MATRIX_ROWS - (optional) row pins of the key matrix, comma separated
+// PIN_ENC_A, PIN_ENC_B
+// SCAN_RATE_HZ     - sample rate in Hz
+// SCAN_DEBOUNCE    - number of stable samples before an edge is accepted
+// SCAN_QUEUE_SIZE  - number of events the queue can hold (power of 2)
+// ENC_STEPS_PER_DETENT - quadrature transitions per encoder detent
+// ENC_ACCEL        - (optional) enable velocity-based acceleration
+// ENC_ACCEL_MS     - detents closer than this are accelerated
+// ENC_ACCEL_MAX    - maximum acceleration factor
+//
+// The timer0 interrupt must be routed to SCAN_interrupt() in the main file.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+// ===================================================================================
+// Keys and Events
+// ===================================================================================
+#define SCAN_KEY1         0             // keys of the default input table: key 1
+#define SCAN_KEY2         1             // key 2
+#define SCAN_KEY3         2             // key 3
+#define SCAN_KEY_ENC      3             // encoder switch
+
+#define SCAN_COUNT_PIN(pin, slot)         +1
+#define SCAN_COUNT_MATRIX(row, pin, slot) +1
+#define SCAN_KEYS (0 SCAN_INPUTS(SCAN_COUNT_PIN, SCAN_COUNT_MATRIX)) // number of keys
+
+#if SCAN_KEYS > 8
+typedef uint16_t SCAN_MASK;             // one bit per key
+#else
+typedef uint8_t  SCAN_MASK;
+#endif
+
+#define SCAN_EV_RELEASE   0x00          // key released (ORed with key number)
+#define SCAN_EV_PRESS     0x80          // key pressed (ORed with key number)
+#define SCAN_EV_NONE      0xFF          // queue is empty
+
+#define SCAN_EV_KEY(ev)      ((ev) & 0x0F)          // get key number of event
+#define SCAN_EV_IS_PRESS(ev) ((ev) & SCAN_EV_PRESS) // check if event is a key press
+
+// ===================================================================================
+// Variables and Functions
+// ===================================================================================
+extern volatile uint8_t SCAN_head, SCAN_tail;
+extern volatile SCAN_MASK SCAN_state;   // debounced key states (bit = 1: pressed)
+extern volatile uint8_t SCAN_ticks;     // sample counter
+extern volatile SCAN_MASK SCAN_forced;  // keys held pressed by self-test
+extern volatile SCAN_MASK SCAN_ext;     // keys driven by other drivers (touch keys)
+extern __code uint8_t SCAN_slot[];      // contact slot of every key
+
+#define SCAN_available()  ((uint8_t)(SCAN_head - SCAN_tail))
+#define SCAN_isPressed(k) (SCAN_state & ((SCAN_MASK)1 << (k)))
+#define SCAN_force(k, on) ((on) ? (SCAN_forced |= (SCAN_MASK)1 << (k)) \
+                                : (SCAN_forced &= ~((SCAN_MASK)1 << (k))))
+
+void SCAN_init(void);                   // setup timer0 and start scanning
+uint8_t SCAN_read(void);                // read next event from queue
+int8_t SCAN_readEncoder(void);          // read and clear encoder steps
+uint8_t SCAN_post(uint8_t key, uint8_t pressed); // post key edge (interrupt)
+void SCAN_interrupt(void);              // timer0 interrupt service routine
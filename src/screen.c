@@ -0,0 +1,99 @@
+// ===================================================================================
+// Screen Coordinate Mapper for CH551, CH552 and CH554                        * v1.0 *
+// ===================================================================================
+
+#include "screen.h"
+#include "flash.h"
+#include "touchmap.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#if MAP_KEYS * 6 + MAP_GESTURES * 7 + 2 > SCR_FLASH_ADDR
+  #error Touch map overlaps the display profile in data flash!
+#endif
+#if DISPLAY_WIDTH < 1 || DISPLAY_HEIGHT < 1 || DISPLAY_ROTATION > SCR_ROT_270
+  #error Invalid static display profile!
+#endif
+
+__code SCR_DATA SCR_profile[] = {
+  SCR_PROFILE(DISPLAY_WIDTH, DISPLAY_HEIGHT, DISPLAY_ROTATION,
+              DISPLAY_OFFSET_X, DISPLAY_OFFSET_Y),
+  #ifdef DISPLAY_PROFILES
+  DISPLAY_PROFILES
+  #endif
+};
+#define SCR_PROFILES    (sizeof(SCR_profile) / sizeof(SCR_DATA))
+
+__xdata uint8_t  SCR_selected;                  // selected profile
+__xdata uint16_t SCR_x, SCR_y;                  // result of SCR_map()
+volatile __bit   SCR_dirty;                     // selection must be stored
+
+// ===================================================================================
+// Select Profile
+// ===================================================================================
+
+// Load the selected profile from data flash (profile 0 if invalid)
+void SCR_load(void) {
+  SCR_selected = FLASH_read(SCR_FLASH_ADDR);
+  if(SCR_selected >= SCR_PROFILES) SCR_selected = 0;
+  SCR_dirty = 0;
+}
+
+// Select a profile (called from the USB interrupt), stored by SCR_poll()
+uint8_t SCR_select(uint8_t p) {
+  if(p >= SCR_PROFILES) return 0;
+  SCR_selected = p;
+  SCR_dirty    = 1;
+  return 1;
+}
+
+// Number of profiles
+uint8_t SCR_profiles(void) {
+  return SCR_PROFILES;
+}
+
+// Store a new selection in data flash
+void SCR_poll(void) {
+  if(!SCR_dirty) return;
+  SCR_dirty = 0;
+  FLASH_write(SCR_FLASH_ADDR, SCR_selected);
+}
+
+// ===================================================================================
+// Map Pixel to Logical Coordinates
+// ===================================================================================
+// Only called from the USB interrupt (relay frames), multiplications by shift and
+// add as the long multiplication of the library is not reentrant
+#pragma save
+#pragma nooverlay
+static uint16_t SCR_scale(uint16_t v, uint32_t scale) {
+  uint32_t r = 0;
+  while(v) {
+    if(v & 1) r += scale;
+    scale <<= 1;
+    v >>= 1;
+  }
+  return r >> 16;
+}
+
+void SCR_map(uint16_t px, uint16_t py) {
+  __code SCR_DATA* p = &SCR_profile[SCR_selected];
+  int32_t mx, my, x, y;
+
+  if(px > p->w) px = p->w;                      // result within MT_LOGICAL_MAX
+  if(py > p->h) py = p->h;
+  mx = SCR_scale(px, p->sx);
+  my = SCR_scale(py, p->sy);
+  switch(p->rotation) {
+    case SCR_ROT_0:   x = mx;                  y = my;                  break;
+    case SCR_ROT_90:  x = MT_LOGICAL_MAX - my; y = mx;                  break;
+    case SCR_ROT_180: x = MT_LOGICAL_MAX - mx; y = MT_LOGICAL_MAX - my; break;
+    default:          x = my;                  y = MT_LOGICAL_MAX - mx; break;
+  }
+  x += p->ox;
+  y += p->oy;
+  SCR_x = SCR_CLAMP(x);
+  SCR_y = SCR_CLAMP(y);
+}
+#pragma restore
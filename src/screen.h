@@ -0,0 +1,84 @@
+// ===================================================================================
+// Screen Coordinate Mapper for CH551, CH552 and CH554                        * v1.0 *
+// ===================================================================================
+//
+// Maps screen pixel coordinates to the logical touch range 0..MT_LOGICAL_MAX
+// with a display profile: resolution, rotation and calibration offsets. Only
+// integer math is used, every axis is px * scale >> 16 with a 16.16 fixed-point
+// scale that is computed at compile time for every profile.
+//
+// Static profile: SCR_PX(px, py) expands to the logical x, y of a pixel of the
+// DISPLAY_* profile in config.h as constant expressions, e.g. for the touch map
+// defaults: {0x01, 0x7F, SCR_PX(110, 108)}. Nothing is left for run time.
+//
+// Selectable profiles: profile 0 is the static profile, DISPLAY_PROFILES adds
+// more. The selected profile is stored in data flash (SCR_FLASH_ADDR) and is used
+// by SCR_map(), e.g. for relay frames with pixel coordinates.
+//
+// Rotation (how the pixel frame is turned clockwise against the touch frame,
+// mx/my = pixel scaled to the logical range):
+// SCR_ROT_0      x = mx,       y = my
+// SCR_ROT_90     x = MAX - my, y = mx
+// SCR_ROT_180    x = MAX - mx, y = MAX - my
+// SCR_ROT_270    x = my,       y = MAX - mx
+// The calibration offsets (logical units) are added last, the result is clamped.
+//
+// Functions available:
+// --------------------
+// SCR_load()               load the selected profile from data flash
+// SCR_select(p)            select profile p, returns 0 if there is no such profile
+// SCR_poll()               store a new selection in data flash, call from main loop
+// SCR_map(px, py)          map a pixel to SCR_x, SCR_y (USB interrupt, relay)
+// SCR_selected             number of the selected profile
+// SCR_profiles()           number of profiles
+//
+// The following must be defined in config.h:
+// DISPLAY_WIDTH, DISPLAY_HEIGHT     - resolution of the static profile in pixels
+// DISPLAY_ROTATION                  - SCR_ROT_0 .. SCR_ROT_270
+// DISPLAY_OFFSET_X, DISPLAY_OFFSET_Y - calibration offsets in logical units
+// DISPLAY_PROFILES                  - (optional) more SCR_PROFILE(...) entries
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#define SCR_ROT_0       0               // rotations
+#define SCR_ROT_90      1
+#define SCR_ROT_180     2
+#define SCR_ROT_270     3
+
+#define SCR_FLASH_ADDR  63              // data flash: selected profile
+
+typedef struct _SCR_DATA {
+  uint16_t w, h;                        // resolution in pixels
+  uint32_t sx, sy;                      // 16.16 scale of the pixel axes
+  uint8_t  rotation;                    // SCR_ROT_0 .. SCR_ROT_270
+  int16_t  ox, oy;                      // calibration offsets
+} SCR_DATA;
+
+// Profile table entry (width, height, rotation, offset x, offset y)
+#define SCR_SCALE(d)    ((((uint32_t)MT_LOGICAL_MAX) << 16) / (d))
+#define SCR_PROFILE(w, h, r, ox, oy) {w, h, SCR_SCALE(w), SCR_SCALE(h), r, ox, oy}
+
+// Static profile at compile time
+#define SCR_MX(px)      ((int32_t)((uint32_t)(px) * MT_LOGICAL_MAX / DISPLAY_WIDTH))
+#define SCR_MY(py)      ((int32_t)((uint32_t)(py) * MT_LOGICAL_MAX / DISPLAY_HEIGHT))
+#define SCR_CLAMP(v)    ((uint16_t)((v) < 0 ? 0 : (v) > MT_LOGICAL_MAX ? MT_LOGICAL_MAX : (v)))
+#define SCR_LX(px, py)  SCR_CLAMP(DISPLAY_OFFSET_X + \
+  (DISPLAY_ROTATION == SCR_ROT_0   ? SCR_MX(px) : \
+   DISPLAY_ROTATION == SCR_ROT_90  ? MT_LOGICAL_MAX - SCR_MY(py) : \
+   DISPLAY_ROTATION == SCR_ROT_180 ? MT_LOGICAL_MAX - SCR_MX(px) : SCR_MY(py)))
+#define SCR_LY(px, py)  SCR_CLAMP(DISPLAY_OFFSET_Y + \
+  (DISPLAY_ROTATION == SCR_ROT_0   ? SCR_MY(py) : \
+   DISPLAY_ROTATION == SCR_ROT_90  ? SCR_MX(px) : \
+   DISPLAY_ROTATION == SCR_ROT_180 ? MT_LOGICAL_MAX - SCR_MY(py) : MT_LOGICAL_MAX - SCR_MX(px)))
+#define SCR_PX(px, py)  SCR_LX(px, py), SCR_LY(px, py)
+
+extern __xdata uint8_t  SCR_selected;           // selected profile
+extern __xdata uint16_t SCR_x, SCR_y;           // result of SCR_map()
+
+void SCR_load(void);                    // load selected profile
+uint8_t SCR_select(uint8_t p);          // select profile
+void SCR_poll(void);                    // store new selection
+void SCR_map(uint16_t px, uint16_t py); // map pixel to SCR_x, SCR_y
+uint8_t SCR_profiles(void);             // number of profiles
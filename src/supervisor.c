@@ -0,0 +1,131 @@
+// ===================================================================================
+// Fault Supervisor for CH551, CH552 and CH554                                * v1.0 *
+// ===================================================================================
+
+#include "supervisor.h"
+#include "perf.h"
+#include "timebase.h"
+#include "usb_handler.h"
+#include "usb_hid.h"
+#include "usb_multitouch.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#if (F_CPU / 1000) * SUP_WDT_MS / 65536 < 1 || (F_CPU / 1000) * SUP_WDT_MS / 65536 > 255
+  #error SUP_WDT_MS out of the watchdog range at this clock!
+#endif
+
+#define SUP_OFF         0               // stopped (bootloader entry)
+#define SUP_WATCH       1               // watching USB
+#define SUP_DETACHED    2               // pull-up off, re-attach timer running
+
+__xdata uint8_t   SUP_state;            // SUP_OFF, SUP_WATCH, SUP_DETACHED
+__xdata uint8_t   SUP_tail;             // HID queue tail at the last check
+__xdata uint16_t  SUP_ep1Since;         // EP1 made no progress since (ms)
+__xdata uint8_t   SUP_polled;           // host picked up a report since attach
+__xdata uint8_t   SUP_retries;          // enumeration re-attaches left
+volatile uint16_t SUP_resetTime;        // last bus reset (ms)
+volatile __bit    SUP_resetSeen;        // bus reset, not configured yet
+
+void SUP_attach(void);
+
+// ===================================================================================
+// Start and Stop
+// ===================================================================================
+
+// Call once before the main loop. Watchdog resets are counted in RESET_KEEP,
+// which only a power-on reset clears.
+void SUP_init(void) {
+  PERF_stats.resetCause = PCON & MASK_RST_FLAG;
+  if(RST_wasWDT() && RST_getKeep() < 0xFF) RST_keep(RST_getKeep() + 1);
+  PERF_stats.wdtResets  = RST_getKeep();
+  SUP_tail     = HID_queueTail;
+  SUP_ep1Since = TB_millis();
+  SUP_polled   = 0;
+  SUP_retries  = SUP_ENUM_RETRIES;
+  SUP_state    = SUP_WATCH;
+  WDT_start();
+  SUP_feed();
+}
+
+void SUP_stop(void) {
+  WDT_stop();
+  TB_stop(TB_TMR_SUPER);
+  SUP_state = SUP_OFF;
+}
+
+// Bus reset (USB interrupt), the enumeration check starts over
+#pragma save
+#pragma nooverlay
+void SUP_busReset(void) {
+  SUP_resetTime = TB_ms;
+  SUP_resetSeen = 1;
+}
+#pragma restore
+
+// ===================================================================================
+// Soft Re-attach
+// ===================================================================================
+
+// Switch the pull-up off and drop all USB state, the host sees a disconnect
+void SUP_detach(void) {
+  IE_USB = 0;
+  USB_CTRL  &= ~bUC_DEV_PU_EN;          // detach
+  USB_EP_init();                        // drop endpoints and queued reports
+  USB_DEV_AD = 0x00;
+  USB_INT_FG = 0x1f;
+  SUP_resetSeen = 0;
+  IE_USB = 1;
+  if(PERF_stats.reattaches < 0xFF) PERF_stats.reattaches++;
+  SUP_state = SUP_DETACHED;
+  TB_start(TB_TMR_SUPER, SUP_DETACH_MS + 1, 0, SUP_attach);
+}
+
+// Pull-up on again (timer callback), the host enumerates the device anew
+void SUP_attach(void) {
+  USB_CTRL    |= bUC_DEV_PU_EN;
+  SUP_tail     = HID_queueTail;
+  SUP_ep1Since = TB_millis();
+  SUP_polled   = 0;
+  SUP_state    = SUP_WATCH;
+}
+
+// ===================================================================================
+// Main Loop Check
+// ===================================================================================
+void SUP_poll(void) {
+  uint16_t reset;
+  uint8_t  tail;
+
+  SUP_feed();
+  if(SUP_state != SUP_WATCH) return;
+
+  // Enumeration: configured in time after the last bus reset. The host forgot
+  // all contacts with the reset, the full state goes out right away.
+  if(USB_ENUM_OK) {
+    if(SUP_resetSeen) MT_sendKeyframe();
+    SUP_resetSeen = 0;
+    SUP_retries   = SUP_ENUM_RETRIES;
+  }
+  else if(SUP_resetSeen && SUP_retries) {
+    IE_USB = 0;
+    reset  = SUP_resetTime;                     // written by the USB interrupt
+    IE_USB = 1;
+    if(TB_elapsed(reset, SUP_ENUM_MS)) {
+      SUP_retries--;
+      SUP_detach();
+      return;
+    }
+  }
+
+  // EP1: the oldest report must be picked up in time
+  tail = HID_queueTail;
+  if(tail != SUP_tail || !HID_queueDepth() || !USB_ENUM_OK
+     || (USB_MIS_ST & bUMS_SUSPEND)) {
+    if(tail != SUP_tail && USB_ENUM_OK) SUP_polled = 1;
+    SUP_tail     = tail;
+    SUP_ep1Since = TB_millis();
+  }
+  else if(SUP_polled && TB_elapsed(SUP_ep1Since, SUP_EP1_MS)) SUP_detach();
+}
@@ -0,0 +1,43 @@
+// ===================================================================================
+// Fault Supervisor for CH551, CH552 and CH554                                * v1.0 *
+// ===================================================================================
+//
+// Watchdog and USB recovery. The watchdog is fed once per main loop pass
+// (SUP_poll()), so it resets the chip if the main loop stops for SUP_WDT_MS,
+// e.g. because the scan interrupt died and PWR_idle() waits forever. USB faults
+// are recovered without a reset by a soft re-attach: the device pull-up is
+// switched off for SUP_DETACH_MS, all endpoints and queued reports are dropped,
+// then the pull-up is switched on again and the host enumerates the device anew.
+// A re-attach is started if
+// - EP1 holds a report the host has not picked up for SUP_EP1_MS while the bus
+//   is configured and not suspended, and the host did poll EP1 before (a host
+//   without a touch driver that never polls is left alone)
+// - the host reset the bus, but did not configure the device within
+//   SUP_ENUM_MS (at most SUP_ENUM_RETRIES times until it is configured)
+//
+// The cause of the last reset, the number of watchdog resets since power-on
+// (kept in RESET_KEEP) and the number of re-attaches go to PERF_stats, which
+// PERF_reset() keeps.
+//
+// Functions available:
+// --------------------
+// SUP_init()               record the reset cause, start the watchdog
+// SUP_poll()               feed the watchdog, check USB, call from main loop
+// SUP_feed()               feed the watchdog (loops that keep the main loop away)
+// SUP_stop()               stop watchdog and USB checks (bootloader entry)
+// SUP_busReset()           bus reset seen (USB interrupt, USB_RESET_handler)
+//
+// The following must be defined in config.h:
+// SUP_WDT_MS, SUP_EP1_MS, SUP_ENUM_MS, SUP_ENUM_RETRIES, SUP_DETACH_MS
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+#include "system.h"
+
+#define SUP_feed()      WDT_set(SUP_WDT_MS)     // reload watchdog
+
+void SUP_init(void);                    // record reset cause, start watchdog
+void SUP_poll(void);                    // feed watchdog, check USB
+void SUP_stop(void);                    // stop watchdog and USB checks
+void SUP_busReset(void);                // bus reset seen (USB interrupt)
@@ -84,7 +84,9 @@ inline void CLK_config(void) {
   SAFE_MOD = 0x55;
   SAFE_MOD = 0xAA;                              // enter safe mode
   
-  #if F_CPU == 32000000
+  #if defined(HOST_BUILD)
+    // host build (make host), no clock tree to set up
+  #elif F_CPU == 32000000
     __asm__("orl _CLOCK_CFG, #0b00000111");     // 32MHz
   #elif F_CPU == 24000000
     __asm__("anl _CLOCK_CFG, #0b11111000");
@@ -171,9 +173,11 @@ inline void RST_now(void) {
 // Bootloader (BOOT) Functions
 // ===================================================================================
 inline void BOOT_now(void) {
+  #ifndef HOST_BUILD
   __asm
     ljmp #BOOT_LOAD_ADDR
   __endasm;
+  #endif
 }
 
 inline void BOOT_prepare(void) {
@@ -0,0 +1,165 @@
+// ===================================================================================
+// Timer2 Timebase for CH551, CH552 and CH554                                 * v1.1 *
+// ===================================================================================
+
+#include "timebase.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define TB_TICKS_US       (F_CPU / 1000000)             // timer2 runs at Fsys
+#define TB_TICKS_MS       (F_CPU / 1000)
+#define TB_RELOAD         (65536 - TB_TICKS_MS)
+
+#if F_CPU % 1000000 || TB_TICKS_MS > 65535
+  #error F_CPU not supported by the timebase!
+#endif
+
+// Timer2 ticks to microseconds without the library divide: a shift, for 3 << n
+// ticks per microsecond followed by a division by 3
+#if   TB_TICKS_US == 32 || TB_TICKS_US == 16 || TB_TICKS_US == 8
+  #define TB_US_SHIFT     (TB_TICKS_US == 32 ? 5 : TB_TICKS_US == 16 ? 4 : 3)
+#elif TB_TICKS_US == 24 || TB_TICKS_US == 12 || TB_TICKS_US == 6 || TB_TICKS_US == 3
+  #define TB_US_SHIFT     (TB_TICKS_US == 24 ? 3 : TB_TICKS_US == 12 ? 2 : TB_TICKS_US == 6)
+  #define TB_US_DIV3
+#else
+  #error F_CPU not supported by the timebase!
+#endif
+
+volatile uint16_t TB_ms;                                // millisecond counter
+volatile uint16_t TB_us;                                // microseconds at TB_ms tick
+__xdata TB_TIMER  TB_timer[TB_TIMERS];                  // software timers
+__xdata uint16_t  TB_pollLast;                          // millisecond of last TB_poll()
+
+// ===================================================================================
+// Setup and Start Timer2
+// ===================================================================================
+void TB_init(void) {
+  uint8_t i;
+  for(i=0; i<TB_TIMERS; i++) TB_timer[i].callback = 0;
+  TB_ms   = 0;
+  TB_us   = 0;
+  TB_pollLast = 0;
+  T2MOD  |= bTMR_CLK | bT2_CLK;                         // timer2 clock is Fsys
+  T2CON   = 0;                                          // 16-bit auto-reload timer
+  RCAP2H  = (uint8_t)(TB_RELOAD >> 8);
+  RCAP2L  = (uint8_t)TB_RELOAD;
+  TH2     = (uint8_t)(TB_RELOAD >> 8);
+  TL2     = (uint8_t)TB_RELOAD;
+  ET2     = 1;                                          // enable timer2 interrupt
+  TR2     = 1;                                          // start timer2
+}
+
+// ===================================================================================
+// Read Timestamps
+// ===================================================================================
+// TB_microsIsr() is for interrupts (all of the same priority) and for code that
+// runs with EA = 0 only: its variables are static (nooverlay) and nothing else
+// may run it meanwhile. It needs no library multiply or divide, those keep their
+// parameters in static memory as well. Interrupts read TB_ms directly.
+#pragma save
+#pragma nooverlay
+uint16_t TB_microsIsr(void) {
+  uint8_t  h, l;
+  uint16_t us, t;
+  #ifdef TB_US_DIV3
+  uint16_t q;
+  #endif
+  do {
+    h = TH2;
+    l = TL2;
+  } while(h != TH2);                                    // TL2 overflow while reading
+  us = TB_us;
+  if(TF2 && (h < (uint8_t)((TB_RELOAD + TB_TICKS_MS / 2) >> 8)))
+    us += 1000;                                         // overflow not served yet
+  t = ((((uint16_t)h << 8) | l) - TB_RELOAD) >> TB_US_SHIFT;
+  #ifdef TB_US_DIV3
+  q  = (t >> 2) + (t >> 4);                             // t / 3 with shifts and adds
+  q += q >> 4;                                          // (Hacker's Delight), exact
+  q += q >> 8;                                          // for all 16-bit t
+  t -= q + (q << 1);                                    // remainder, 0..19
+  t  = q + ((t + 5 + (t << 2)) >> 4);
+  #endif
+  return us + t;
+}
+#pragma restore
+
+// The main loop versions block the interrupts while reading, their variables
+// are overlaid with the rest of the main loop, which no interrupt touches.
+uint16_t TB_micros(void) {
+  uint16_t us;
+  __bit ea = EA;
+  EA = 0;
+  us = TB_microsIsr();
+  EA = ea;
+  return us;
+}
+
+uint16_t TB_millis(void) {
+  uint16_t ms;
+  __bit ea = EA;
+  EA = 0;
+  ms = TB_ms;
+  EA = ea;
+  return ms;
+}
+
+// ===================================================================================
+// Wait for Millisecond Ticks
+// ===================================================================================
+// The overflows are served here, so TB_ms keeps counting even if this is called
+// from an interrupt that blocks TB_interrupt(). The first tick may be partial,
+// wait one more for a minimum delay. Timer2 must be running (TB_init()).
+#pragma save
+#pragma nooverlay
+void TB_waitMs(uint8_t n) {
+  __bit ea = EA;
+  EA = 0;
+  while(n) {
+    while(!TF2);
+    TF2 = 0;
+    TB_ms++;
+    TB_us += 1000;
+    n--;
+  }
+  EA = ea;
+}
+
+// ===================================================================================
+// Timer2 Interrupt Service Routine
+// ===================================================================================
+void TB_interrupt(void) {
+  TF2 = 0;                                              // clear interrupt flag
+  TB_ms++;
+  TB_us += 1000;
+}
+#pragma restore
+
+// ===================================================================================
+// Software Timers
+// ===================================================================================
+void TB_start(uint8_t t, uint16_t ms, uint16_t period, TB_CALLBACK cb) {
+  __xdata TB_TIMER* tmr = &TB_timer[t];
+  tmr->due      = TB_after(ms);
+  tmr->period   = period;
+  tmr->callback = cb;
+}
+
+// Timers are only checked once per millisecond. A one-shot timer is stopped
+// before its callback runs, so the callback can restart it.
+void TB_poll(void) {
+  __xdata TB_TIMER* tmr;
+  TB_CALLBACK cb;
+  uint16_t now = TB_millis();
+  uint8_t  i;
+
+  if(now == TB_pollLast) return;
+  TB_pollLast = now;
+  for(i=0, tmr=TB_timer; i<TB_TIMERS; i++, tmr++) {
+    while((cb = tmr->callback) && ((int16_t)(now - tmr->due) >= 0)) {
+      if(tmr->period) tmr->due += tmr->period;
+      else tmr->callback = 0;
+      cb();
+    }
+  }
+}
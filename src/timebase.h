@@ -0,0 +1,82 @@
+// ===================================================================================
+// Timer2 Timebase for CH551, CH552 and CH554                                 * v1.1 *
+// ===================================================================================
+//
+// Timer2 runs from Fsys in 16-bit auto-reload mode and overflows every
+// millisecond. Together with the millisecond counter this gives a free-running
+// microsecond timestamp, read with TB_micros() from the main loop and with
+// TB_microsIsr() from interrupts. Interrupts read the milliseconds from TB_ms.
+// On top of that there are deadline helpers and a small table of software
+// timers whose callbacks run from TB_poll() in the main loop, so nothing has to
+// wait in a blocking delay.
+//
+// Functions available:
+// --------------------
+// TB_init()                setup and start timer2
+// TB_micros()              free-running 16-bit microsecond timestamp (main loop)
+// TB_microsIsr()           the same for interrupts and code running with EA = 0
+// TB_millis()              free-running 16-bit millisecond counter (main loop)
+// TB_waitMs(n)             wait for n timer2 overflows, also with interrupts blocked
+//
+// TB_after(ms)             deadline ms milliseconds from now
+// TB_expired(deadline)     check if a millisecond deadline has passed
+// TB_afterUs(us)           deadline us microseconds from now
+// TB_expiredUs(deadline)   check if a microsecond deadline has passed
+// TB_elapsed(start, ms)    check if ms milliseconds passed since timestamp start
+//
+// TB_start(t, ms, period, cb) call cb in ms milliseconds, then every period ms
+//                          (period 0: once), restarts a running timer
+// TB_stop(t)               stop timer t
+// TB_running(t)            check if timer t is running
+// TB_poll()                run callbacks of expired timers, call from main loop
+//
+// 16-bit timestamps wrap after 65ms (us) or 65s (ms), so only use differences
+// of timestamps, e.g. (uint16_t)(TB_micros() - start). Deadlines must be less
+// than half of that ahead. The current millisecond is already partly over, add
+// one for a minimum delay. A periodic timer that fell behind catches up by
+// running its callback once per missed period. Callbacks may start and stop
+// timers. The timers are numbered below, one per user.
+//
+// The timer2 interrupt must be routed to TB_interrupt() in the main file.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+
+// Software timers
+#define TB_TMR_GESTURE    0             // gesture frames
+#define TB_TMR_VENDOR     1             // bootloader entry sequence
+#define TB_TMR_LED        2             // status LED
+#define TB_TMR_MACRO      3             // macro program steps
+#define TB_TMR_ANIM       4             // pixel animation frames
+#define TB_TMR_SUPER      5             // USB re-attach (supervisor)
+#define TB_TIMERS         6             // number of software timers
+
+typedef void (*TB_CALLBACK)(void);
+
+typedef struct _TB_TIMER {
+  TB_CALLBACK callback;                 // 0: timer stopped
+  uint16_t    due;                      // millisecond deadline
+  uint16_t    period;                   // reload in ms, 0: one-shot
+} TB_TIMER;
+
+extern volatile uint16_t TB_ms;         // millisecond counter
+extern __xdata TB_TIMER TB_timer[TB_TIMERS];
+
+#define TB_after(ms)        ((uint16_t)(TB_millis() + (ms)))
+#define TB_expired(d)       ((int16_t)(TB_millis() - (d)) >= 0)
+#define TB_afterUs(us)      ((uint16_t)(TB_micros() + (us)))
+#define TB_expiredUs(d)     ((int16_t)(TB_micros() - (d)) >= 0)
+#define TB_elapsed(s, ms)   ((uint16_t)(TB_millis() - (s)) >= (uint16_t)(ms))
+
+#define TB_stop(t)          (TB_timer[t].callback = 0)
+#define TB_running(t)       (TB_timer[t].callback != 0)
+
+void TB_init(void);                     // setup and start timer2
+uint16_t TB_micros(void);               // microsecond timestamp
+uint16_t TB_microsIsr(void);            // microsecond timestamp, interrupts or EA = 0
+uint16_t TB_millis(void);               // millisecond counter
+void TB_waitMs(uint8_t n);              // wait for n millisecond ticks
+void TB_start(uint8_t t, uint16_t ms, uint16_t period, TB_CALLBACK cb); // start timer
+void TB_poll(void);                     // run expired timers
+void TB_interrupt(void);                // timer2 interrupt service routine
@@ -0,0 +1,115 @@
+// ===================================================================================
+// Capacitive Touch Key Driver for CH551, CH552 and CH554                     * v1.0 *
+// ===================================================================================
+
+#include "touchkey.h"
+
+#ifdef TOUCH_ENABLE
+#include "scan.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define TK_DATA_MASK      0x3FFF                        // 14-bit count
+#define TK_DRIFT_SAMPLES  (TOUCH_DRIFT_MS / TOUCH_KEYS) // one sample per ms and channel
+
+#if TOUCH_KEYS < 1 || TOUCH_KEYS > 4
+  #error TOUCH_KEYS must be 1..4!
+#endif
+#if TOUCH_TH_LOW >= TOUCH_TH_HIGH
+  #error TOUCH_TH_LOW must be below TOUCH_TH_HIGH!
+#endif
+#if TOUCH_DEBOUNCE < 1 || TOUCH_DEBOUNCE > 255
+  #error TOUCH_DEBOUNCE must be 1..255!
+#endif
+#if TK_DRIFT_SAMPLES < 1 || TK_DRIFT_SAMPLES > 255
+  #error TOUCH_DRIFT_MS out of range for TOUCH_KEYS!
+#endif
+
+__code uint8_t   TK_channel[TOUCH_KEYS] = {TOUCH_CHANNELS};  // TIN of every key
+__code uint8_t   TK_key[TOUCH_KEYS]     = {TOUCH_SCAN_KEYS}; // scan key of every key
+__code uint8_t   TK_pinBit[6] = {0x01, 0x02, 0x10, 0x20, 0x40, 0x80}; // TIN0..5 on P1
+
+__xdata uint16_t TK_value[TOUCH_KEYS];                  // last counts
+__xdata uint16_t TK_baseline[TOUCH_KEYS];               // untouched counts
+__xdata uint16_t TK_initial[TOUCH_KEYS];                // counts at power-on
+__xdata uint8_t  TK_count[TOUCH_KEYS];                  // debounce counters
+__xdata uint8_t  TK_drift[TOUCH_KEYS];                  // baseline tracking counters
+__xdata uint8_t  TK_ready;                              // keys with a first sample
+__xdata uint8_t  TK_index;                              // key being sampled
+
+// ===================================================================================
+// Setup TouchKey and Start Sampling
+// ===================================================================================
+void TK_init(void) {
+  uint8_t i;
+  SCAN_MASK mask = 0;
+  for(i=0; i<TOUCH_KEYS; i++) {
+    P1_DIR_PU &= ~TK_pinBit[TK_channel[i]];             // high impedance input
+    P1_MOD_OC &= ~TK_pinBit[TK_channel[i]];
+    TK_count[i] = 0;
+    TK_drift[i] = 0;
+    mask |= (SCAN_MASK)1 << TK_key[i];
+  }
+  TK_ready  = 0;
+  TK_index  = 0;
+  SCAN_ext |= mask;                                     // stop sampling these pins
+  TKEY_CTRL = TK_channel[0] + 1;                        // 1ms cycle, start channel
+  IE_TKEY   = 1;                                        // enable touch-key interrupt
+}
+
+// ===================================================================================
+// Touch-Key Interrupt Service Routine
+// ===================================================================================
+// The count of the finished cycle is read before the next channel is selected,
+// which also clears the interrupt flag. Counts right after a channel change are
+// marked invalid and skipped.
+#pragma save
+#pragma nooverlay
+void TK_interrupt(void) {
+  uint16_t raw, comp;
+  uint8_t  i, mask, pressed, valid;
+
+  i     = TK_index;
+  valid = !(TKEY_DATH & bTKD_CHG);
+  raw   = TKEY_DAT & TK_DATA_MASK;
+  if(++TK_index >= TOUCH_KEYS) TK_index = 0;
+  TKEY_CTRL = TK_channel[TK_index] + 1;                 // start next channel
+  if(!valid) return;
+
+  mask = 1 << i;
+  TK_value[i] = raw;
+  if(!(TK_ready & mask)) {                              // first sample after power-on
+    TK_ready      |= mask;
+    TK_baseline[i] = raw;
+    TK_initial[i]  = raw;
+  }
+
+  // Remove the drift since power-on, keys pressed by self-test count as touched
+  comp = raw + TK_initial[i] - TK_baseline[i];
+  if(SCAN_forced & ((SCAN_MASK)1 << TK_key[i])) comp = 0;
+  pressed = SCAN_isPressed(TK_key[i]) ? 1 : 0;
+
+  // Hysteresis and debounce
+  if(pressed ? (comp > TOUCH_TH_HIGH) : (comp < TOUCH_TH_LOW)) {
+    if(++TK_count[i] >= TOUCH_DEBOUNCE) {
+      if(SCAN_post(TK_key[i], !pressed)) TK_count[i] = 0;
+      else TK_count[i] = TOUCH_DEBOUNCE - 1;            // queue full, retry
+    }
+    return;
+  }
+  TK_count[i] = 0;
+
+  // Track the baseline while untouched
+  if(pressed || comp <= TOUCH_TH_HIGH) {
+    TK_drift[i] = 0;
+    return;
+  }
+  if(++TK_drift[i] < (uint8_t)TK_DRIFT_SAMPLES) return;
+  TK_drift[i] = 0;
+  if(raw > TK_baseline[i])      TK_baseline[i]++;
+  else if(raw < TK_baseline[i]) TK_baseline[i]--;
+}
+#pragma restore
+
+#endif // TOUCH_ENABLE
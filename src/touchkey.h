@@ -0,0 +1,51 @@
+// ===================================================================================
+// Capacitive Touch Key Driver for CH551, CH552 and CH554                     * v1.0 *
+// ===================================================================================
+//
+// Samples the TouchKey channels round robin from the touch-key interrupt, one
+// channel per 1ms touch-key timer cycle. A finger on the pad lowers the count.
+// Every channel replaces one of the scan keys: its edges are posted into the
+// scan event queue and its state shows up in SCAN_state, so the main loop cannot
+// tell a touch pad from a mechanical key. The pin of that key is no longer
+// sampled by the scan engine.
+//
+// A key is pressed when the count drops below TOUCH_TH_LOW and released when it
+// rises above TOUCH_TH_HIGH, each for TOUCH_DEBOUNCE samples in a row. The
+// thresholds apply to the count at power-on. While a key is released and
+// untouched, a baseline follows the count by at most one per TOUCH_DRIFT_MS, and
+// the thresholds are shifted by the drift of the baseline since power-on
+// (temperature, humidity).
+//
+// Functions available:
+// --------------------
+// TK_init()                setup the TouchKey peripheral and start sampling
+// TK_value[key]            last count of a touch key
+// TK_baseline[key]         current baseline of a touch key
+//
+// The following must be defined in config.h:
+// TOUCH_ENABLE             - (optional) enable the driver, empty macros otherwise
+// TOUCH_KEYS               - number of touch keys (1..4)
+// TOUCH_CHANNELS           - TouchKey channels (0..5 for TIN0..TIN5), comma separated
+// TOUCH_SCAN_KEYS          - scan keys replaced by the touch keys, comma separated
+// TOUCH_TH_LOW             - pressed threshold
+// TOUCH_TH_HIGH            - released threshold
+// TOUCH_DEBOUNCE           - samples beyond a threshold before an edge is accepted
+// TOUCH_DRIFT_MS           - baseline tracking period in ms
+//
+// Call TK_init() after SCAN_init(). The touch-key interrupt must be routed to
+// TK_interrupt() in the main file and must have the same priority as timer0.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+#ifdef TOUCH_ENABLE
+extern __xdata uint16_t TK_value[TOUCH_KEYS];     // last counts
+extern __xdata uint16_t TK_baseline[TOUCH_KEYS];  // untouched counts
+
+void TK_init(void);                     // setup TouchKey and start sampling
+void TK_interrupt(void);                // touch-key interrupt service routine
+#else
+#define TK_init()
+#endif
@@ -0,0 +1,109 @@
+// ===================================================================================
+// Touch Map for CH551, CH552 and CH554                                       * v1.1 *
+// ===================================================================================
+
+#include "touchmap.h"
+#include "flash.h"
+#include "gesture.h"
+#include "screen.h"
+#include "usb_multitouch.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#define MAP_SIZE        sizeof(MAP_data)
+#define MAP_SIZE_V1     sizeof(MAP_table)
+#define MAP_IDLE        0               // nothing to do
+#define MAP_PENDING     1               // MAP_staging holds a new map
+#define MAP_DEFAULT     2               // restore the default map
+#define MAP_WRITING     3               // writing MAP_data to data flash
+
+#if MAP_KEYS * 6 + MAP_GESTURES * 7 + 2 > 128
+  #error Touch map does not fit into data flash!
+#endif
+
+__code MAP_DATA MAP_default = {{MAP_DEFAULTS}, {MAP_GESTURE_DEFAULTS}};
+
+__xdata MAP_DATA  MAP_data;                     // active map
+__xdata MAP_DATA  MAP_staging;                  // staging buffer for a new map
+volatile uint8_t  MAP_state;                    // update state
+__xdata uint8_t   MAP_writePos;                 // next step of the flash write
+__xdata uint8_t   MAP_writeSum;                 // sum of the bytes written so far
+
+// ===================================================================================
+// Load Map from Data Flash
+// ===================================================================================
+void MAP_load(void) {
+  __xdata uint8_t* dst = (__xdata uint8_t*)&MAP_data;
+  __code  uint8_t* src = (__code uint8_t*)&MAP_default;
+  uint8_t i, len, sum = 0;
+
+  MAP_state = MAP_IDLE;
+  for(i=MAP_SIZE; i; i--) *dst++ = *src++;        // start with defaults
+  i = FLASH_read(0);
+  if(i == MAP_MAGIC) len = MAP_SIZE;
+  else if(i == MAP_MAGIC_V1) len = MAP_SIZE_V1;   // keys only, default gestures
+  else return;
+  for(i=1; i<=len; i++) sum += FLASH_read(i);
+  if(sum != FLASH_read(len + 1)) return;          // invalid, keep defaults
+  dst = (__xdata uint8_t*)&MAP_data;
+  for(i=1; i<=len; i++) *dst++ = FLASH_read(i);   // valid map found
+}
+
+// ===================================================================================
+// Request Map Update (called from the USB interrupt)
+// ===================================================================================
+uint8_t MAP_request(uint8_t defaults) {
+  if(MAP_state) return 0;                         // previous update still running
+  MAP_state = defaults ? MAP_DEFAULT : MAP_PENDING;
+  return 1;
+}
+
+// ===================================================================================
+// Apply Pending Update and Write it to Data Flash
+// ===================================================================================
+// Only one data flash byte is written per call, so the CPU is never stalled
+// for more than a single byte programming time.
+void MAP_poll(void) {
+  uint8_t i, data;
+
+  switch(MAP_state) {
+    case MAP_IDLE:
+      return;
+
+    case MAP_PENDING:
+    case MAP_DEFAULT:
+      if(MAP_state == MAP_PENDING) {
+        __xdata uint8_t* src = (__xdata uint8_t*)&MAP_staging;
+        __xdata uint8_t* dst = (__xdata uint8_t*)&MAP_data;
+        for(i=MAP_SIZE; i; i--) *dst++ = *src++;
+      }
+      else {
+        __code  uint8_t* src = (__code uint8_t*)&MAP_default;
+        __xdata uint8_t* dst = (__xdata uint8_t*)&MAP_data;
+        for(i=MAP_SIZE; i; i--) *dst++ = *src++;
+      }
+      MT_forget();                                // contact IDs may have changed
+      GES_dirty = 1;                              // send the new contacts now
+      FLASH_write(0, 0x00);                       // invalidate stored map
+      MAP_writePos = 1;
+      MAP_writeSum = 0;
+      MAP_state    = MAP_WRITING;
+      return;
+
+    case MAP_WRITING:
+      if(MAP_writePos <= MAP_SIZE) {
+        data = ((__xdata uint8_t*)&MAP_data)[MAP_writePos - 1];
+        MAP_writeSum += data;
+        FLASH_write(MAP_writePos++, data);
+      }
+      else if(MAP_writePos == MAP_SIZE + 1) {
+        FLASH_write(MAP_writePos++, MAP_writeSum);
+      }
+      else {
+        FLASH_write(0, MAP_MAGIC);                // map is valid now
+        MAP_state = MAP_IDLE;
+      }
+      return;
+  }
+}
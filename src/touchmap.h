@@ -0,0 +1,79 @@
+// ===================================================================================
+// Touch Map for CH551, CH552 and CH554                                       * v1.1 *
+// ===================================================================================
+//
+// Maps every key to a touch contact (contact ID, pressure, X/Y in
+// 0..MT_LOGICAL_MAX) and a gesture (see gesture.h). Two more gestures are
+// bound to the encoder (clockwise, counter-clockwise). The map is kept in data
+// flash and loaded into XRAM at boot. A new map can be handed over from the USB
+// interrupt (vendor request), MAP_poll() then applies it and writes it to data
+// flash one byte per call.
+//
+// Functions available:
+// --------------------
+// MAP_load()               load map from data flash (defaults if it is invalid)
+// MAP_poll()               apply a pending update, write it to data flash
+// MAP_busy()               check if an update is pending or being written
+// MAP_request(defaults)    flag MAP_staging (or the defaults) as new map
+//
+// Data flash layout:
+// ------------------
+// 0                        MAP_MAGIC (written last, so a torn update is ignored)
+// 1 .. sizeof(MAP_data)    the key entries, then the gesture entries
+// sizeof(MAP_data) + 1     8-bit sum of the entries
+// A map stored by v1.0 (MAP_MAGIC_V1, key entries only) is still loaded, the
+// gestures then fall back to the defaults.
+//
+// The following must be defined in config.h:
+// MAP_KEYS                 - number of key entries
+// MAP_DEFAULTS             - initializer for the default key entries
+// MAP_GESTURE_DEFAULTS     - initializer for the default gestures (MAP_GESTURES)
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+#define MAP_MAGIC       0x47            // 'G': keys and gestures
+#define MAP_MAGIC_V1    0x4D            // 'M': keys only
+
+#define GES_TAP         0               // gesture types, see gesture.h
+#define GES_HOLD        1
+#define GES_SWIPE       2
+#define GES_FLICK       3
+
+#define MAP_GESTURES    (MAP_KEYS + 2)  // one per key, two for the encoder
+#define MAP_GES_CW      MAP_KEYS        // gesture for a clockwise encoder detent
+#define MAP_GES_CCW     (MAP_KEYS + 1)  // gesture for a counter-clockwise detent
+
+typedef struct _MAP_ENTRY {
+  uint8_t  id;                          // contact identifier
+  uint8_t  pressure;                    // pressure while touching (0..127)
+  uint16_t x;                           // x coordinate (0..MT_LOGICAL_MAX)
+  uint16_t y;                           // y coordinate (0..MT_LOGICAL_MAX)
+} MAP_ENTRY;
+
+typedef struct _MAP_GESTURE {
+  uint8_t  type;                        // GES_TAP, GES_HOLD, GES_SWIPE, GES_FLICK
+  uint16_t frames;                      // duration in USB frames (poll intervals)
+  int16_t  dx;                          // x distance of swipe/flick
+  int16_t  dy;                          // y distance of swipe/flick
+} MAP_GESTURE;
+
+typedef struct _MAP_DATA {
+  MAP_ENTRY   key[MAP_KEYS];            // contact of every key
+  MAP_GESTURE gesture[MAP_GESTURES];    // gesture of every key and the encoder
+} MAP_DATA;
+
+extern __xdata MAP_DATA  MAP_data;              // active map
+extern __xdata MAP_DATA  MAP_staging;           // staging buffer for a new map
+extern volatile uint8_t  MAP_state;             // update state machine
+
+#define MAP_table       MAP_data.key            // active key entries
+#define MAP_gesture     MAP_data.gesture        // active gestures
+
+#define MAP_busy()      (MAP_state)
+
+void MAP_load(void);                    // load map from data flash
+void MAP_poll(void);                    // apply pending update
+uint8_t MAP_request(uint8_t defaults);  // new map in MAP_staging (1: use defaults)
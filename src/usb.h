@@ -55,6 +55,13 @@
 #define HID_SET_PROTOCOL        0x0B
 #endif
 
+// USB HID report types (wValueH of GET_REPORT/SET_REPORT)
+#ifndef HID_REPORT_INPUT
+#define HID_REPORT_INPUT        0x01
+#define HID_REPORT_OUTPUT       0x02
+#define HID_REPORT_FEATURE      0x03
+#endif
+
 // Bit define for USB request type
 #ifndef USB_REQ_TYP_MASK
 #define USB_REQ_TYP_IN          0x80  // control IN, device to host
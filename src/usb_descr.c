@@ -3,6 +3,7 @@
 // ===================================================================================
 
 #include "usb_descr.h"
+#include "usb_hid_items.h"
 
 // ===================================================================================
 // Device Descriptor
@@ -24,6 +25,196 @@ __code USB_DEV_DESCR DevDescr = {
     .bNumConfigurations = 1          // number of possible configurations
 };
 
+// ===================================================================================
+// HID Report Descriptor: Touch Screen
+// ===================================================================================
+// One finger collection: contact identifier, tip switch and in range, optional
+// pressure, absolute X/Y coordinates of 16 bit each (0..MT_LOGICAL_MAX) and
+// optional contact width/height. The layout matches MT_CONTACT, in parallel
+// mode the collection is repeated for every contact of the report.
+#ifdef MT_PRESSURE
+#define MT_FINGER_PRESSURE                                                     \
+    HID_USAGE(0x30)                   /* Pressure                           */ \
+    HID_LOGICAL_MAX(0x7F)                                                      \
+    HID_REPORT_SIZE(8)                                                         \
+    HID_REPORT_COUNT(1)                                                        \
+    HID_INPUT(HID_DATA_VAR_ABS)
+#else
+#define MT_FINGER_PRESSURE
+#endif
+
+#ifdef MT_WIDTH_HEIGHT
+#define MT_FINGER_WIDTH_HEIGHT                                                 \
+    HID_USAGE_PAGE(HID_PAGE_DIGITIZER)                                         \
+    HID_USAGE(0x48)                   /* Width                              */ \
+    HID_USAGE(0x49)                   /* Height                             */ \
+    HID_REPORT_SIZE(16)                                                        \
+    HID_REPORT_COUNT(2)                                                        \
+    HID_INPUT(HID_DATA_VAR_ABS)
+#else
+#define MT_FINGER_WIDTH_HEIGHT
+#endif
+
+#define MT_FINGER_COLLECTION()                                                 \
+    HID_USAGE_PAGE(HID_PAGE_DIGITIZER)                                         \
+    HID_USAGE(0x22)                   /* Finger                             */ \
+    HID_COLLECTION(HID_LOGICAL)                                                \
+    HID_USAGE(0x51)                   /*   Contact Identifier               */ \
+    HID_LOGICAL_MIN(0)                                                         \
+    HID_LOGICAL_MAX(0x7F)                                                      \
+    HID_REPORT_SIZE(8)                                                         \
+    HID_REPORT_COUNT(1)                                                        \
+    HID_INPUT(HID_DATA_VAR_ABS)                                                \
+    HID_USAGE(0x42)                   /*   Tip Switch                       */ \
+    HID_USAGE(0x32)                   /*   In Range                         */ \
+    HID_LOGICAL_MAX(1)                                                         \
+    HID_REPORT_SIZE(1)                                                         \
+    HID_REPORT_COUNT(2)                                                        \
+    HID_INPUT(HID_DATA_VAR_ABS)                                                \
+    HID_REPORT_COUNT(6)               /*   padding bits                     */ \
+    HID_INPUT(HID_CNST_VAR_ABS)                                                \
+    MT_FINGER_PRESSURE                /*   Pressure (optional)              */ \
+    HID_USAGE_PAGE(HID_PAGE_DESKTOP)                                           \
+    HID_USAGE(0x30)                   /*   X                                */ \
+    HID_USAGE(0x31)                   /*   Y                                */ \
+    HID_LOGICAL_MAX16(MT_LOGICAL_MAX)                                          \
+    HID_PHYSICAL_MIN16(0)                                                      \
+    HID_PHYSICAL_MAX16(MT_LOGICAL_MAX)                                         \
+    HID_UNIT16(0)                     /*   no unit                          */ \
+    HID_REPORT_SIZE(16)                                                        \
+    HID_REPORT_COUNT(2)                                                        \
+    HID_INPUT(HID_DATA_VAR_ABS)                                                \
+    MT_FINGER_WIDTH_HEIGHT            /*   Width, Height (optional)         */ \
+    HID_END_COLLECTION
+
+__code uint8_t ReportDescr[] = {
+    HID_USAGE_PAGE(HID_PAGE_DIGITIZER)
+    HID_USAGE(0x04)                     // Touch Screen
+    HID_COLLECTION(HID_APPLICATION)
+    HID_REPORT_ID(REPORT_ID_TOUCH)
+
+    // actual amount of fingers that are concurrently touching the screen
+    HID_USAGE(0x54)                     //   Contact Count
+    HID_LOGICAL_MAX(0x7F)
+    HID_REPORT_SIZE(8)
+    HID_REPORT_COUNT(1)
+    HID_INPUT(HID_DATA_VAR_ABS)
+
+    // the finger collections (MT_REPORT_CONTACTS in each report)
+    HID_REPEAT(MT_REPORT_CONTACTS, MT_FINGER_COLLECTION)
+
+    // maximum amount of fingers that the device supports
+    HID_REPORT_ID(REPORT_ID_MAX_COUNT)
+    HID_USAGE_PAGE(HID_PAGE_DIGITIZER)
+    HID_USAGE(0x55)                     //   Contact Count Maximum
+    HID_LOGICAL_MAX(0x7F)
+    HID_REPORT_SIZE(8)
+    HID_REPORT_COUNT(1)
+    HID_FEATURE(HID_DATA_VAR_ABS)
+
+    // Windows device certification status (THQA blob, 256 bytes)
+    HID_USAGE_PAGE16(HID_PAGE_VENDOR)
+    HID_REPORT_ID(REPORT_ID_THQA)
+    HID_USAGE(0xC5)                     //   Vendor Usage 0xC5
+    HID_LOGICAL_MIN(0)
+    HID_LOGICAL_MAX16(0xFF)
+    HID_REPORT_SIZE(8)
+    HID_REPORT_COUNT16(256)
+    HID_FEATURE(HID_DATA_VAR_ABS)
+
+    #ifdef RELAY_ENABLE
+    // contact frames from the host (relay mode, see src/usb_relay.h)
+    HID_REPORT_ID(REPORT_ID_RELAY)
+    HID_USAGE(0xC6)                     //   Vendor Usage 0xC6
+    HID_REPORT_COUNT(RLY_REPORT_SIZE - 1)
+    HID_OUTPUT(HID_DATA_VAR_ABS)
+    #endif
+
+    HID_END_COLLECTION
+};
+
+__code uint16_t ReportDescrLen = sizeof(ReportDescr);
+
+// ===================================================================================
+// HID Report Descriptor: Boot Keyboard
+// ===================================================================================
+// Standard boot keyboard report without report ID: modifier byte, reserved byte
+// and 6 key codes. The LED output report is received via SET_REPORT on EP0.
+__code uint8_t KbdReportDescr[] = {
+    HID_USAGE_PAGE(HID_PAGE_DESKTOP)
+    HID_USAGE(0x06)                     // Keyboard
+    HID_COLLECTION(HID_APPLICATION)
+    HID_USAGE_PAGE(HID_PAGE_KEYBOARD)   //   modifier keys
+    HID_USAGE_MIN(0xE0)                 //   Left Control
+    HID_USAGE_MAX(0xE7)                 //   Right GUI
+    HID_LOGICAL_MIN(0)
+    HID_LOGICAL_MAX(1)
+    HID_REPORT_SIZE(1)
+    HID_REPORT_COUNT(8)
+    HID_INPUT(HID_DATA_VAR_ABS)
+    HID_REPORT_SIZE(8)                  //   reserved byte
+    HID_REPORT_COUNT(1)
+    HID_INPUT(HID_CNST_VAR_ABS)
+    HID_USAGE_PAGE(HID_PAGE_LED)        //   LED output report
+    HID_USAGE_MIN(0x01)                 //   Num Lock
+    HID_USAGE_MAX(0x05)                 //   Kana
+    HID_REPORT_SIZE(1)
+    HID_REPORT_COUNT(5)
+    HID_OUTPUT(HID_DATA_VAR_ABS)
+    HID_REPORT_SIZE(3)                  //   padding bits
+    HID_REPORT_COUNT(1)
+    HID_OUTPUT(HID_CNST_VAR_ABS)
+    HID_USAGE_PAGE(HID_PAGE_KEYBOARD)   //   6 key codes
+    HID_USAGE_MIN(0x00)
+    HID_USAGE_MAX(0x65)                 //   Keyboard Application
+    HID_LOGICAL_MAX(0x65)
+    HID_REPORT_SIZE(8)
+    HID_REPORT_COUNT(6)
+    HID_INPUT(HID_DATA_ARY_ABS)
+    HID_END_COLLECTION
+};
+
+__code uint16_t KbdReportDescrLen = sizeof(KbdReportDescr);
+
+// ===================================================================================
+// HID Report Descriptor: Consumer Control and Mouse Wheel
+// ===================================================================================
+__code uint8_t ConsReportDescr[] = {
+    // consumer control, one usage at a time (0: released)
+    HID_USAGE_PAGE(HID_PAGE_CONSUMER)
+    HID_USAGE(0x01)                     // Consumer Control
+    HID_COLLECTION(HID_APPLICATION)
+    HID_REPORT_ID(REPORT_ID_CONSUMER)
+    HID_LOGICAL_MIN(0)
+    HID_LOGICAL_MAX16(0x3FF)
+    HID_USAGE_MIN(0)
+    HID_USAGE_MAX16(0x3FF)
+    HID_REPORT_SIZE(16)
+    HID_REPORT_COUNT(1)
+    HID_INPUT(HID_DATA_ARY_ABS)
+    HID_END_COLLECTION
+
+    // mouse wheel driven by the rotary encoder (X and Y are always 0)
+    HID_USAGE_PAGE(HID_PAGE_DESKTOP)
+    HID_USAGE(0x02)                     // Mouse
+    HID_COLLECTION(HID_APPLICATION)
+    HID_REPORT_ID(REPORT_ID_WHEEL)
+    HID_USAGE(0x01)                     //   Pointer
+    HID_COLLECTION(HID_PHYSICAL)
+    HID_USAGE(0x30)                     //     X
+    HID_USAGE(0x31)                     //     Y
+    HID_USAGE(0x38)                     //     Wheel
+    HID_LOGICAL_MIN(-127)
+    HID_LOGICAL_MAX(127)
+    HID_REPORT_SIZE(8)
+    HID_REPORT_COUNT(3)
+    HID_INPUT(HID_DATA_VAR_REL)
+    HID_END_COLLECTION
+    HID_END_COLLECTION
+};
+
+__code uint16_t ConsReportDescrLen = sizeof(ConsReportDescr);
+
 // ===================================================================================
 // Configuration Descriptor
 // ===================================================================================
@@ -36,26 +227,30 @@ __code USB_CFG_DESCR_HID CfgDescr = {
             .bDescriptorType =
                 USB_DESCR_TYP_CONFIG,         // configuration descriptor: 0x02
             .wTotalLength = sizeof(CfgDescr), // total length in bytes
-            .bNumInterfaces = 1,              // number of interfaces: 1
+            .bNumInterfaces = HID_ITFS,       // number of interfaces: 3
             .bConfigurationValue = 1, // value to select this configuration
             .iConfiguration = 0,      // no configuration string descriptor
+#ifdef USB_REMOTE_WAKEUP
+            .bmAttributes = 0xA0,     // attributes = bus powered, remote wakeup
+#else
             .bmAttributes = 0x80,     // attributes = bus powered, no wakeup
+#endif
             .MaxPower = USB_MAX_POWER_mA / 2 // in 2mA units
         },
 
-    // Interface Descriptor
+    // Interface Descriptor: Touch Screen
     .interface0 =
         {
             .bLength =
                 sizeof(USB_ITF_DESCR), // size of the descriptor in bytes: 9
             .bDescriptorType =
                 USB_DESCR_TYP_INTERF, // interface descriptor: 0x04
-            .bInterfaceNumber = 0,    // number of this interface: 0
+            .bInterfaceNumber = HID_ITF_TOUCH, // number of this interface: 0
             .bAlternateSetting = 0, // value used to select alternative setting
             .bNumEndpoints = 2,     // number of endpoints used: 2
             .bInterfaceClass = USB_DEV_CLASS_HID, // interface class: HID (0x03)
-            .bInterfaceSubClass = 1,              // boot interface
-            .bInterfaceProtocol = 1,              // keyboard
+            .bInterfaceSubClass = 0,              // no boot interface
+            .bInterfaceProtocol = 0,              // none
             .iInterface = 4                       // interface string descriptor
         },
 
@@ -83,8 +278,8 @@ __code USB_CFG_DESCR_HID CfgDescr = {
                 USB_ENDP_ADDR_EP1_IN, // endpoint: 1, direction: IN (0x81)
             .bmAttributes =
                 USB_ENDP_TYPE_INTER,    // transfer type: interrupt (0x03)
-            .wMaxPacketSize = EP1_SIZE, // max packet size
-            .bInterval = 10             // polling intervall in ms
+            .wMaxPacketSize = EP1_SIZE,     // max packet size
+            .bInterval = USB_POLL_INTERVAL  // polling intervall in ms
         },
 
     // Endpoint Descriptor: Endpoint 2 (OUT, Interrupt)
@@ -95,102 +290,124 @@ __code USB_CFG_DESCR_HID CfgDescr = {
             USB_ENDP_ADDR_EP2_OUT, // endpoint: 2, direction: OUT (0x02)
         .bmAttributes = USB_ENDP_TYPE_INTER, // transfer type: interrupt (0x03)
         .wMaxPacketSize = EP2_SIZE,          // max packet size
-        .bInterval = 10                      // polling intervall in ms
-    }};
+        .bInterval = USB_POLL_INTERVAL       // polling intervall in ms
+    },
 
-// ===================================================================================
-// HID Report Descriptor
-// ===================================================================================
-__code uint8_t ReportDescr[] = {
-    0x05, 0x0D, // USAGE_PAGE(Digitizers)
-    0x09, 0x04, // USAGE     (Touch Screen)
-    0xA1, 0x01, // COLLECTION(Application)
-
-    // define the actual amount of fingers that are concurrently touching the
-    // screen
-    0x09, 0x54, //   USAGE (Contact count)
-    0x25, 0x7f, //   LOGICAL_MAXIMUM (128)
-    0x95, 0x01, //   REPORT_COUNT(1)
-    0x75, 0x08, //   REPORT_SIZE (8)
-    0x81, 0x02, //   INPUT (Data,Var,Abs)
-                // declare a finger collection
-    0x05, 0x0D, //   USAGE_PAGE(Digitizers)
-    0x09, 0x22, //   USAGE (Finger)
-    0xA1, 0x02, //   COLLECTION (Logical)
-
-    // declare an identifier for the finger
-    0x09, 0x51, //     USAGE (Contact Identifier)
-    0x25, 0x7f, //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08, //     REPORT_SIZE (8)
-    0x95, 0x01, //     REPORT_COUNT (1)
-    0x81, 0x02, //     INPUT (Data,Var,Abs)
-
-    // declare Tip Switch & In range
-    0x09, 0x42, //     USAGE (Tip Switch)
-    0x09, 0x32, //     USAGE (In Range)
-    0x15, 0x00, //     LOGICAL_MINIMUM (0)
-    0x25, 0x01, //     LOGICAL_MAXIMUM (1)
-    0x75, 0x01, //     REPORT_SIZE (1)
-    0x95, 0x02, //     REPORT_COUNT(2)
-    0x81, 0x02, //     INPUT (Data,Var,Abs)
-    // declare the 6 padding bits as constant so the driver will ignore them
-    0x95, 0x06, //     REPORT_COUNT (6)
-    0x81, 0x03, //     INPUT (Cnst,Ary,Abs)
-
-    // declare pressure
-    0x09, 0x30, //     USAGE (Pressure)
-    0x25, 0x7f, //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08, //     REPORT_SIZE (8)
-    0x95, 0x01, //     REPORT_COUNT (1)
-    0x81, 0x02, //     INPUT (Data,Var,Abs)
-
-    // define absolute X and Y coordinates of 16 bit each (percent values
-    // multiplied with 100)
-    0x05, 0x01,       //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,       //     Usage (X)
-    0x09, 0x31,       //     Usage (Y)
-    0x16, 0x00, 0x00, //     Logical Minimum (0)
-    0x26, 0x10, 0x27, //     Logical Maximum (10000)
-    0x36, 0x00, 0x00, //     Physical Minimum (0)
-    0x46, 0x10, 0x27, //     Physical Maximum (10000)
-    0x66, 0x00, 0x00, //     UNIT (None)
-    0x75, 0x10,       //     Report Size (16),
-    0x95, 0x02,       //     Report Count (2),
-    0x81, 0x02,       //     Input (Data,Var,Abs)
-    0xC0,             //   END_COLLECTION
-    // define the maximum amount of fingers that the device supports
-    0x05, 0x0D, //   USAGE_PAGE(Digitizers)
-    0x09, 0x55, //   USAGE (Contact Count Maximum)
-    0x25, 0x7f, //   LOGICAL_MAXIMUM (127)
-    0xB1, 0x02, //   FEATURE (Data,Var,Abs)
-
-    0xC0 // END_COLLECTION
-};
+    // Interface Descriptor: Boot Keyboard
+    .interface1 =
+        {
+            .bLength =
+                sizeof(USB_ITF_DESCR), // size of the descriptor in bytes: 9
+            .bDescriptorType =
+                USB_DESCR_TYP_INTERF, // interface descriptor: 0x04
+            .bInterfaceNumber = HID_ITF_KEYBOARD, // number of this interface: 1
+            .bAlternateSetting = 0, // value used to select alternative setting
+            .bNumEndpoints = 1,     // number of endpoints used: 1
+            .bInterfaceClass = USB_DEV_CLASS_HID, // interface class: HID (0x03)
+            .bInterfaceSubClass = 1,              // boot interface
+            .bInterfaceProtocol = 1,              // keyboard
+            .iInterface = 0                       // no interface string
+        },
+
+    // HID Descriptor: Boot Keyboard
+    .hid1 =
+        {
+            .bLength =
+                sizeof(USB_HID_DESCR), // size of the descriptor in bytes: 9
+            .bDescriptorType = USB_DESCR_TYP_HID, // HID descriptor: 0x21
+            .bcdHID = 0x0110,     // HID class spec version (BCD: 1.1)
+            .bCountryCode = 33,   // country code: US
+            .bNumDescriptors = 1, // number of report descriptors: 1
+            .bDescriptorTypeX =
+                USB_DESCR_TYP_REPORT, // descriptor type: report (0x22)
+            .wDescriptorLength = sizeof(KbdReportDescr) // report descriptor length
+        },
+
+    // Endpoint Descriptor: Endpoint 3 (IN, Interrupt)
+    .ep3IN =
+        {
+            .bLength =
+                sizeof(USB_ENDP_DESCR), // size of the descriptor in bytes: 7
+            .bDescriptorType = USB_DESCR_TYP_ENDP, // endpoint descriptor: 0x05
+            .bEndpointAddress =
+                USB_ENDP_ADDR_EP3_IN, // endpoint: 3, direction: IN (0x83)
+            .bmAttributes =
+                USB_ENDP_TYPE_INTER,    // transfer type: interrupt (0x03)
+            .wMaxPacketSize = EP3_SIZE,     // max packet size
+            .bInterval = USB_POLL_INTERVAL  // polling intervall in ms
+        },
+
+    // Interface Descriptor: Consumer Control and Mouse Wheel
+    .interface2 =
+        {
+            .bLength =
+                sizeof(USB_ITF_DESCR), // size of the descriptor in bytes: 9
+            .bDescriptorType =
+                USB_DESCR_TYP_INTERF, // interface descriptor: 0x04
+            .bInterfaceNumber = HID_ITF_CONSUMER, // number of this interface: 2
+            .bAlternateSetting = 0, // value used to select alternative setting
+            .bNumEndpoints = 1,     // number of endpoints used: 1
+            .bInterfaceClass = USB_DEV_CLASS_HID, // interface class: HID (0x03)
+            .bInterfaceSubClass = 0,              // no boot interface
+            .bInterfaceProtocol = 0,              // none
+            .iInterface = 0                       // no interface string
+        },
+
+    // HID Descriptor: Consumer Control and Mouse Wheel
+    .hid2 =
+        {
+            .bLength =
+                sizeof(USB_HID_DESCR), // size of the descriptor in bytes: 9
+            .bDescriptorType = USB_DESCR_TYP_HID, // HID descriptor: 0x21
+            .bcdHID = 0x0110,     // HID class spec version (BCD: 1.1)
+            .bCountryCode = 0,    // country code: not localized
+            .bNumDescriptors = 1, // number of report descriptors: 1
+            .bDescriptorTypeX =
+                USB_DESCR_TYP_REPORT, // descriptor type: report (0x22)
+            .wDescriptorLength = sizeof(ConsReportDescr) // report descriptor length
+        },
 
-__code uint8_t ReportDescrLen = sizeof(ReportDescr);
+    // Endpoint Descriptor: Endpoint 4 (IN, Interrupt)
+    .ep4IN = {
+        .bLength = sizeof(USB_ENDP_DESCR), // size of the descriptor in bytes: 7
+        .bDescriptorType = USB_DESCR_TYP_ENDP, // endpoint descriptor: 0x05
+        .bEndpointAddress =
+            USB_ENDP_ADDR_EP4_IN, // endpoint: 4, direction: IN (0x84)
+        .bmAttributes = USB_ENDP_TYPE_INTER, // transfer type: interrupt (0x03)
+        .wMaxPacketSize = EP4_SIZE,          // max packet size
+        .bInterval = USB_POLL_INTERVAL       // polling intervall in ms
+    }};
 
 // ===================================================================================
 // String Descriptors
 // ===================================================================================
 
+// Header word of a string descriptor: type and length in bytes. SDCC takes the
+// size of the array being defined, gcc (host build) counts the contents.
+#ifdef HOST_BUILD
+#define USB_STR_HEADER(descr, ...) (((uint16_t)USB_DESCR_TYP_STRING << 8) | \
+                                    (2 + sizeof((uint16_t[]){__VA_ARGS__})))
+#else
+#define USB_STR_HEADER(descr, ...) (((uint16_t)USB_DESCR_TYP_STRING << 8) | \
+                                    sizeof(descr))
+#endif
+
 // Language Descriptor (Index 0)
-__code uint16_t LangDescr[] = {((uint16_t)USB_DESCR_TYP_STRING << 8) |
-                                   sizeof(LangDescr),
+__code uint16_t LangDescr[] = {USB_STR_HEADER(LangDescr, 0x0409),
                                0x0409}; // US English
 
 // Manufacturer String Descriptor (Index 1)
-__code uint16_t ManufDescr[] = {((uint16_t)USB_DESCR_TYP_STRING << 8) |
-                                    sizeof(ManufDescr),
+__code uint16_t ManufDescr[] = {USB_STR_HEADER(ManufDescr, MANUFACTURER_STR),
                                 MANUFACTURER_STR};
 
 // Product String Descriptor (Index 2)
-__code uint16_t ProdDescr[] = {
-    ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(ProdDescr), PRODUCT_STR};
+__code uint16_t ProdDescr[] = {USB_STR_HEADER(ProdDescr, PRODUCT_STR),
+                               PRODUCT_STR};
 
 // Serial String Descriptor (Index 3)
-__code uint16_t SerDescr[] = {
-    ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(SerDescr), SERIAL_STR};
+__code uint16_t SerDescr[] = {USB_STR_HEADER(SerDescr, SERIAL_STR),
+                              SERIAL_STR};
 
 // Interface String Descriptor (Index 4)
-__code uint16_t InterfDescr[] = {
-    ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(InterfDescr), INTERFACE_STR};
+__code uint16_t InterfDescr[] = {USB_STR_HEADER(InterfDescr, INTERFACE_STR),
+                                 INTERFACE_STR};
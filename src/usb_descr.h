@@ -9,36 +9,133 @@
 // USB_PRODUCT_ID           - Product ID (16-bit word)
 // USB_DEVICE_VERSION       - Device version (16-bit BCD)
 // USB_MAX_POWER_mA         - Device max power in mA
+// USB_POLL_INTERVAL        - polling interval of all endpoints in ms
+// EP1_SIZE, EP2_SIZE       - EP1 IN/EP2 OUT (touch screen) max packet size (8..64)
+// EP3_SIZE                 - EP3 IN (boot keyboard) max packet size (8..64)
+// EP4_SIZE                 - EP4 IN (consumer control/mouse) max packet size (8..64)
 // All string descriptors.
 //
-// In the makefile the following microcontroller settings must be made:
+// The device is a composite of three HID interfaces, each with its own IN
+// endpoint, so the host polls them independently:
+// Interface 0: touch screen (digitizer), EP1 IN, EP2 OUT (relay mode)
+// Interface 1: boot keyboard, EP3 IN
+// Interface 2: consumer control and mouse wheel, EP4 IN
+//
+// In the makefile the following microcontroller settings must be made and handed
+// to the compiler (-DXRAM_LOC, -DXRAM_SIZE), so the endpoint buffer layout can be
+// checked against them:
 // XRAM_LOC   = 0x0100
 // XRAM_SIZE  = 0x0300
+// The EP1 buffers grow with HID_QUEUE_SIZE and the contact layout, raise XRAM_LOC
+// (e.g. 0x0180 with MT_WIDTH_HEIGHT) if the build stops with an overlap error.
 
 #pragma once
 #include <stdint.h>
 #include "usb.h"
 #include "config.h"
 
+// ===================================================================================
+// HID Interfaces and Report IDs
+// ===================================================================================
+#define HID_ITF_TOUCH         0         // touch screen interface (EP1/EP2)
+#define HID_ITF_KEYBOARD      1         // boot keyboard interface (EP3)
+#define HID_ITF_CONSUMER      2         // consumer control/mouse interface (EP4)
+#define HID_ITFS              3         // number of interfaces
+
+#define REPORT_ID_TOUCH       0x01      // interface 0, input: touch screen contacts
+#define REPORT_ID_MAX_COUNT   0x02      // interface 0, feature: contact count maximum
+#define REPORT_ID_THQA        0x04      // interface 0, feature: certification status
+#define REPORT_ID_WHEEL       0x03      // interface 2, input: mouse wheel (rotary encoder)
+#define REPORT_ID_CONSUMER    0x05      // interface 2, input: consumer control usage
+#define REPORT_ID_RELAY       0x06      // interface 0, output: relayed contacts (EP2 OUT)
+
+#define KBD_REPORT_SIZE       8         // boot keyboard report (no report ID)
+#define WHEEL_REPORT_SIZE     4         // report ID, X, Y, wheel
+#define CONSUMER_REPORT_SIZE  3         // report ID, 16-bit usage
+#define RLY_CONTACT_SIZE      7         // id, flags, x, y, pressure
+#define RLY_REPORT_SIZE       (3 + MT_MAX_CONTACTS * RLY_CONTACT_SIZE) // ID, seq, count
+
+// ===================================================================================
+// Multitouch Report Layout
+// ===================================================================================
+// Parallel mode packs all MT_MAX_CONTACTS contacts into one input report, hybrid
+// mode sends one report per contact with the contact count in the first one.
+#ifdef MT_PARALLEL_MODE
+  #define MT_REPORT_CONTACTS  MT_MAX_CONTACTS
+#else
+  #define MT_REPORT_CONTACTS  1
+#endif
+// The contact layout follows the optional usages enabled in config.h, the
+// report descriptor and MT_CONTACT are built from the same settings.
+#ifdef MT_PRESSURE
+  #define MT_PRESSURE_SIZE    1         // pressure
+#else
+  #define MT_PRESSURE_SIZE    0
+#endif
+#ifdef MT_WIDTH_HEIGHT
+  #define MT_WH_SIZE          4         // width, height
+#else
+  #define MT_WH_SIZE          0
+#endif
+#define MT_CONTACT_SIZE       (6 + MT_PRESSURE_SIZE + MT_WH_SIZE) // id, status, x, y
+#define MT_REPORT_SIZE        (2 + MT_REPORT_CONTACTS * MT_CONTACT_SIZE)
+#define EP1_REPORT_MAX        MT_REPORT_SIZE  // largest report sent on EP1
+
+#if MT_REPORT_CONTACTS < 1 || MT_REPORT_CONTACTS > 10
+  #error MT_MAX_CONTACTS must be within 1..10!
+#endif
+#if MT_LOGICAL_MAX < 1 || MT_LOGICAL_MAX > 32767
+  #error MT_LOGICAL_MAX must be within 1..32767!
+#endif
+
 // ===================================================================================
 // USB Endpoint Definitions
 // ===================================================================================
-#define EP0_SIZE        8
-#define EP1_SIZE        8
-#define EP2_SIZE        8
+#define EP0_SIZE        64            // full-speed maximum, descriptors in few packets
 
 #define EP0_BUF_SIZE    EP_BUF_SIZE(EP0_SIZE)
-#define EP1_BUF_SIZE    EP_BUF_SIZE(EP1_SIZE)
 #define EP2_BUF_SIZE    EP_BUF_SIZE(EP2_SIZE)
-#define EP_BUF_SIZE(x)  (x+2<64 ? x+2 : 64)
+#define EP3_BUF_SIZE    EP_BUF_SIZE(EP3_SIZE)
+#define EP4_BUF_SIZE    EP_BUF_SIZE(EP4_SIZE)
+#define EP_BUF_SIZE(x)  ((x)+2<64 ? ((x)+3)&~1 : 64)  // keep DMA addresses even
 
+// EP4 has no DMA register of its own, with only EP4 IN enabled the hardware
+// uses the buffer at UEP0_DMA + 64. EP1 has one buffer per slot of the HID
+// report queue, UEP1_DMA is moved to the slot of the report being sent, so
+// reports are built where they are sent from (zero copy).
+#define EP1_SLOT_SIZE   ((EP1_REPORT_MAX + 1) & ~1)   // keep DMA addresses even
 #define EP0_ADDR        0
-#define EP1_ADDR        (EP0_ADDR + EP0_BUF_SIZE)
-#define EP2_ADDR        (EP1_ADDR + EP1_BUF_SIZE)
+#define EP4_ADDR        (EP0_ADDR + 64)
+#define EP2_ADDR        (EP4_ADDR + EP4_BUF_SIZE)
+#define EP3_ADDR        (EP2_ADDR + EP2_BUF_SIZE)
+#define EP1_ADDR        (EP3_ADDR + EP3_BUF_SIZE)
+#define EP_BUF_END      (EP1_ADDR + HID_QUEUE_SIZE * EP1_SLOT_SIZE)
+
+#if EP1_SIZE < 8 || EP1_SIZE > 64 || EP2_SIZE < 8 || EP2_SIZE > 64
+  #error EP1_SIZE and EP2_SIZE must be within 8..64 bytes!
+#endif
+#if EP3_SIZE < 8 || EP3_SIZE > 64 || EP4_SIZE < 8 || EP4_SIZE > 64
+  #error EP3_SIZE and EP4_SIZE must be within 8..64 bytes!
+#endif
+#if EP1_REPORT_MAX > EP1_SIZE
+  #error Report does not fit into EP1_SIZE, raise EP1_SIZE or use hybrid mode!
+#endif
+#if USB_POLL_INTERVAL < 1 || USB_POLL_INTERVAL > 255
+  #error USB_POLL_INTERVAL must be within 1..255 ms!
+#endif
+#if defined(XRAM_LOC) && (EP_BUF_END > XRAM_LOC)
+  #error Endpoint buffers overlap compiler XRAM, raise XRAM_LOC in the makefile!
+#endif
+#if defined(XRAM_LOC) && defined(XRAM_SIZE) && (XRAM_LOC + XRAM_SIZE > 0x0400)
+  #error XRAM_LOC + XRAM_SIZE exceeds the 1K XRAM of the CH55x!
+#endif
 
 __xdata __at (EP0_ADDR) uint8_t EP0_buffer[EP0_BUF_SIZE];     
-__xdata __at (EP1_ADDR) uint8_t EP1_buffer[EP1_BUF_SIZE];
+__xdata __at (EP1_ADDR) uint8_t EP1_buffer[HID_QUEUE_SIZE][EP1_SLOT_SIZE];
 __xdata __at (EP2_ADDR) uint8_t EP2_buffer[EP2_BUF_SIZE];
+__xdata __at (EP3_ADDR) uint8_t EP3_buffer[EP3_BUF_SIZE];
+__xdata __at (EP4_ADDR) uint8_t EP4_buffer[EP4_BUF_SIZE];
+__xdata __at (EP_BUF_END) uint8_t EP_bufferEnd;   // end marker for tools/mem_report.py
 
 // ===================================================================================
 // Device and Configuration Descriptors
@@ -49,6 +146,12 @@ typedef struct _USB_CFG_DESCR_HID {
   USB_HID_DESCR hid0;
   USB_ENDP_DESCR ep1IN;
   USB_ENDP_DESCR ep2OUT;
+  USB_ITF_DESCR interface1;
+  USB_HID_DESCR hid1;
+  USB_ENDP_DESCR ep3IN;
+  USB_ITF_DESCR interface2;
+  USB_HID_DESCR hid2;
+  USB_ENDP_DESCR ep4IN;
 } USB_CFG_DESCR_HID, *PUSB_CFG_DESCR_HID;
 typedef USB_CFG_DESCR_HID __xdata *PXUSB_CFG_DESCR_HID;
 
@@ -59,10 +162,22 @@ extern __code USB_CFG_DESCR_HID CfgDescr;
 // HID Report Descriptors
 // ===================================================================================
 extern __code uint8_t ReportDescr[];
-extern __code uint8_t ReportDescrLen;
+extern __code uint16_t ReportDescrLen;
+extern __code uint8_t KbdReportDescr[];
+extern __code uint16_t KbdReportDescrLen;
+extern __code uint8_t ConsReportDescr[];
+extern __code uint16_t ConsReportDescrLen;
 
-#define USB_REPORT_DESCR      ReportDescr
-#define USB_REPORT_DESCR_LEN  ReportDescrLen
+// HID and report descriptors per interface (GET_DESCRIPTOR wIndex)
+#define USB_HID_DESCR_i0          (uint8_t*)&CfgDescr.hid0
+#define USB_HID_DESCR_i1          (uint8_t*)&CfgDescr.hid1
+#define USB_HID_DESCR_i2          (uint8_t*)&CfgDescr.hid2
+#define USB_REPORT_DESCR_i0       ReportDescr
+#define USB_REPORT_DESCR_LEN_i0   ReportDescrLen
+#define USB_REPORT_DESCR_i1       KbdReportDescr
+#define USB_REPORT_DESCR_LEN_i1   KbdReportDescrLen
+#define USB_REPORT_DESCR_i2       ConsReportDescr
+#define USB_REPORT_DESCR_LEN_i2   ConsReportDescrLen
 
 // ===================================================================================
 // String Descriptors
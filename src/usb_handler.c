@@ -4,12 +4,17 @@
 
 #include "usb_handler.h"
 
+#if F_CPU < 6000000
+  #error USB device mode needs a system clock of at least 6 MHz!
+#endif
+
 // ===================================================================================
 // Variables
 // ===================================================================================
 volatile uint8_t  USB_SetupReq, USB_SetupTyp, USB_Config, USB_Addr;
 volatile uint16_t USB_SetupLen;
 volatile __bit    USB_ENUM_OK;
+volatile __bit    USB_REMOTE_WAKE;
 __code uint8_t*   USB_pDescr;
 
 // ===================================================================================
@@ -21,6 +26,7 @@ void USB_EP_init(void) {
               | UEP_T_RES_NAK;              // EP0 IN transaction returns NAK
   UEP0_T_LEN  = 0;                          // must be zero at start
   USB_ENUM_OK = 0;                          // reset ENUM flag
+  USB_REMOTE_WAKE = 0;                      // remote wakeup disabled after reset
 
   #ifdef USB_INIT_endpoints
   USB_INIT_endpoints();                     // custom EP init handler
@@ -52,7 +58,14 @@ void USB_init(void) {
 // Fast Copy Function
 // ===================================================================================
 // Copy descriptor *USB_pDescr to EP0_buffer using double pointer
-// (Thanks to Ralph Doncaster)
+// (Thanks to Ralph Doncaster). The simulator benchmarks (BENCH_SIM) and the host
+// build (HOST_BUILD) copy in C, the 8051 core of the simulator has no DPTR1.
+#if defined(BENCH_SIM) || defined(HOST_BUILD)
+void USB_EP0_copyDescr(uint8_t len) {
+  __xdata uint8_t* dst = EP0_buffer;
+  while(len--) *dst++ = *USB_pDescr++;
+}
+#else
 #pragma callee_saves USB_EP0_copyDescr
 void USB_EP0_copyDescr(uint8_t len) {
   len;                          // stop unreferenced argument warning
@@ -77,6 +90,7 @@ void USB_EP0_copyDescr(uint8_t len) {
     pop  acc                    ; acc <- stack
   __endasm;
 }
+#endif
 
 // ===================================================================================
 // Endpoint EP0 Handlers
@@ -85,6 +99,7 @@ void USB_EP0_copyDescr(uint8_t len) {
 // Endpoint 0 SETUP handler
 void USB_EP0_SETUP(void) {
   uint8_t len = 0;                                // default is success and upload 0 length
+  uint16_t dlen;                                  // descriptor length (may exceed 255)
   USB_SetupLen = ((uint16_t)USB_SetupBuf->wLengthH<<8) | (USB_SetupBuf->wLengthL);
   USB_SetupReq = USB_SetupBuf->bRequest;
   USB_SetupTyp = USB_SetupBuf->bRequestType;
@@ -96,12 +111,12 @@ void USB_EP0_SETUP(void) {
 
           case USB_DESCR_TYP_DEVICE:              // Device Descriptor
             USB_pDescr = (uint8_t*)&DevDescr;     // put descriptor into out buffer
-            len = sizeof(DevDescr);               // descriptor length
+            dlen = sizeof(DevDescr);              // descriptor length
             break;
 
           case USB_DESCR_TYP_CONFIG:              // Configuration Descriptor
             USB_pDescr = (uint8_t*)&CfgDescr;     // put descriptor into out buffer
-            len = sizeof(CfgDescr);               // descriptor length
+            dlen = sizeof(CfgDescr);              // descriptor length
             break;
 
           case USB_DESCR_TYP_STRING:
@@ -133,16 +148,61 @@ void USB_EP0_SETUP(void) {
               #endif
               default:  USB_pDescr = USB_STR_DESCR_ix; break;
             }
-            len = USB_pDescr[0];                  // descriptor length
+            dlen = USB_pDescr[0];                 // descriptor length
+            break;
+
+          #ifdef USB_HID_DESCR_i0
+          case USB_DESCR_TYP_HID:                 // HID Descriptor of interface wIndex
+            switch(USB_SetupBuf->wIndexL) {
+              case 0:   USB_pDescr = USB_HID_DESCR_i0; break;
+              #ifdef USB_HID_DESCR_i1
+              case 1:   USB_pDescr = USB_HID_DESCR_i1; break;
+              #endif
+              #ifdef USB_HID_DESCR_i2
+              case 2:   USB_pDescr = USB_HID_DESCR_i2; break;
+              #endif
+              #ifdef USB_HID_DESCR_i3
+              case 3:   USB_pDescr = USB_HID_DESCR_i3; break;
+              #endif
+              default:  len = 0xff; break;
+            }
+            dlen = sizeof(USB_HID_DESCR);         // descriptor length
             break;
+          #endif
 
-          #ifdef USB_REPORT_DESCR
-          case USB_DESCR_TYP_REPORT:
-            if(USB_SetupBuf->wValueL == 0) {
-              USB_pDescr = USB_REPORT_DESCR;
-              len = USB_REPORT_DESCR_LEN;
+          #ifdef USB_REPORT_DESCR_i0
+          case USB_DESCR_TYP_REPORT:              // Report Descriptor of interface wIndex
+            if(USB_SetupBuf->wValueL) {
+              len = 0xff;                         // only one report descriptor each
+              break;
+            }
+            switch(USB_SetupBuf->wIndexL) {
+              case 0:
+                USB_pDescr = USB_REPORT_DESCR_i0;
+                dlen = USB_REPORT_DESCR_LEN_i0;
+                break;
+              #ifdef USB_REPORT_DESCR_i1
+              case 1:
+                USB_pDescr = USB_REPORT_DESCR_i1;
+                dlen = USB_REPORT_DESCR_LEN_i1;
+                break;
+              #endif
+              #ifdef USB_REPORT_DESCR_i2
+              case 2:
+                USB_pDescr = USB_REPORT_DESCR_i2;
+                dlen = USB_REPORT_DESCR_LEN_i2;
+                break;
+              #endif
+              #ifdef USB_REPORT_DESCR_i3
+              case 3:
+                USB_pDescr = USB_REPORT_DESCR_i3;
+                dlen = USB_REPORT_DESCR_LEN_i3;
+                break;
+              #endif
+              default:
+                len = 0xff;                       // no such interface
+                break;
             }
-            else len = 0xff;
             break;
           #endif
 
@@ -152,7 +212,7 @@ void USB_EP0_SETUP(void) {
         }
 
         if(len != 0xff) {
-          if(USB_SetupLen > len) USB_SetupLen = len;    // limit length
+          if(USB_SetupLen > dlen) USB_SetupLen = dlen;  // limit length
           len = USB_SetupLen >= EP0_SIZE ? EP0_SIZE : USB_SetupLen;
           USB_EP0_copyDescr(len);                 // copy descriptor to EP0
         }
@@ -181,6 +241,8 @@ void USB_EP0_SETUP(void) {
 
       case USB_GET_STATUS:
         EP0_buffer[0] = 0x00;
+        if(((USB_SetupTyp & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_DEVICE) && USB_REMOTE_WAKE)
+          EP0_buffer[0] = 0x02;                   // remote wakeup enabled
         EP0_buffer[1] = 0x00;
         if(USB_SetupLen > 2) USB_SetupLen = 2;
         len = USB_SetupLen;
@@ -190,7 +252,7 @@ void USB_EP0_SETUP(void) {
         if((USB_SetupTyp & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_DEVICE) {
           if(USB_SetupBuf->wValueL == 0x01) {
             if(((uint8_t*)&CfgDescr)[7] & 0x20) {
-              // wake up
+              USB_REMOTE_WAKE = 0;         // disable remote wakeup
             }
             else len = 0xff;               // failed
           }
@@ -249,7 +311,8 @@ void USB_EP0_SETUP(void) {
       case USB_SET_FEATURE:
         if((USB_SetupTyp & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_DEVICE) {
           if(USB_SetupBuf->wValueL == 0x01) {
-            if( !(((uint8_t*)&CfgDescr)[7] & 0x20) ) len = 0xff;  // failed
+            if(((uint8_t*)&CfgDescr)[7] & 0x20) USB_REMOTE_WAKE = 1;  // enable remote wakeup
+            else len = 0xff;                                      // failed
           }
           else len = 0xff;                                        // failed
         }
@@ -458,15 +521,8 @@ void USB_interrupt(void) {
   if(UIF_SUSPEND) {
     UIF_SUSPEND = 0;                        // clear interrupt flag
     #ifdef USB_SUSPEND_handler
-    if(USB_MIS_ST & bUMS_SUSPEND) {
-      SAFE_MOD   = 0x55;
-      SAFE_MOD   = 0xAA;
-      WAKE_CTRL |= bWAK_BY_USB;             // enable wakeup by USB
-      USB_SUSPEND_handler();                // custom suspend handler (PCON |= PD;)
-      SAFE_MOD   = 0x55;
-      SAFE_MOD   = 0xAA;
-      WAKE_CTRL &= ~bWAK_BY_USB;            // disable wakeup by USB
-    }
+    if(USB_MIS_ST & bUMS_SUSPEND)
+      USB_SUSPEND_handler();                // custom suspend handler (keep it short)
     #endif
   }
 
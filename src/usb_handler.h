@@ -14,30 +14,55 @@
 extern volatile uint8_t  USB_SetupReq, USB_SetupTyp;
 extern volatile uint16_t USB_SetupLen;
 extern volatile __bit    USB_ENUM_OK;
+extern volatile __bit    USB_REMOTE_WAKE; // remote wakeup enabled by host
 extern __code uint8_t*   USB_pDescr;
 
 // ===================================================================================
 // Custom External USB Handler Functions
 // ===================================================================================
 uint8_t MT_control(void);
+void MT_controlIn(void);
+void MT_controlOut(void);
 void HID_EP_init(void);
 void HID_EP1_IN(void);
+void HID_EP3_IN(void);
+void HID_EP4_IN(void);
+void RLY_EP2_OUT(void);
+void PWR_suspendIrq(void);
+void SUP_busReset(void);
+uint8_t VEN_control(void);
+void VEN_controlIn(void);
+void VEN_controlOut(void);
 
 // ===================================================================================
 // USB Handler Defines
 // ===================================================================================
 // Custom USB handler functions
 #define USB_INIT_endpoints  HID_EP_init       // custom USB EP init handler
+#define USB_SUSPEND_handler PWR_suspendIrq    // custom USB suspend handler
+#define USB_RESET_handler   SUP_busReset      // custom USB bus reset handler
+#define USB_CLASS_SETUP_handler MT_control    // HID class SETUP requests
+#define USB_CLASS_IN_handler    MT_controlIn  // HID class IN data/status stage
+#define USB_CLASS_OUT_handler   MT_controlOut // HID class OUT data/status stage
+#define USB_VENDOR_SETUP_handler VEN_control  // vendor SETUP requests
+#define USB_VENDOR_IN_handler   VEN_controlIn // vendor IN data/status stage
+#define USB_VENDOR_OUT_handler  VEN_controlOut // vendor OUT data/status stage
 
 // Endpoint callback functions
 #define EP0_SETUP_callback  USB_EP0_SETUP
 #define EP0_IN_callback     USB_EP0_IN
 #define EP0_OUT_callback    USB_EP0_OUT
 #define EP1_IN_callback     HID_EP1_IN
+#define EP3_IN_callback     HID_EP3_IN
+#define EP4_IN_callback     HID_EP4_IN
+#ifdef RELAY_ENABLE
+#define EP2_OUT_callback    RLY_EP2_OUT
+#endif
 
 // ===================================================================================
 // Functions
 // ===================================================================================
 void USB_init(void);
+void USB_EP_init(void);
 void USB_interrupt(void);
 void USB_EP0_copyDescr(uint8_t len);
@@ -1,56 +1,282 @@
-// ===================================================================================
-// USB HID Functions for CH551, CH552 and CH554                               * v1.1 *
-// ===================================================================================
-
-#include "usb_hid.h"
-
-// ===================================================================================
-// Variables and Defines
-// ===================================================================================
-volatile __bit HID_writeBusyFlag;                 // upload pointer busy flag
-
-// ===================================================================================
-// Front End Functions
-// ===================================================================================
-
-// Send HID report
-void HID_sendReport(__xdata uint8_t* buf, uint8_t len) {
-  uint8_t i;
-  while(HID_writeBusyFlag);                       // wait for ready to write
-  for(i=0; i<len; i++) EP1_buffer[i] = buf[i];    // copy report to EP1 buffer
-  HID_writeBusyFlag = 1;                          // set busy flag
-  UEP1_T_LEN = len;                               // set length to upload
-  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
-             | UEP_T_RES_ACK;                     // upload report to host
-}
-
-// ===================================================================================
-// HID-Specific USB Handler Functions
-// ===================================================================================
-
-// Setup/reset HID endpoints
-void HID_EP_init(void) {
-  UEP1_DMA    = (uint16_t)EP1_buffer;             // EP1 data transfer address
-  UEP1_CTRL   = bUEP_AUTO_TOG                     // EP1 Auto flip sync flag
-              | UEP_T_RES_NAK;                    // EP1 IN transaction returns NAK
-  UEP4_1_MOD  = bUEP1_TX_EN;                      // EP1 TX enable
-  UEP1_T_LEN  = 0;                                // EP1 nothing to send
-  #ifdef EP2_SIZE
-  UEP2_DMA    = (uint16_t)EP2_buffer;             // EP2 data transfer address
-  UEP2_CTRL   = bUEP_AUTO_TOG                     // EP2 Auto flip sync flag
-              | UEP_R_RES_ACK;                    // EP2 OUT transaction returns ACK
-  UEP2_3_MOD  = bUEP2_RX_EN;                      // EP2 RX_enable
-  HID_writeBusyFlag = 0;                          // reset write busy flag
-  #endif
-}
-
-// Endpoint 1 IN handler (HID report transfer to host completed)
-void HID_EP1_IN(void) {
-  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
-             | UEP_T_RES_NAK;                     // -> respond NAK
-  HID_writeBusyFlag = 0;                          // clear busy flag
-}
-
-// Endpoint 2 OUT handler (HID report transfer from host completed)
-// No handling is actually necessary here, the auto-ACK is sufficient.
-// The current report can be read from the EP2 buffer.
+// ===================================================================================
+// USB HID Functions for CH551, CH552 and CH554                               * v1.4 *
+// ===================================================================================
+
+#include "usb_hid.h"
+#include "perf.h"
+#include "timebase.h"
+
+// ===================================================================================
+// Variables and Defines
+// ===================================================================================
+#if HID_QUEUE_SIZE & (HID_QUEUE_SIZE - 1)
+  #error HID_QUEUE_SIZE must be a power of 2!
+#endif
+#define HID_QUEUE_MASK  (HID_QUEUE_SIZE - 1)
+
+volatile __bit HID_writeBusyFlag;                 // EP1 armed, report in flight
+volatile uint8_t HID_queueHead;                   // next free queue slot
+volatile uint8_t HID_queueTail;                   // oldest report (in flight if busy)
+__xdata uint8_t HID_queueLen[HID_QUEUE_SIZE];     // length of queued reports
+__xdata uint8_t HID_queueTag[HID_QUEUE_SIZE];     // coalescing tag of queued reports
+__xdata uint8_t* HID_copySrc;                     // source of HID_copy()
+volatile __bit HID_reserved;                      // report reserved, not committed yet
+volatile __bit HID_frameHeld;                     // queue held for a frame of reports
+
+volatile __bit HID_kbdBusyFlag;                   // EP3 armed, keyboard report in flight
+volatile __bit HID_conBusyFlag;                   // EP4 armed, consumer report in flight
+volatile uint8_t HID_kbdLeds;                     // keyboard LED state set by host
+__xdata uint16_t HID_kbdStart;                    // millisecond of last keyboard report
+
+// ===================================================================================
+// Fast Copy
+// ===================================================================================
+// Copy len (1..255) bytes from *HID_copySrc to dst in XRAM using both data
+// pointers, HID_copySrc is advanced. The USB interrupt must be blocked, as it
+// uses DPTR1 as well (USB_EP0_copyDescr). The simulator benchmarks (BENCH_SIM)
+// and the host build (HOST_BUILD) copy in C, the 8051 core of the simulator has
+// no DPTR1.
+#if defined(BENCH_SIM) || defined(HOST_BUILD)
+void HID_copy(__xdata uint8_t* dst, uint8_t len) {
+  while(len--) *dst++ = *HID_copySrc++;
+}
+#else
+#pragma callee_saves HID_copy
+void HID_copy(__xdata uint8_t* dst, uint8_t len) {
+  dst; len;                     // stop unreferenced argument warning
+  __asm
+    push acc                    ; acc -> stack
+    push ar7                    ; r7  -> stack
+    push ar6                    ; r6  -> stack
+    mov  r7, _HID_copy_PARM_2   ; r7  <- len
+    mov  r6, dph                ; r6  <- dst high byte
+    mov  a, dpl                 ; acc <- dst low byte
+    inc  _XBUS_AUX              ; select dptr1
+    mov  dpl, a                 ; dptr1 <- dst
+    mov  dph, r6
+    dec  _XBUS_AUX              ; select dptr0
+    mov  dpl, _HID_copySrc      ; dptr0 <- HID_copySrc
+    mov  dph, (_HID_copySrc + 1)
+    01$:
+    movx a, @dptr               ; acc <- *HID_copySrc[dptr0]
+    inc  dptr                   ; inc dptr0
+    .db  0xA5                   ; acc -> dst[dptr1] & inc dptr1
+    djnz r7, 01$                ; repeat len times
+    mov  _HID_copySrc, dpl      ; HID_copySrc += len
+    mov  (_HID_copySrc + 1), dph
+    pop  ar6                    ; r6  <- stack
+    pop  ar7                    ; r7  <- stack
+    pop  acc                    ; acc <- stack
+  __endasm;
+}
+#endif
+
+// ===================================================================================
+// Front End Functions
+// ===================================================================================
+
+// Get the buffer for the next report, returns 0 if the queue is full. The queue
+// slots are the EP1 DMA buffers, so the report is built right where the USB
+// engine sends it from. Nothing changes until HID_commitReport(). Both are also
+// called from the EP2 OUT handler (relay mode), which leaves a reserved slot
+// alone (HID_reserved). The slot is reserved before the queue is checked, so a
+// relay frame cannot take it in between.
+#pragma save
+#pragma nooverlay
+__xdata uint8_t* HID_reserveReport(void) {
+  HID_reserved = 1;                               // keep the EP2 OUT handler out
+  if((uint8_t)(HID_queueHead - HID_queueTail) >= HID_QUEUE_SIZE) {
+    HID_reserved = 0;
+    PERF_reportDropped();
+    return 0;
+  }
+  return EP1_buffer[HID_queueHead & HID_QUEUE_MASK];
+}
+
+// Queue the report written to the buffer of HID_reserveReport(). It is armed
+// right away if EP1 is idle. With HID_COALESCE set, it replaces the newest
+// pending report instead if both carry the same tag.
+void HID_commitReport(uint8_t len, uint8_t tag) {
+  uint8_t slot = HID_queueHead & HID_QUEUE_MASK;
+  tag;                                            // unreferenced without HID_COALESCE
+
+  IE_USB = 0;                                     // keep EP1 IN handler out
+  HID_reserved = 0;
+  #ifdef HID_COALESCE
+  if( (tag != HID_TAG_NONE)
+   && ((uint8_t)(HID_queueHead - HID_queueTail) > (uint8_t)HID_writeBusyFlag)
+   && (HID_queueTag[(HID_queueHead - 1) & HID_QUEUE_MASK] == tag) ) {
+    HID_copySrc = EP1_buffer[slot];               // overwrite newest pending report
+    slot = (HID_queueHead - 1) & HID_QUEUE_MASK;
+    HID_copy(EP1_buffer[slot], len);
+    HID_queueLen[slot] = len;
+    PERF_reportCoalesced();
+    PERF_reportQueued();
+    IE_USB = 1;
+    return;
+  }
+  #endif
+  HID_queueLen[slot] = len;
+  HID_queueTag[slot] = tag;
+  HID_queueHead++;
+  if(!HID_writeBusyFlag) {                        // EP1 idle -> send right away
+    HID_writeBusyFlag = 1;                        // set busy flag
+    UEP1_DMA   = (uint16_t)EP1_buffer[slot];      // send from this slot
+    UEP1_T_LEN = len;                             // set length to upload
+    UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
+               | UEP_T_RES_ACK;                   // upload report to host
+  }
+  PERF_reportQueued();
+  IE_USB = 1;
+}
+#pragma restore
+
+// Queue a copy of a HID report, returns immediately (1: queued or sent, 0:
+// queue full)
+uint8_t HID_tryQueueReport(__xdata uint8_t* buf, uint8_t len, uint8_t tag) {
+  __xdata uint8_t* dst = HID_reserveReport();
+  if(!dst) return 0;                              // queue full
+  IE_USB = 0;
+  HID_copySrc = buf;
+  HID_copy(dst, len);
+  IE_USB = 1;
+  HID_commitReport(len, tag);
+  return 1;
+}
+
+// Send HID report, waits until there is room in the queue, but gives up after
+// HID_SEND_MS if the host stopped polling (returns 0)
+uint8_t HID_sendReport(__xdata uint8_t* buf, uint8_t len) {
+  uint16_t start = TB_millis();
+  while(!HID_tryQueueReport(buf, len, HID_TAG_NONE))
+    if(TB_elapsed(start, HID_SEND_MS + 1)) return 0;
+  return 1;
+}
+
+// Number of free reports that can be queued without blocking
+uint8_t HID_queueFree(void) {
+  return HID_QUEUE_SIZE - (uint8_t)(HID_queueHead - HID_queueTail);
+}
+
+// Hold the queue for a frame of several reports, returns 0 if they do not all
+// fit. The EP2 OUT handler queues nothing until HID_releaseFrame(), so the
+// frame is not split by a relay frame.
+uint8_t HID_holdFrame(uint8_t reports) {
+  HID_frameHeld = 1;                              // keep the EP2 OUT handler out
+  if(HID_queueFree() >= reports) return 1;
+  HID_frameHeld = 0;
+  return 0;
+}
+
+// Send boot keyboard report (KBD_REPORT_SIZE bytes) on EP3, returns 0 if busy.
+// Keyboard reports never wait behind touch frames.
+uint8_t HID_tryKeyboardReport(__xdata uint8_t* buf) {
+  if(HID_kbdBusyFlag) return 0;                   // last report not picked up yet
+  IE_USB = 0;
+  HID_copySrc = buf;
+  HID_copy(EP3_buffer, KBD_REPORT_SIZE);
+  IE_USB = 1;
+  HID_commitKeyboard();
+  return 1;
+}
+
+// Send the keyboard report written to EP3_buffer (HID_keyboardBuffer())
+void HID_commitKeyboard(void) {
+  HID_kbdBusyFlag = 1;
+  HID_kbdStart    = TB_millis();                  // restart idle period
+  UEP3_T_LEN = KBD_REPORT_SIZE;
+  UEP3_CTRL  = (UEP3_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_ACK;                     // upload report to host
+}
+
+// Send consumer control or wheel report on EP4, returns 0 if busy
+uint8_t HID_tryConsumerReport(__xdata uint8_t* buf, uint8_t len) {
+  if(HID_conBusyFlag) return 0;                   // last report not picked up yet
+  IE_USB = 0;
+  HID_copySrc = buf;
+  HID_copy(EP4_buffer, len);
+  IE_USB = 1;
+  HID_commitConsumer(len);
+  return 1;
+}
+
+// Send the consumer or wheel report written to EP4_buffer (HID_consumerBuffer())
+void HID_commitConsumer(uint8_t len) {
+  HID_conBusyFlag = 1;
+  UEP4_T_LEN = len;
+  UEP4_CTRL  = (UEP4_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_ACK;                     // upload report to host
+}
+
+// ===================================================================================
+// HID-Specific USB Handler Functions
+// ===================================================================================
+
+// Setup/reset HID endpoints
+void HID_EP_init(void) {
+  UEP1_DMA    = (uint16_t)EP1_buffer[0];          // EP1 data transfer address
+  UEP1_CTRL   = bUEP_AUTO_TOG                     // EP1 Auto flip sync flag
+              | UEP_T_RES_NAK;                    // EP1 IN transaction returns NAK
+  UEP1_T_LEN  = 0;                                // EP1 nothing to send
+  UEP2_DMA    = (uint16_t)EP2_buffer;             // EP2 data transfer address
+  UEP2_CTRL   = bUEP_AUTO_TOG                     // EP2 Auto flip sync flag
+              | UEP_R_RES_ACK;                    // EP2 OUT transaction returns ACK
+  UEP3_DMA    = (uint16_t)EP3_buffer;             // EP3 data transfer address
+  UEP3_CTRL   = bUEP_AUTO_TOG                     // EP3 Auto flip sync flag
+              | UEP_T_RES_NAK;                    // EP3 IN transaction returns NAK
+  UEP3_T_LEN  = 0;                                // EP3 nothing to send
+  UEP4_CTRL   = UEP_T_RES_NAK;                    // EP4 manual flip, returns NAK
+  UEP4_T_LEN  = 0;                                // EP4 nothing to send
+  UEP2_3_MOD  = bUEP2_RX_EN | bUEP3_TX_EN;        // EP2 RX and EP3 TX enable
+  UEP4_1_MOD  = bUEP1_TX_EN | bUEP4_TX_EN;        // EP1 TX and EP4 TX enable
+                                                  // (EP4 buffer: UEP0_DMA + 64)
+  HID_queueHead = 0;                              // drop pending reports
+  HID_queueTail = 0;
+  HID_writeBusyFlag = 0;                          // reset write busy flags
+  HID_kbdBusyFlag = 0;
+  HID_conBusyFlag = 0;
+}
+
+// Endpoint 1 IN handler (HID report transfer to host completed)
+// The slot of the ACKed report is freed and the DMA address is moved to the
+// next queued report right here without copying, so back-to-back reports go
+// out on consecutive polls without involving the main loop.
+#pragma save
+#pragma nooverlay
+void HID_EP1_IN(void) {
+  uint8_t slot;
+
+  PERF_reportDone();                              // last transfer has been ACKed
+  HID_queueTail++;                                // free its slot
+  if(HID_queueHead == HID_queueTail) {            // nothing left to send
+    UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
+               | UEP_T_RES_NAK;                   // -> respond NAK
+    HID_writeBusyFlag = 0;                        // clear busy flag
+    return;
+  }
+  slot = HID_queueTail & HID_QUEUE_MASK;
+  UEP1_DMA   = (uint16_t)EP1_buffer[slot];        // arm next report, stay ACK
+  UEP1_T_LEN = HID_queueLen[slot];
+}
+
+// Endpoint 3 IN handler (keyboard report transfer to host completed)
+void HID_EP3_IN(void) {
+  UEP3_T_LEN = 0;                                 // no data to send anymore
+  UEP3_CTRL  = (UEP3_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_NAK;                     // default NAK
+  HID_kbdBusyFlag = 0;                            // clear busy flag
+}
+
+// Endpoint 4 IN handler (consumer report transfer to host completed)
+// EP4 has no auto flip, the sync flag is toggled here.
+void HID_EP4_IN(void) {
+  UEP4_T_LEN = 0;                                 // no data to send anymore
+  UEP4_CTRL  = ((UEP4_CTRL ^ bUEP_T_TOG) & ~MASK_UEP_T_RES)
+             | UEP_T_RES_NAK;                     // switch DATA0/DATA1, default NAK
+  HID_conBusyFlag = 0;                            // clear busy flag
+}
+#pragma restore
+
+// Endpoint 2 OUT handler (HID report transfer from host completed)
+// No handling is actually necessary here, the auto-ACK is sufficient.
+// The current report can be read from the EP2 buffer.
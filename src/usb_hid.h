@@ -1,21 +1,78 @@
-// ===================================================================================
-// USB HID Functions for CH551, CH552 and CH554                               * v1.1 *
-// ===================================================================================
-//
-// Functions available:
-// --------------------
-// HID_init()               init USB-HID
-// HID_sendReport(rep, len) send HID report (pointer to report buffer, length)
-//
-// 2022 by Stefan Wagner:   https://github.com/wagiminator
-
-#pragma once
-#include <stdint.h>
-#include "ch554.h"
-#include "usb.h"
-#include "usb_descr.h"
-#include "usb_handler.h"
-
-#define HID_IN_buffer   EP2_buffer                        // buffer for incoming HID reports
-#define HID_init        USB_init                          // setup USB-HID
-void HID_sendReport(__xdata uint8_t* buf, uint8_t len);   // send HID report
+// ===================================================================================
+// USB HID Functions for CH551, CH552 and CH554                               * v1.4 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// HID_init()               init USB-HID
+// HID_sendReport(rep, len) send HID report (pointer to report buffer, length),
+//                          waits at most HID_SEND_MS for room (returns 0 if full)
+// HID_tryQueueReport(rep, len, tag)
+//                          queue HID report without waiting (returns 0 if full)
+// HID_reserveReport()      get EP1 buffer to build the next report in (0 if full)
+// HID_commitReport(len, tag)
+//                          queue the report built in the reserved buffer
+// HID_queueDepth()         number of reports queued or in flight
+// HID_queueFree()          number of reports that can be queued without blocking
+// HID_holdFrame(reports)   hold the queue for a frame of several reports (0 if
+//                          they do not fit), HID_releaseFrame() when queued
+// HID_tryKeyboardReport(rep)
+//                          send boot keyboard report on EP3 (returns 0 if busy)
+// HID_keyboardBuffer()     get EP3 buffer to build a keyboard report in (0 if busy)
+// HID_commitKeyboard()     send the keyboard report built in the EP3 buffer
+// HID_tryConsumerReport(rep, len)
+//                          send consumer control/wheel report on EP4 (returns 0 if busy)
+// HID_consumerBuffer()     get EP4 buffer to build a consumer/wheel report in (0 if busy)
+// HID_commitConsumer(len)  send the report built in the EP4 buffer
+// HID_copy(dst, len)       fast XRAM copy from HID_copySrc (USB interrupt blocked)
+// HID_busy()               any report queued or in flight on any endpoint
+// HID_kbdLeds              keyboard LED state set by the host (bit 0: num lock, ...)
+//
+// Reports are kept in a ring of HID_QUEUE_SIZE entries (config.h), each entry
+// is an EP1 DMA buffer and the report in flight keeps its entry until it is
+// ACKed. The EP1 IN handler arms the next queued report directly from the
+// interrupt by moving UEP1_DMA, nothing is copied. Reports can be built in place
+// (HID_reserveReport, HID_commitReport) or copied (HID_tryQueueReport). If
+// HID_COALESCE is defined, a report replaces the newest pending report with
+// the same tag (use HID_TAG_NONE to always append). Keyboard and consumer
+// reports have their own endpoints with a single buffer each, so they never
+// wait behind touch frames.
+//
+// 2022 by Stefan Wagner:   https://github.com/wagiminator
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "usb.h"
+#include "usb_descr.h"
+#include "usb_handler.h"
+
+#define HID_IN_buffer   EP2_buffer                        // buffer for incoming HID reports
+#define HID_init        USB_init                          // setup USB-HID
+#define HID_TAG_NONE    0xFF                              // never coalesce this report
+
+extern volatile __bit HID_writeBusyFlag;
+extern volatile uint8_t HID_queueHead, HID_queueTail;
+extern volatile __bit HID_kbdBusyFlag, HID_conBusyFlag;
+extern volatile uint8_t HID_kbdLeds;
+extern __xdata uint16_t HID_kbdStart;                     // ms of last keyboard report
+extern __xdata uint8_t* HID_copySrc;                      // source of HID_copy()
+extern volatile __bit HID_reserved;                       // report reserved, not committed
+extern volatile __bit HID_frameHeld;                      // queue held for a frame
+#define HID_queueDepth() ((uint8_t)(HID_queueHead - HID_queueTail))
+#define HID_busy()       (HID_queueDepth() || HID_kbdBusyFlag || HID_conBusyFlag)
+#define HID_keyboardBuffer() (HID_kbdBusyFlag ? 0 : EP3_buffer)
+#define HID_consumerBuffer() (HID_conBusyFlag ? 0 : EP4_buffer)
+
+uint8_t HID_sendReport(__xdata uint8_t* buf, uint8_t len); // send HID report
+uint8_t HID_tryQueueReport(__xdata uint8_t* buf, uint8_t len, uint8_t tag);
+__xdata uint8_t* HID_reserveReport(void);                 // get buffer of next report
+void HID_commitReport(uint8_t len, uint8_t tag);          // queue reserved report
+uint8_t HID_queueFree(void);
+uint8_t HID_holdFrame(uint8_t reports);                   // hold queue for a frame
+#define HID_releaseFrame() (HID_frameHeld = 0)
+uint8_t HID_tryKeyboardReport(__xdata uint8_t* buf);      // send keyboard report
+void HID_commitKeyboard(void);                            // send report in EP3 buffer
+uint8_t HID_tryConsumerReport(__xdata uint8_t* buf, uint8_t len);
+void HID_commitConsumer(uint8_t len);                     // send report in EP4 buffer
+void HID_copy(__xdata uint8_t* dst, uint8_t len);         // fast copy (1..255 bytes)
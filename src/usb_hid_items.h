@@ -0,0 +1,93 @@
+// ===================================================================================
+// HID Report Descriptor Items                                                * v1.0 *
+// ===================================================================================
+//
+// Macros that expand to the bytes of HID report descriptor short items, so
+// report descriptors can be composed from config.h settings at compile time
+// instead of being edited byte by byte. Every macro ends with a comma and can
+// be chained within an array initializer:
+//
+// __code uint8_t ReportDescr[] = {
+//   HID_USAGE_PAGE(HID_PAGE_DESKTOP) HID_USAGE(0x02) HID_COLLECTION(HID_APPLICATION)
+//   ...
+//   HID_END_COLLECTION
+// };
+//
+// Items with 8-bit and 16-bit data are available (e.g. HID_LOGICAL_MAX and
+// HID_LOGICAL_MAX16), negative values are encoded in two's complement.
+// HID_REPEAT(n, m) expands the function-like macro m() n times (n must expand
+// to a literal 1..10).
+
+#pragma once
+
+// ===================================================================================
+// Usage Pages and Collection Types
+// ===================================================================================
+#define HID_PAGE_DESKTOP        0x01      // Generic Desktop
+#define HID_PAGE_KEYBOARD       0x07      // Keyboard/Keypad
+#define HID_PAGE_LED            0x08      // LEDs
+#define HID_PAGE_CONSUMER       0x0C      // Consumer Devices
+#define HID_PAGE_DIGITIZER      0x0D      // Digitizers
+#define HID_PAGE_VENDOR         0xFF00    // Vendor Defined
+
+#define HID_PHYSICAL            0x00      // collection: physical
+#define HID_APPLICATION         0x01      // collection: application
+#define HID_LOGICAL             0x02      // collection: logical
+
+// Main item data flags
+#define HID_DATA_ARY_ABS        0x00      // data, array, absolute
+#define HID_DATA_VAR_ABS        0x02      // data, variable, absolute
+#define HID_CNST_VAR_ABS        0x03      // constant (padding)
+#define HID_DATA_VAR_REL        0x06      // data, variable, relative
+
+// ===================================================================================
+// Item Encoding
+// ===================================================================================
+#define HID_B0(x)               ((x) & 0xFF)
+#define HID_B1(x)               (((x) >> 8) & 0xFF)
+#define HID_ITEM8(p, x)         (p), HID_B0(x),
+#define HID_ITEM16(p, x)        ((p) + 1), HID_B0(x), HID_B1(x),
+
+// Main items
+#define HID_INPUT(f)            HID_ITEM8(0x81, f)
+#define HID_OUTPUT(f)           HID_ITEM8(0x91, f)
+#define HID_FEATURE(f)          HID_ITEM8(0xB1, f)
+#define HID_COLLECTION(t)       HID_ITEM8(0xA1, t)
+#define HID_END_COLLECTION      0xC0,
+
+// Global items
+#define HID_USAGE_PAGE(x)       HID_ITEM8(0x05, x)
+#define HID_USAGE_PAGE16(x)     HID_ITEM16(0x05, x)
+#define HID_LOGICAL_MIN(x)      HID_ITEM8(0x15, x)
+#define HID_LOGICAL_MIN16(x)    HID_ITEM16(0x15, x)
+#define HID_LOGICAL_MAX(x)      HID_ITEM8(0x25, x)
+#define HID_LOGICAL_MAX16(x)    HID_ITEM16(0x25, x)
+#define HID_PHYSICAL_MIN16(x)   HID_ITEM16(0x35, x)
+#define HID_PHYSICAL_MAX16(x)   HID_ITEM16(0x45, x)
+#define HID_UNIT16(x)           HID_ITEM16(0x65, x)
+#define HID_REPORT_SIZE(x)      HID_ITEM8(0x75, x)
+#define HID_REPORT_ID(x)        HID_ITEM8(0x85, x)
+#define HID_REPORT_COUNT(x)     HID_ITEM8(0x95, x)
+#define HID_REPORT_COUNT16(x)   HID_ITEM16(0x95, x)
+
+// Local items
+#define HID_USAGE(x)            HID_ITEM8(0x09, x)
+#define HID_USAGE_MIN(x)        HID_ITEM8(0x19, x)
+#define HID_USAGE_MAX(x)        HID_ITEM8(0x29, x)
+#define HID_USAGE_MAX16(x)      HID_ITEM16(0x29, x)
+
+// ===================================================================================
+// Repetition
+// ===================================================================================
+#define HID_REPEAT(n, x)        HID_REPEAT_(n, x)
+#define HID_REPEAT_(n, x)       HID_REPEAT_##n(x)
+#define HID_REPEAT_1(x)         x()
+#define HID_REPEAT_2(x)         x() x()
+#define HID_REPEAT_3(x)         HID_REPEAT_2(x) x()
+#define HID_REPEAT_4(x)         HID_REPEAT_3(x) x()
+#define HID_REPEAT_5(x)         HID_REPEAT_4(x) x()
+#define HID_REPEAT_6(x)         HID_REPEAT_5(x) x()
+#define HID_REPEAT_7(x)         HID_REPEAT_6(x) x()
+#define HID_REPEAT_8(x)         HID_REPEAT_7(x) x()
+#define HID_REPEAT_9(x)         HID_REPEAT_8(x) x()
+#define HID_REPEAT_10(x)        HID_REPEAT_9(x) x()
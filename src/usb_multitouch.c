@@ -1,12 +1,401 @@
+// ===================================================================================
+// USB Multitouch Functions for CH551, CH552 and CH554                        * v1.3 *
+// ===================================================================================
+
 #include "usb_multitouch.h"
+#include "timebase.h"
+#include "usb_relay.h"
+
+// ===================================================================================
+// Variables
+// ===================================================================================
+__xdata MT_CONTACT MT_frame[MT_MAX_CONTACTS];   // contacts of the current frame
+__xdata MT_REPORT  MT_report;                   // GET_REPORT buffer
+__xdata uint8_t    MT_frameCount;               // number of contacts in frame
+__xdata MT_CONTACT MT_known[MT_MAX_CONTACTS];   // contact states the host has
+__xdata uint8_t    MT_knownCount;               // number of known contacts
+__bit              MT_keyframeDue;              // keyframe needed after last frame
+__bit              MT_resync;                   // states forgotten, send next frame
+
+__xdata uint8_t    MT_idleRate[HID_ITFS];       // SET_IDLE duration in 4ms units
+__xdata uint16_t   MT_idleStart;                // millisecond of last touch report
+__bit              MT_idleRestart;              // SET_IDLE received, restart period
+__bit              MT_kbdRestart;               // same for the keyboard
+__xdata uint8_t    MT_protocol[HID_ITFS] = {1, 1, 1}; // 0: boot, 1: report protocol
+__xdata uint8_t    MT_controlItf;               // interface of current class request
+uint8_t*           MT_controlSrc;               // GET_REPORT data stage pointer
+
+// ===================================================================================
+// Contact Frame Builder
+// ===================================================================================
+
+// Start a new, empty frame
+void MT_beginFrame(void) {
+  MT_frameCount = 0;
+}
+
+// Append a contact to the frame, returns 0 if the frame is full
+uint8_t MT_addContact(uint8_t id, uint8_t status, uint8_t pressure, uint16_t x, uint16_t y) {
+  __xdata MT_CONTACT* c;
+  if(MT_frameCount >= MT_MAX_CONTACTS) return 0;
+  c = &MT_frame[MT_frameCount++];
+  c->id       = id;
+  c->status   = status;
+  #ifdef MT_PRESSURE
+  c->pressure = pressure;
+  #else
+  pressure;                             // stop unreferenced argument warning
+  #endif
+  c->x        = x;
+  c->y        = y;
+  #ifdef MT_WIDTH_HEIGHT
+  c->width    = MT_CONTACT_WIDTH;
+  c->height   = MT_CONTACT_HEIGHT;
+  #endif
+  return 1;
+}
+
+// Tag used to coalesce a frame in the HID queue: a newer frame may only
+// replace a pending one if the same contacts touch and none lifts (pure
+// movement), so no touch down or lift ever gets lost
+uint8_t MT_frameTag(__xdata MT_CONTACT* c, uint8_t count) {
+  uint8_t i, tag = 0x80;
+  for(i=0; i<count; i++) {
+    if(!(c[i].status & MT_TOUCH)) return HID_TAG_NONE;
+  }
+  #ifdef MT_PARALLEL_MODE
+  if(count > 7) return HID_TAG_NONE;
+  tag |= (1 << count) - 1;
+  #else
+  if(count != 1) return HID_TAG_NONE;
+  tag = (c[0].id & 0x3F) | 0x40;
+  #endif
+  return tag;
+}
+
+// Queue count contacts without waiting, returns 0 if there is no room (try
+// again). Parallel mode sends one report, hybrid mode MT_REPORT_CONTACTS
+// contacts per report with the total contact count in the first report only.
+// Reports are built right in the EP1 buffers of the HID queue. While relay mode
+// is active the frame is dropped as if it was sent.
+uint8_t MT_queueContacts(__xdata MT_CONTACT* c, uint8_t count) {
+  uint8_t i, n, tag;
+  __xdata MT_REPORT* r;
+  __xdata uint8_t* src = (__xdata uint8_t*)c;
+  __xdata uint8_t* dst;
+  uint8_t left = count;
+  uint8_t reports = (left + MT_REPORT_CONTACTS - 1) / MT_REPORT_CONTACTS;
+
+  if(RLY_active) return 1;                  // host drives the touch screen
+  if(!reports) reports = 1;                 // keyframe without contacts
+  if(reports > 1) {
+    if(!HID_holdFrame(reports)) return 0;   // frame must not be split
+    tag = HID_TAG_NONE;
+  }
+  else tag = MT_frameTag(c, count);
+
+  do {
+    r = (__xdata MT_REPORT*)HID_reserveReport();
+    if(!r) {
+      HID_releaseFrame();
+      return 0;
+    }
+    r->reportId = REPORT_ID_TOUCH;
+    r->count = (left == count) ? count : 0;
+    n = left > MT_REPORT_CONTACTS ? MT_REPORT_CONTACTS : left;
+    dst = (__xdata uint8_t*)r->contact;
+    if(n) {
+      IE_USB = 0;                           // HID_copy() shares DPTR1 with the USB ISR
+      HID_copySrc = src;
+      HID_copy(dst, n * sizeof(MT_CONTACT));
+      IE_USB = 1;
+      src += n * sizeof(MT_CONTACT);
+      dst += n * sizeof(MT_CONTACT);
+    }
+    for(i = (MT_REPORT_CONTACTS - n) * sizeof(MT_CONTACT); i; i--) *dst++ = 0;
+    HID_commitReport(sizeof(MT_REPORT), tag);
+    left -= n;
+  } while(left);
+  HID_releaseFrame();
+  MT_idleStart = TB_millis();               // restart idle period
+  return 1;
+}
+
+// Find a contact by id in the known states, returns MT_knownCount if unknown
+uint8_t MT_findKnown(uint8_t id) {
+  uint8_t i;
+  for(i=0; i<MT_knownCount; i++) {
+    if(MT_known[i].id == id) break;
+  }
+  return i;
+}
+
+// Check if two contacts are equal
+uint8_t MT_sameContact(__xdata MT_CONTACT* a, __xdata MT_CONTACT* b) {
+  __xdata uint8_t* pa = (__xdata uint8_t*)a;
+  __xdata uint8_t* pb = (__xdata uint8_t*)b;
+  uint8_t i;
+  for(i=sizeof(MT_CONTACT); i; i--) {
+    if(*pa++ != *pb++) return 0;
+  }
+  return 1;
+}
+
+// Copy a contact
+void MT_copyContact(__xdata MT_CONTACT* dst, __xdata MT_CONTACT* src) {
+  __xdata uint8_t* d = (__xdata uint8_t*)dst;
+  __xdata uint8_t* s = (__xdata uint8_t*)src;
+  uint8_t i;
+  for(i=sizeof(MT_CONTACT); i; i--) *d++ = *s++;
+}
+
+// Queue the frame as a delta to the state the host already has, returns 0 if
+// there is no room (try again). Touching contacts are always sent, the host
+// drops contacts missing from a frame. Lifted contacts are only sent with the
+// lift itself, they are removed from the frame otherwise. Nothing is sent if
+// nothing changed. A touching contact missing from the frame (e.g. its ID
+// changed with a new touch map) is a change as well, the host drops it.
+uint8_t MT_sendFrame(void) {
+  __xdata MT_CONTACT* c = MT_frame;
+  uint8_t i, k, n = 0, changed = MT_resync;
+
+  for(i=0; i<MT_frameCount; i++, c++) {
+    k = MT_findKnown(c->id);
+    if(k < MT_knownCount ? !MT_sameContact(c, &MT_known[k]) : (c->status & MT_TOUCH))
+      changed = 1;
+    else if(!(c->status & MT_TOUCH)) continue;  // lift already known
+    if(n != i) MT_copyContact(&MT_frame[n], c);
+    n++;
+  }
+  MT_frameCount = n;
+  for(k=0; k<MT_knownCount && !changed; k++) {
+    if(!(MT_known[k].status & MT_TOUCH)) continue;
+    for(i=0; i<n && MT_frame[i].id != MT_known[k].id; i++);
+    if(i == n) changed = 1;                     // dropped touching contact
+  }
+  if(!changed) return 1;
+  if(!MT_queueContacts(MT_frame, n)) return 0;
+
+  for(i=0; i<n; i++)                            // host has exactly these now
+    MT_copyContact(&MT_known[i], &MT_frame[i]);
+  MT_knownCount  = n;
+  MT_keyframeDue = 1;
+  MT_resync      = 0;
+  return 1;
+}
+
+// Queue all known contact states (touching and lifted) at once. The lifts
+// have been sent twice then, only the touching contacts stay known.
+uint8_t MT_sendKeyframe(void) {
+  uint8_t i, n = 0;
+  if(!MT_queueContacts(MT_known, MT_knownCount)) return 0;
+  for(i=0; i<MT_knownCount; i++) {
+    if(!(MT_known[i].status & MT_TOUCH)) continue;
+    if(n != i) MT_copyContact(&MT_known[n], &MT_known[i]);
+    n++;
+  }
+  MT_knownCount  = n;
+  MT_keyframeDue = n;                           // repeat while touching
+  return 1;
+}
 
+// Forget all contact states (new touch map), the next frame is sent even if
+// nothing touches and drops every contact the host still has
+void MT_forget(void) {
+  MT_knownCount = 0;
+  MT_resync     = 1;
+}
+
+// ===================================================================================
+// Idle Rate
+// ===================================================================================
+// Send a keyframe with the full contact state if nothing was sent for the
+// SET_IDLE duration, or for MT_KEYFRAME_MS while a contact touches and once
+// more after the last lift, so the host never keeps a stale contact. The last
+// keyboard report (still in EP3_buffer) is repeated at the keyboard idle rate.
+void MT_idle(void) {
+  if(MT_idleRestart) {
+    MT_idleRestart = 0;
+    MT_idleStart   = TB_millis();
+  }
+  if(MT_kbdRestart) {
+    MT_kbdRestart = 0;
+    HID_kbdStart  = TB_millis();
+  }
+  if(MT_idleRate[HID_ITF_KEYBOARD] && !HID_kbdBusyFlag &&
+     TB_elapsed(HID_kbdStart, (uint16_t)MT_idleRate[HID_ITF_KEYBOARD] << 2))
+    HID_commitKeyboard();               // restarts the keyboard idle period
+  if(HID_queueDepth()) return;
+  if(MT_idleRate[HID_ITF_TOUCH] &&
+     TB_elapsed(MT_idleStart, (uint16_t)MT_idleRate[HID_ITF_TOUCH] << 2)) {
+    MT_sendKeyframe();                  // restarts the idle period
+    return;
+  }
+  #if MT_KEYFRAME_MS
+  if(MT_keyframeDue && TB_elapsed(MT_idleStart, MT_KEYFRAME_MS)) MT_sendKeyframe();
+  #endif
+}
+
+// ===================================================================================
+// HID Class Requests
+// ===================================================================================
+
+// Certification status blob for Windows (Microsoft sample blob), first byte is
+// the report ID so it can be streamed as is
+__code uint8_t MT_thqaReport[257] = {
+  REPORT_ID_THQA,
+  0xfc, 0x28, 0xfe, 0x84, 0x40, 0xcb, 0x9a, 0x87, 0x0d, 0xbe, 0x57, 0x3c,
+  0xb6, 0x70, 0x09, 0x88, 0x07, 0x97, 0x2d, 0x2b, 0xe3, 0x38, 0x34, 0xb6,
+  0x6c, 0xed, 0xb0, 0xf7, 0xe5, 0x9c, 0xf6, 0xc2, 0x2e, 0x84, 0x1b, 0xe8,
+  0xb4, 0x51, 0x78, 0x43, 0x1f, 0x28, 0x4b, 0x7c, 0x2d, 0x53, 0xaf, 0xfc,
+  0x47, 0x70, 0x1b, 0x59, 0x6f, 0x74, 0x43, 0xc4, 0xf3, 0x47, 0x18, 0x53,
+  0x1a, 0xa2, 0xa1, 0x71, 0xc7, 0x95, 0x0e, 0x31, 0x55, 0x21, 0xd3, 0xb5,
+  0x1e, 0xe9, 0x0c, 0xba, 0xec, 0xb8, 0x89, 0x19, 0x3e, 0xb3, 0xaf, 0x75,
+  0x81, 0x9d, 0x53, 0xb9, 0x41, 0x57, 0xf4, 0x6d, 0x39, 0x25, 0x29, 0x7c,
+  0x87, 0xd9, 0xb4, 0x98, 0x45, 0x7d, 0xa7, 0x26, 0x9c, 0x65, 0x3b, 0x85,
+  0x68, 0x89, 0xd7, 0x3b, 0xbd, 0xff, 0x14, 0x67, 0xf2, 0x2b, 0xf0, 0x2a,
+  0x41, 0x54, 0xf0, 0xfd, 0x2c, 0x66, 0x7c, 0xf8, 0xc0, 0x8f, 0x33, 0x13,
+  0x03, 0xf1, 0xd3, 0xc1, 0x0b, 0x89, 0xd9, 0x1b, 0x62, 0xcd, 0x51, 0xb7,
+  0x80, 0xb8, 0xaf, 0x3a, 0x10, 0xc1, 0x8a, 0x5b, 0xe8, 0x8a, 0x56, 0xf0,
+  0x8c, 0xaa, 0xfa, 0x35, 0xe9, 0x42, 0xc4, 0xd8, 0x55, 0xc3, 0x38, 0xcc,
+  0x2b, 0x53, 0x5c, 0x69, 0x52, 0xd5, 0xc8, 0x73, 0x02, 0x38, 0x7c, 0x73,
+  0xb6, 0x41, 0xe7, 0xff, 0x05, 0xd8, 0x2b, 0x79, 0x9a, 0xe2, 0x34, 0x60,
+  0x8f, 0xa3, 0x32, 0x1f, 0x09, 0x78, 0x62, 0xbc, 0x80, 0xe3, 0x0f, 0xbd,
+  0x65, 0x20, 0x08, 0x13, 0xc1, 0xe2, 0xee, 0x53, 0x2d, 0x86, 0x7e, 0xa7,
+  0x5a, 0xc5, 0xd3, 0x7d, 0x98, 0xbe, 0x31, 0x48, 0x1f, 0xfb, 0xda, 0xaf,
+  0xa2, 0xa8, 0x6a, 0x89, 0xd6, 0xbf, 0xf2, 0xd3, 0x32, 0x2a, 0x9a, 0xe4,
+  0xcf, 0x17, 0xb7, 0xb8, 0xf4, 0xe1, 0x33, 0x08, 0x24, 0x8b, 0xc4, 0x43,
+  0xa5, 0xe5, 0x24, 0xc2
+};
+
+__code uint8_t MT_maxCountReport[2] = {REPORT_ID_MAX_COUNT, MT_MAX_CONTACTS};
+__code uint8_t MT_wheelReport[WHEEL_REPORT_SIZE] = {REPORT_ID_WHEEL, 0, 0, 0};
+__code uint8_t MT_consumerReport[CONSUMER_REPORT_SIZE] = {REPORT_ID_CONSUMER, 0, 0};
+
+// Copy next packet of a GET_REPORT data stage to EP0
+#pragma save
+#pragma nooverlay
+uint8_t MT_controlCopy(void) {
+  uint8_t i, len;
+  len = USB_SetupLen >= EP0_SIZE ? EP0_SIZE : USB_SetupLen;
+  for(i=0; i<len; i++) EP0_buffer[i] = *MT_controlSrc++;
+  return len;
+}
+#pragma restore
+
+// Start a GET_REPORT data stage (report may span several packets)
+uint8_t MT_controlStart(uint8_t* src, uint16_t len) {
+  MT_controlSrc = src;
+  if(USB_SetupLen > len) USB_SetupLen = len;    // limit length
+  return MT_controlCopy();
+}
+
+// Build the touch input report for GET_REPORT from the contact states the
+// host has (the sent reports live in the HID queue, which is reused)
+#pragma save
+#pragma nooverlay
+void MT_getTouchReport(void) {
+  __xdata uint8_t* src = (__xdata uint8_t*)MT_known;
+  __xdata uint8_t* dst = (__xdata uint8_t*)MT_report.contact;
+  uint8_t i, n = MT_knownCount;
+
+  if(n > MT_REPORT_CONTACTS) n = MT_REPORT_CONTACTS;
+  MT_report.reportId = REPORT_ID_TOUCH;
+  MT_report.count    = n;
+  for(i = n * sizeof(MT_CONTACT); i; i--) *dst++ = *src++;
+  for(i = (MT_REPORT_CONTACTS - n) * sizeof(MT_CONTACT); i; i--) *dst++ = 0;
+}
+#pragma restore
+
+// Class SETUP handler, wIndex selects the interface
 uint8_t MT_control(void) {
+  uint8_t type = USB_SetupBuf->wValueH;         // report type or idle duration
+  uint8_t id   = USB_SetupBuf->wValueL;         // report ID or protocol
+  uint8_t itf  = USB_SetupBuf->wIndexL;         // interface
+
+  if(itf >= HID_ITFS) return 0xff;              // no such interface
+  MT_controlItf = itf;
+
   switch(USB_SetupReq) {
     case HID_GET_REPORT:
-        EP0_buffer[0] = 10; // 10 fingers max
-        return 1;
+      if(type == HID_REPORT_INPUT) {
+        if(itf == HID_ITF_TOUCH && id == REPORT_ID_TOUCH) {
+          MT_getTouchReport();
+          return MT_controlStart((uint8_t*)&MT_report, sizeof(MT_report));
+        }
+        if(itf == HID_ITF_KEYBOARD && !id)      // last report sent on EP3
+          return MT_controlStart((uint8_t*)EP3_buffer, KBD_REPORT_SIZE);
+        if(itf == HID_ITF_CONSUMER && id == REPORT_ID_WHEEL)
+          return MT_controlStart((uint8_t*)MT_wheelReport, sizeof(MT_wheelReport));
+        if(itf == HID_ITF_CONSUMER && id == REPORT_ID_CONSUMER)
+          return MT_controlStart((uint8_t*)MT_consumerReport, sizeof(MT_consumerReport));
+      }
+      else if(type == HID_REPORT_FEATURE && itf == HID_ITF_TOUCH) {
+        if(id == REPORT_ID_MAX_COUNT)
+          return MT_controlStart((uint8_t*)MT_maxCountReport, sizeof(MT_maxCountReport));
+        if(id == REPORT_ID_THQA)
+          return MT_controlStart((uint8_t*)MT_thqaReport, sizeof(MT_thqaReport));
+      }
+      return 0xff;                              // unknown report
+
+    case HID_SET_REPORT:
+      if(type != HID_REPORT_OUTPUT && type != HID_REPORT_FEATURE) return 0xff;
+      return 0;                                 // data stage in MT_controlOut()
+
+    case HID_GET_IDLE:
+      EP0_buffer[0] = MT_idleRate[itf];
+      if(USB_SetupLen > 1) USB_SetupLen = 1;
+      return USB_SetupLen;
+
+    case HID_SET_IDLE:
+      if(itf == HID_ITF_CONSUMER) return 0;     // wheel is relative, nothing to repeat
+      if(!id || id == REPORT_ID_TOUCH) {
+        MT_idleRate[itf] = type;                // duration in 4ms units, 0: infinite
+        if(itf == HID_ITF_TOUCH) MT_idleRestart = 1;
+        else MT_kbdRestart = 1;
+      }
+      return 0;
+
+    case HID_GET_PROTOCOL:
+      EP0_buffer[0] = MT_protocol[itf];
+      if(USB_SetupLen > 1) USB_SetupLen = 1;
+      return USB_SetupLen;
+
+    case HID_SET_PROTOCOL:
+      MT_protocol[itf] = id;                    // boot keyboard layout is the report layout
+      return 0;
 
     default:
-      return 0xff;                       // failed
+      return 0xff;                              // failed
+  }
+}
+
+// Class IN handler (GET_REPORT data stage or status stage of a class write)
+#pragma save
+#pragma nooverlay
+void MT_controlIn(void) {
+  uint8_t len;
+  if(USB_SetupReq == HID_GET_REPORT) {
+    len = MT_controlCopy();
+    USB_SetupLen -= len;
+    UEP0_T_LEN    = len;
+    UEP0_CTRL    ^= bUEP_T_TOG;                 // switch between DATA0 and DATA1
+  }
+  else UEP0_CTRL = bUEP_R_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
+}
+
+// Class OUT handler (SET_REPORT data stage or status stage of a class read)
+// The keyboard LED report has no report ID, its only byte is the LED state.
+void MT_controlOut(void) {
+  if((USB_SetupReq == HID_SET_REPORT) && U_TOG_OK) {
+    if(MT_controlItf == HID_ITF_KEYBOARD) {
+      if(USB_RX_LEN) HID_kbdLeds = EP0_buffer[0];
+    }
+    #ifdef MT_SET_REPORT_callback
+    else MT_SET_REPORT_callback(EP0_buffer, USB_RX_LEN);
+    #endif
   }
-}
\ No newline at end of file
+  UEP0_T_LEN = 0;
+  UEP0_CTRL  = bUEP_T_TOG | UEP_T_RES_ACK | UEP_R_RES_ACK;
+}
+#pragma restore
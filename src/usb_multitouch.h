@@ -1,4 +1,90 @@
+// ===================================================================================
+// USB Multitouch Functions for CH551, CH552 and CH554                        * v1.3 *
+// ===================================================================================
+//
+// Contact frame builder for the touch screen report. All contacts of a scan are
+// collected into one frame which is then sent as a single report in parallel
+// mode (MT_PARALLEL_MODE) or as one report per contact in hybrid mode.
+//
+// Functions available:
+// --------------------
+// MT_beginFrame()          start a new, empty contact frame
+// MT_addContact(id, status, pressure, x, y)
+//                          append a contact to the frame (status: MT_TOUCH or MT_LIFT)
+// MT_sendFrame()           queue the changes of the frame (returns 0 if queue is full)
+// MT_sendKeyframe()        queue the full state of all known contacts
+// MT_forget()              forget the contact states the host has (new touch map)
+// MT_queueContacts(c, n)   queue n contacts as they are, without delta (returns 0
+//                          if queue is full)
+// MT_idle()                send keyframes (SET_IDLE period, MT_KEYFRAME_MS) and
+//                          repeat the keyboard report (keyboard SET_IDLE period)
+//
+// Frames are sent as deltas to the contact states the host already has (the
+// HID queue never drops a report it accepted). Touching contacts are part of
+// every frame, because hosts drop contacts that are missing from a frame, but
+// a lifted contact is only sent once, and a frame without any change is not
+// sent at all. Keyframes repeat the full state so the host can never keep a
+// stale touching contact.
+//
+// HID class requests of all interfaces (MT_control, MT_controlIn, MT_controlOut):
+// GET_REPORT input (touch, keyboard, consumer, wheel) and feature (contact count
+// maximum, THQA certification blob, sent in several packets), SET_REPORT
+// (keyboard LEDs), GET/SET_IDLE and GET/SET_PROTOCOL per interface.
+//
+// The following must be defined in config.h:
+// MT_MAX_CONTACTS          - maximum number of contacts per frame
+// MT_PARALLEL_MODE         - (optional) send all contacts in one report
+// MT_LOGICAL_MAX           - coordinate range (1..32767)
+// MT_PRESSURE              - (optional) report contact pressure
+// MT_WIDTH_HEIGHT          - (optional) report contact width/height
+// MT_CONTACT_WIDTH/HEIGHT  - contact size in logical units (with MT_WIDTH_HEIGHT)
+// MT_KEYFRAME_MS           - keyframe interval while touching in ms (0: SET_IDLE only)
+//
+// The idle rate is timed by the timer2 timebase (TB_init() must have been called).
+
 #pragma once
 #include <stdint.h>
 #include "usb_hid.h"
-#include "usb_handler.h"
\ No newline at end of file
+#include "usb_handler.h"
+
+// ===================================================================================
+// Contact and Report Structures
+// ===================================================================================
+#define MT_LIFT         0x00            // contact lifted (not in range)
+#define MT_TOUCH        0x03            // tip switch and in range
+
+// Field order and presence must match MT_FINGER_COLLECTION in usb_descr.c
+typedef struct _MT_CONTACT {
+  uint8_t  id;                          // contact identifier
+  uint8_t  status;                      // bit 0: tip switch, bit 1: in range
+  #ifdef MT_PRESSURE
+  uint8_t  pressure;                    // pressure (0..127)
+  #endif
+  uint16_t x;                           // x coordinate (0..MT_LOGICAL_MAX)
+  uint16_t y;                           // y coordinate (0..MT_LOGICAL_MAX)
+  #ifdef MT_WIDTH_HEIGHT
+  uint16_t width;                       // contact width (MT_CONTACT_WIDTH)
+  uint16_t height;                      // contact height (MT_CONTACT_HEIGHT)
+  #endif
+} MT_CONTACT;
+
+typedef struct _MT_REPORT {
+  uint8_t    reportId;                  // REPORT_ID_TOUCH
+  uint8_t    count;                     // number of valid contacts
+  MT_CONTACT contact[MT_REPORT_CONTACTS];
+} MT_REPORT;
+
+// Compile-time check that the structs match the report descriptor
+typedef char MT_contactSizeCheck[(sizeof(MT_CONTACT) == MT_CONTACT_SIZE) ? 1 : -1];
+typedef char MT_reportSizeCheck[(sizeof(MT_REPORT) == MT_REPORT_SIZE) ? 1 : -1];
+
+// ===================================================================================
+// Functions
+// ===================================================================================
+void MT_beginFrame(void);
+uint8_t MT_addContact(uint8_t id, uint8_t status, uint8_t pressure, uint16_t x, uint16_t y);
+uint8_t MT_sendFrame(void);
+uint8_t MT_sendKeyframe(void);
+void MT_forget(void);                   // next frame drops all host contacts
+uint8_t MT_queueContacts(__xdata MT_CONTACT* c, uint8_t count); // queue contacts as is
+void MT_idle(void);
@@ -0,0 +1,126 @@
+// ===================================================================================
+// USB Touch Relay for CH551, CH552 and CH554                                 * v1.0 *
+// ===================================================================================
+
+#include "usb_relay.h"
+#include "usb_multitouch.h"
+#include "timebase.h"
+#include "screen.h"
+
+#ifdef RELAY_ENABLE
+
+// ===================================================================================
+// Variables
+// ===================================================================================
+volatile __bit     RLY_active;                  // relay mode active
+volatile __bit     RLY_release;                 // lift relayed contacts
+__xdata RLY_STATS  RLY_stats;                   // relay statistics
+__xdata uint16_t   RLY_lastMs;                  // millisecond of the last frame
+__xdata MT_CONTACT RLY_contact[MT_MAX_CONTACTS]; // contacts of the last frame
+__xdata uint8_t    RLY_count;                   // number of contacts in last frame
+
+#if RLY_REPORT_SIZE > EP2_SIZE
+  #error Relay report does not fit into EP2_SIZE!
+#endif
+
+// ===================================================================================
+// EP2 OUT Handler
+// ===================================================================================
+// Parse a relay frame and queue it as touch report(s) right away. Frames that
+// do not fit into the queue as a whole are dropped.
+#pragma save
+#pragma nooverlay
+void RLY_EP2_OUT(void) {
+  __xdata uint8_t*    src = EP2_buffer;
+  __xdata uint8_t*    dst;
+  __xdata MT_CONTACT* c;
+  uint8_t  i, n, count, left, reports;
+  uint16_t v;
+
+  if(!U_TOG_OK) return;                         // out of sync packet, ignore
+  count = src[2] & RLY_COUNT_MASK;
+  if( (src[0] != REPORT_ID_RELAY) || (count > MT_MAX_CONTACTS)
+   || (USB_RX_LEN < 3 + count * RLY_CONTACT_SIZE) ) {
+    RLY_stats.errors++;
+    return;
+  }
+  if(RLY_active && (src[1] != (uint8_t)(RLY_stats.seq + 1)))
+    RLY_stats.gaps += (uint8_t)(src[1] - RLY_stats.seq - 1);
+  RLY_stats.seq = src[1];
+  RLY_lastMs    = TB_ms;
+  RLY_active    = 1;                            // local contacts stop here
+  if(src[2] & RLY_END) {
+    RLY_active  = 0;
+    RLY_release = 1;
+  }
+
+  // Convert contacts
+  src += 3;
+  c = RLY_contact;
+  for(i=0; i<count; i++, c++, src+=RLY_CONTACT_SIZE) {
+    c->id     = src[0];
+    c->status = (src[1] & RLY_TOUCH) ? MT_TOUCH : MT_LIFT;
+    if(src[1] & RLY_PIXELS) {
+      SCR_map(src[2] | ((uint16_t)src[3] << 8), src[4] | ((uint16_t)src[5] << 8));
+      c->x    = SCR_x;
+      c->y    = SCR_y;
+    }
+    else {
+      v = src[2] | ((uint16_t)src[3] << 8);
+      c->x    = v > MT_LOGICAL_MAX ? MT_LOGICAL_MAX : v;
+      v = src[4] | ((uint16_t)src[5] << 8);
+      c->y    = v > MT_LOGICAL_MAX ? MT_LOGICAL_MAX : v;
+    }
+    #ifdef MT_PRESSURE
+    c->pressure = src[6];
+    #endif
+    #ifdef MT_WIDTH_HEIGHT
+    c->width  = MT_CONTACT_WIDTH;
+    c->height = MT_CONTACT_HEIGHT;
+    #endif
+  }
+  RLY_count = count;
+
+  // Queue the frame, the main loop must not be building a report or frame now
+  reports = count ? (count + MT_REPORT_CONTACTS - 1) / MT_REPORT_CONTACTS : 1;
+  if( HID_reserved || HID_frameHeld
+   || ((uint8_t)(HID_queueHead - HID_queueTail) > HID_QUEUE_SIZE - reports) ) {
+    RLY_stats.overruns++;
+    return;
+  }
+  src  = (__xdata uint8_t*)RLY_contact;
+  left = count;
+  do {
+    dst = HID_reserveReport();
+    *dst++ = REPORT_ID_TOUCH;
+    *dst++ = (left == count) ? count : 0;
+    n = left > MT_REPORT_CONTACTS ? MT_REPORT_CONTACTS : left;
+    for(i = n * sizeof(MT_CONTACT); i; i--) *dst++ = *src++;
+    for(i = (MT_REPORT_CONTACTS - n) * sizeof(MT_CONTACT); i; i--) *dst++ = 0;
+    HID_commitReport(sizeof(MT_REPORT), HID_TAG_NONE);
+    left -= n;
+  } while(left);
+  RLY_stats.frames++;
+}
+#pragma restore
+
+// ===================================================================================
+// Leave Relay Mode
+// ===================================================================================
+// Lift the contacts of the last relayed frame after RLY_END or a timeout, the
+// local contacts are sent again by the next keyframe
+void RLY_poll(void) {
+  uint8_t i;
+
+  IE_USB = 0;
+  if(RLY_active && TB_elapsed(RLY_lastMs, RELAY_TIMEOUT_MS)) {
+    RLY_active  = 0;
+    RLY_release = 1;
+  }
+  IE_USB = 1;
+  if(!RLY_release || RLY_active) return;
+  for(i=0; i<RLY_count; i++) RLY_contact[i].status = MT_LIFT;
+  if(MT_queueContacts(RLY_contact, RLY_count)) RLY_release = 0;
+}
+
+#endif // RELAY_ENABLE
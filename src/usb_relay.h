@@ -0,0 +1,68 @@
+// ===================================================================================
+// USB Touch Relay for CH551, CH552 and CH554                                 * v1.0 *
+// ===================================================================================
+//
+// Relay mode lets a host drive the touch screen interface: contact frames
+// written as output report REPORT_ID_RELAY to EP2 OUT are parsed by the EP2 OUT
+// handler and forwarded straight into the EP1 IN queue from the interrupt, the
+// main loop is not involved. A frame is sent to the touch host within the next
+// poll if EP1 is idle.
+//
+// Output report (RLY_REPORT_SIZE bytes, unused contacts are ignored):
+// -------------------------------------------------------------------
+// byte 0       REPORT_ID_RELAY
+// byte 1       sequence number, incremented by one per frame
+// byte 2       bits 0..3: number of contacts, bit 7: RLY_END (leave relay mode
+//              after this frame)
+// byte 3..     contacts, RLY_CONTACT_SIZE bytes each: id, flags (bit 0: RLY_TOUCH,
+//              bit 1: RLY_PIXELS), x (LE), y (LE), pressure
+//
+// Coordinates are logical (0..MT_LOGICAL_MAX), or screen pixels of the selected
+// display profile with RLY_PIXELS (see screen.h).
+//
+// The first frame starts relay mode, the local keys and gestures are not
+// reported while it is active. It ends with RLY_END or when no frame arrived for
+// RELAY_TIMEOUT_MS. Contacts of the last relayed frame are then lifted and the
+// local contacts are reported again by the next keyframe.
+//
+// Frames are counted in RLY_stats (readable by vendor request VEN_GET_RELAY):
+// frames forwarded, sequence numbers skipped (gaps), frames dropped because the
+// queue was full or in use by the main loop (overruns) and malformed frames.
+//
+// Functions available:
+// --------------------
+// RLY_poll()               end relay mode after a timeout, call from main loop
+// RLY_active               set while relay mode is active
+// RLY_stats                relay statistics
+//
+// The following must be defined in config.h:
+// RELAY_ENABLE             - (optional) enable relay mode
+// RELAY_TIMEOUT_MS         - leave relay mode without frames for this long
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#define RLY_TOUCH         0x01          // contact flags: touching
+#define RLY_PIXELS        0x02          // contact flags: x/y are screen pixels
+#define RLY_END           0x80          // frame header: leave relay mode
+#define RLY_COUNT_MASK    0x0F          // frame header: number of contacts
+
+typedef struct _RLY_STATS {
+  uint16_t frames;                      // frames received and forwarded
+  uint16_t gaps;                        // sequence numbers missed
+  uint16_t overruns;                    // frames dropped, no room in the queue
+  uint16_t errors;                      // malformed frames
+  uint8_t  seq;                         // last sequence number
+} RLY_STATS;
+
+#ifdef RELAY_ENABLE
+extern volatile __bit RLY_active;       // relay mode active
+extern __xdata RLY_STATS RLY_stats;     // relay statistics
+
+void RLY_poll(void);                    // leave relay mode after a timeout
+void RLY_EP2_OUT(void);                 // EP2 OUT handler
+#else
+#define RLY_active        0
+#define RLY_poll()
+#endif
@@ -0,0 +1,250 @@
+// ===================================================================================
+// USB Vendor Requests for CH551, CH552 and CH554                             * v1.1 *
+// ===================================================================================
+
+#include "usb_vendor.h"
+#include "touchmap.h"
+#include "macro.h"
+#include "screen.h"
+#include "perf.h"
+#include "usb_relay.h"
+#include "scan.h"
+#include "timebase.h"
+#include "supervisor.h"
+#include "system.h"
+
+// ===================================================================================
+// Variables
+// ===================================================================================
+uint8_t*          VEN_ptr;              // data stage pointer
+__xdata uint8_t   VEN_left;             // bytes left to receive in OUT data stage
+__code uint8_t*   VEN_crcPtr;           // next byte to add to the CRC
+volatile uint16_t VEN_crcLeft;          // bytes left to add to the CRC
+__xdata uint16_t  VEN_crc;              // CRC16 accumulator
+__xdata uint8_t   VEN_reply[3];         // small IN replies
+volatile __bit    VEN_bootPending;      // enter bootloader from main loop
+
+#define VEN_CRC_CHUNK   32              // bytes per VEN_poll() call
+
+void VEN_detach(void);
+void VEN_boot(void);
+
+#ifdef MT_PARALLEL_MODE
+  #define VEN_INFO_PARALLEL   0x01
+#else
+  #define VEN_INFO_PARALLEL   0x00
+#endif
+#ifdef PERF_ENABLE
+  #define VEN_INFO_PERF       0x02
+#else
+  #define VEN_INFO_PERF       0x00
+#endif
+#ifdef HID_COALESCE
+  #define VEN_INFO_COALESCE   0x04
+#else
+  #define VEN_INFO_COALESCE   0x00
+#endif
+#ifdef RELAY_ENABLE
+  #define VEN_INFO_RELAY      0x08
+#else
+  #define VEN_INFO_RELAY      0x00
+#endif
+
+__code uint8_t VEN_info[9] = {
+  0x02,                                 // version of this block
+  VEN_INFO_PARALLEL | VEN_INFO_PERF | VEN_INFO_COALESCE | VEN_INFO_RELAY,
+  USB_POLL_INTERVAL,
+  F_CPU / 1000000,
+  (uint8_t)SCAN_RATE_HZ, (uint8_t)(SCAN_RATE_HZ >> 8),
+  SCAN_DEBOUNCE,
+  MT_REPORT_CONTACTS,
+  MT_CONTACT_SIZE
+};
+
+// ===================================================================================
+// Vendor Requests
+// ===================================================================================
+
+// Copy next packet of an IN data stage to EP0
+#pragma save
+#pragma nooverlay
+uint8_t VEN_copy(void) {
+  uint8_t i, len;
+  len = USB_SetupLen >= EP0_SIZE ? EP0_SIZE : USB_SetupLen;
+  for(i=0; i<len; i++) EP0_buffer[i] = *VEN_ptr++;
+  return len;
+}
+#pragma restore
+
+// Start an IN data stage
+uint8_t VEN_startIn(uint8_t* src, uint16_t len) {
+  VEN_ptr = src;
+  if(USB_SetupLen > len) USB_SetupLen = len;    // limit length
+  return VEN_copy();
+}
+
+// Vendor SETUP handler
+uint8_t VEN_control(void) {
+  uint8_t i;
+  switch(USB_SetupReq) {
+    case VEN_GET_MAP:
+      return VEN_startIn((uint8_t*)&MAP_data, sizeof(MAP_data));
+
+    case VEN_SET_MAP:                           // keys only or keys and gestures
+      if(MAP_busy()) return 0xff;
+      if((USB_SetupLen != sizeof(MAP_table)) && (USB_SetupLen != sizeof(MAP_data)))
+        return 0xff;
+      for(i=0; i<sizeof(MAP_data); i++)         // keep what is not sent
+        ((__xdata uint8_t*)&MAP_staging)[i] = ((__xdata uint8_t*)&MAP_data)[i];
+      VEN_ptr  = (uint8_t*)&MAP_staging;
+      VEN_left = USB_SetupLen;
+      return 0;                                 // data stage in VEN_controlOut()
+
+    case VEN_RESET_MAP:
+      return MAP_request(1) ? 0 : 0xff;
+
+    case VEN_GET_STATUS:
+      EP0_buffer[0] = (MAP_busy() ? 0x01 : 0x00) | (VEN_crcLeft ? 0x02 : 0x00)
+                    | (MAC_busy() ? 0x04 : 0x00);
+      if(USB_SetupLen > 1) USB_SetupLen = 1;
+      return USB_SetupLen;
+
+    case VEN_START_CRC:
+      if(VEN_crcLeft) return 0xff;              // still busy
+      VEN_crcPtr  = (__code uint8_t*)(((uint16_t)USB_SetupBuf->wValueH << 8)
+                                    | USB_SetupBuf->wValueL);
+      VEN_crc     = 0xFFFF;
+      VEN_crcLeft = ((uint16_t)USB_SetupBuf->wIndexH << 8) | USB_SetupBuf->wIndexL;
+      return 0;
+
+    case VEN_GET_CRC:
+      VEN_reply[0] = VEN_crcLeft ? 0x01 : 0x00;
+      VEN_reply[1] = (uint8_t)VEN_crc;
+      VEN_reply[2] = (uint8_t)(VEN_crc >> 8);
+      return VEN_startIn((uint8_t*)VEN_reply, 3);
+
+    case VEN_BOOT:
+      VEN_bootPending = 1;
+      return 0;
+
+    case VEN_GET_PERF:
+      return VEN_startIn((uint8_t*)&PERF_stats, sizeof(PERF_stats));
+
+    case VEN_RESET_PERF:
+      PERF_reset();
+      return 0;
+
+    case VEN_SELF_TEST:
+      if(USB_SetupBuf->wValueL >= SCAN_KEYS) return 0xff;
+      SCAN_force(USB_SetupBuf->wValueL, USB_SetupBuf->wValueH);
+      return 0;
+
+    case VEN_GET_INFO:
+      return VEN_startIn((uint8_t*)VEN_info, sizeof(VEN_info));
+
+    #ifdef RELAY_ENABLE
+    case VEN_GET_RELAY:
+      return VEN_startIn((uint8_t*)&RLY_stats, sizeof(RLY_stats));
+    #endif
+
+    case VEN_GET_SCREEN:
+      VEN_reply[0] = SCR_selected;
+      VEN_reply[1] = SCR_profiles();
+      return VEN_startIn((uint8_t*)VEN_reply, 2);
+
+    case VEN_SET_SCREEN:
+      return SCR_select(USB_SetupBuf->wValueL) ? 0 : 0xff;
+
+    #ifdef MACRO_ENABLE
+    case VEN_GET_MACRO:
+      return VEN_startIn((uint8_t*)&MAC_data, sizeof(MAC_data));
+
+    case VEN_SET_MACRO:
+      if(MAC_busy() || (USB_SetupLen != sizeof(MAC_data))) return 0xff;
+      VEN_ptr  = (uint8_t*)&MAC_staging;
+      VEN_left = USB_SetupLen;
+      return 0;                                 // data stage in VEN_controlOut()
+
+    case VEN_RESET_MACRO:
+      return MAC_request(1) ? 0 : 0xff;
+    #endif
+
+    default:
+      return 0xff;                              // unsupported request
+  }
+}
+
+// Vendor IN handler (data stage of a read or status stage of a write)
+#pragma save
+#pragma nooverlay
+void VEN_controlIn(void) {
+  uint8_t len;
+  if((USB_SetupReq == VEN_GET_MAP)  || (USB_SetupReq == VEN_GET_CRC)
+  || (USB_SetupReq == VEN_GET_PERF) || (USB_SetupReq == VEN_GET_INFO)
+  || (USB_SetupReq == VEN_GET_RELAY) || (USB_SetupReq == VEN_GET_MACRO)
+  || (USB_SetupReq == VEN_GET_SCREEN)) {
+    len = VEN_copy();
+    USB_SetupLen -= len;
+    UEP0_T_LEN    = len;
+    UEP0_CTRL    ^= bUEP_T_TOG;                 // switch between DATA0 and DATA1
+  }
+  else UEP0_CTRL = bUEP_R_TOG | UEP_T_RES_NAK | UEP_R_RES_ACK;
+}
+
+// Vendor OUT handler (data stage of a write or status stage of a read)
+void VEN_controlOut(void) {
+  uint8_t i, len;
+  if(((USB_SetupReq == VEN_SET_MAP) || (USB_SetupReq == VEN_SET_MACRO)) && VEN_left) {
+    if(U_TOG_OK) {
+      len = USB_RX_LEN > VEN_left ? VEN_left : USB_RX_LEN;
+      for(i=0; i<len; i++) *VEN_ptr++ = EP0_buffer[i];
+      VEN_left -= len;
+      if(!VEN_left) {                           // complete -> hand over
+        if(USB_SetupReq == VEN_SET_MAP) MAP_request(0);
+        else MAC_request(0);
+      }
+      UEP0_CTRL ^= bUEP_R_TOG;                  // expect next data toggle
+    }
+    return;
+  }
+  UEP0_T_LEN = 0;
+  UEP0_CTRL  = bUEP_T_TOG | UEP_T_RES_ACK | UEP_R_RES_ACK;
+}
+#pragma restore
+
+// ===================================================================================
+// Pending Work (called from the main loop)
+// ===================================================================================
+void VEN_poll(void) {
+  uint8_t i, n;
+
+  if(VEN_crcLeft) {
+    n = VEN_crcLeft > VEN_CRC_CHUNK ? VEN_CRC_CHUNK : VEN_crcLeft;
+    while(n--) {
+      VEN_crc ^= (uint16_t)(*VEN_crcPtr++) << 8;
+      for(i=8; i; i--) {
+        if(VEN_crc & 0x8000) VEN_crc = (VEN_crc << 1) ^ 0x1021;
+        else VEN_crc <<= 1;
+      }
+      VEN_crcLeft--;
+    }
+  }
+
+  if(VEN_bootPending) {
+    VEN_bootPending = 0;
+    TB_start(TB_TMR_VENDOR, 5 + 1, 0, VEN_detach); // let the status stage finish
+  }
+}
+
+// Bootloader entry, run by the vendor timer. Interrupts keep running until
+// VEN_boot(), the vendor timer depends on them.
+void VEN_detach(void) {
+  SUP_stop();                                   // no watchdog in the bootloader
+  USB_CTRL &= ~bUC_DEV_PU_EN;                   // detach from USB
+  TB_start(TB_TMR_VENDOR, 100 + 1, 0, VEN_boot);  // give the host time to notice
+}
+
+void VEN_boot(void) {
+  BOOT_prepare();
+  BOOT_now();                                   // enter bootloader
+}
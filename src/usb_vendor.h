@@ -0,0 +1,81 @@
+// ===================================================================================
+// USB Vendor Requests for CH551, CH552 and CH554                             * v1.1 *
+// ===================================================================================
+//
+// Vendor specific control requests on EP0 (bmRequestType 0xC0 for IN, 0x40 for
+// OUT, recipient device) used to configure the device at runtime.
+//
+// Requests:
+// ---------
+// VEN_GET_MAP      IN   read the touch map (MAP_KEYS * 6 bytes key entries, then
+//                       MAP_GESTURES * 7 bytes gestures)
+// VEN_SET_MAP      OUT  write the touch map (key entries only or key entries and
+//                       gestures), applied and saved to data flash by the main
+//                       loop (STALL while the last one is in progress)
+// VEN_RESET_MAP    OUT  restore and save the default touch map (no data)
+// VEN_GET_STATUS   IN   1 byte: bit 0 = touch map update in progress,
+//                       bit 1 = CRC calculation in progress, bit 2 = macro update
+//                       in progress
+// VEN_START_CRC    OUT  start CRC16 calculation over code flash (no data),
+//                       wValue = start address, wIndex = number of bytes
+// VEN_GET_CRC      IN   3 bytes: busy flag, CRC16 (LE)
+// VEN_BOOT         OUT  detach and enter the bootloader (no data)
+// VEN_GET_PERF     IN   latency statistics (PERF_STATS, see perf.h)
+// VEN_RESET_PERF   OUT  clear latency statistics (no data)
+// VEN_SELF_TEST    OUT  press (wValueH = 1) or release (wValueH = 0) key wValueL
+//                       (0 .. SCAN_KEYS - 1, see SCAN_INPUTS) as if it was a real key
+//                       (no data)
+// VEN_GET_INFO     IN   9 bytes build configuration: version, flags (bit 0: parallel
+//                       mode, bit 1: PERF_ENABLE, bit 2: HID_COALESCE, bit 3:
+//                       RELAY_ENABLE), poll interval
+//                       in ms, F_CPU in MHz, scan rate in Hz (LE), debounce samples,
+//                       contacts per report, bytes per contact
+// VEN_GET_RELAY    IN   relay mode statistics (RLY_STATS, see usb_relay.h), STALL
+//                       without RELAY_ENABLE
+// VEN_GET_MACRO    IN   read the macro programs (MAC_SIZE bytes, see macro.h)
+// VEN_SET_MACRO    OUT  write the macro programs (MAC_SIZE bytes), applied and saved
+//                       to data flash by the main loop (STALL while busy)
+// VEN_RESET_MACRO  OUT  restore and save the default macro programs (no data)
+// The macro requests STALL without MACRO_ENABLE.
+// VEN_GET_SCREEN   IN   2 bytes: selected display profile, number of profiles
+// VEN_SET_SCREEN   OUT  select display profile wValueL (see screen.h), saved to data
+//                       flash by the main loop (no data)
+//
+// Map entries are 6 bytes each: id, pressure, x (LE), y (LE). Gestures are 7
+// bytes each: type, frames (LE), dx (LE), dy (LE). The CRC is
+// CRC16-CCITT (polynomial 0x1021, initial value 0xFFFF), it is calculated by
+// VEN_poll() in the main loop so the USB interrupt never runs long.
+//
+// Functions available:
+// --------------------
+// VEN_poll()               run pending work (CRC, bootloader), call from main loop
+//
+// The bootloader is entered by the vendor software timer (TB_TMR_VENDOR), the
+// main loop keeps serving USB until the device detaches.
+
+#pragma once
+#include <stdint.h>
+#include "usb_handler.h"
+
+#define VEN_GET_MAP     0x01
+#define VEN_SET_MAP     0x02
+#define VEN_RESET_MAP   0x03
+#define VEN_GET_STATUS  0x04
+#define VEN_START_CRC   0x05
+#define VEN_GET_CRC     0x06
+#define VEN_BOOT        0x07
+#define VEN_GET_PERF    0x08
+#define VEN_RESET_PERF  0x09
+#define VEN_SELF_TEST   0x0A
+#define VEN_GET_INFO    0x0B
+#define VEN_GET_RELAY   0x0C
+#define VEN_GET_MACRO   0x0D
+#define VEN_SET_MACRO   0x0E
+#define VEN_RESET_MACRO 0x0F
+#define VEN_GET_SCREEN  0x10
+#define VEN_SET_SCREEN  0x11
+
+uint8_t VEN_control(void);              // vendor SETUP handler
+void VEN_controlIn(void);               // vendor IN handler
+void VEN_controlOut(void);              // vendor OUT handler
+void VEN_poll(void);                    // run pending work from main loop
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 # ===================================================================================
 # Project:   chprog - Programming Tool for CH55x Microcontrollers
-# Version:   v1.2
+# Version:   v1.3
 # Year:      2022
 # Author:    Stefan Wagner
 # Github:    https://github.com/wagiminator
@@ -80,9 +80,10 @@ def _main():
 # ===================================================================================
 
 class Programmer:
-    def __init__(self):
-        # Find device
-        dev = usb.core.find(idVendor = CH_USB_VENDOR_ID, idProduct = CH_USB_PRODUCT_ID)
+    def __init__(self, dev = None):
+        # Find device (or use the given one, e.g. from usb.core.find(find_all=True))
+        if dev is None:
+            dev = usb.core.find(idVendor = CH_USB_VENDOR_ID, idProduct = CH_USB_PRODUCT_ID)
         if dev is None:
             raise Exception('CH55x not found. Check if device is in BOOT mode')
 
@@ -134,12 +135,14 @@ class Programmer:
         self.code_flash_size = self.device['code_size']
         self.data_flash_size = self.device['data_size']
 
-    # Erase code flash
-    def erase(self):
+    # Erase code flash (whole code flash or the first size bytes, rounded up to 1K)
+    def erase(self, size = None):
+        if size is None or size > self.code_flash_size:
+            size = self.code_flash_size
         if self.chipversion == 1:
             self.__erasev1()
         else:
-            self.__erasev2()
+            self.__erasev2((size + 1023) // 1024)
 
     # Write binary file to code flash
     def flash_bin(self, filename):
@@ -154,14 +157,14 @@ class Programmer:
         self.verify_data(data)
         return len(data)
 
-    # Write data stream to code flash
-    def flash_data(self, data):
+    # Write data stream to code flash (skip_blank: don't send erased 0xff packets)
+    def flash_data(self, data, skip_blank = False):
         if len(data) > self.code_flash_size:
             raise Exception('Not enough memory')
         if self.chipversion == 1:
             self.__writev1(data, CH_CMD_CODE_WRITE_V1)
         else:
-            self.__writev2(data, CH_CMD_CODE_WRITE_V2)
+            self.__writev2(data, CH_CMD_CODE_WRITE_V2, skip_blank)
 
     # Verify data stream in code flash
     def verify_data(self, data):
@@ -246,8 +249,8 @@ class Programmer:
             if reply[0] != 0x00:
                 raise Exception('Failed to erase chip')
 
-    def __erasev2(self):
-        reply = self.__sendcmd((0xa4, 0x01, 0x00, self.code_flash_size // 1024))
+    def __erasev2(self, pages):
+        reply = self.__sendcmd((0xa4, 0x01, 0x00, pages))
         if reply[4] != 0x00:
             raise Exception('Failed to erase chip')
 
@@ -277,7 +280,11 @@ class Programmer:
             offset += pkt_len
             rest   -= pkt_len
 
-    def __writev2(self, data, mode):
+    def __writev2(self, data, mode, skip_blank = False):
+        # Find erased packets before encryption
+        blank = bytes((0xff,)) * 0x38
+        plain = bytes(data)
+
         # Encrypt data
         if (len(data) % CH_XOR_KEY_LEN) > 0:
             data += b'0xff' * (CH_XOR_KEY_LEN - (len(data) % CH_XOR_KEY_LEN))
@@ -291,6 +298,10 @@ class Programmer:
         while rest > 0:
             if rest >= 0x38:  pkt_len = 0x38
             else:             pkt_len = rest
+            if skip_blank and plain[offset:(offset + pkt_len)] == blank[:pkt_len]:
+                offset += pkt_len
+                rest   -= pkt_len
+                continue
             stream  = bytes((mode, pkt_len + 5, 0))
             stream += offset.to_bytes(4, byteorder='little')
             stream += (rest & 0xff).to_bytes(1, byteorder='little')
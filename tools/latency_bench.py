@@ -0,0 +1,384 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   latency_bench - End-to-End Latency Benchmark for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Presses and releases a key through the firmware self-test vendor request and
+# timestamps the resulting touch report on the host (hidraw or evdev). The
+# self-test key goes through the same debounce, report and USB path as a real
+# key. Reports p50/p99/p99.9 latency, jitter and report rate together with the
+# build configuration read from the device (report mode, polling interval,
+# clock), and splits the latency with the on-device counters (see src/perf.h):
+#
+#   host total = request + debounce + edge->queue + queue->ACK + host stack
+#
+# Results can be appended to a CSV file and compared against a baseline run to
+# catch regressions.
+#
+# Dependencies:
+# -------------
+# - pyusb, Linux (hidraw), python-evdev for --input evdev
+#
+# Operating Instructions:
+# -----------------------
+# python3 latency_bench.py [-n 500] [-k 0] [--input hidraw|evdev] [--csv out.csv]
+#                          [--baseline base.csv] [--tolerance 10]
+#
+# Vendor requests on EP0 do not need the kernel HID driver to be detached. Run
+# as root or add a udev rule for 6666:6666 (usb and hidraw subsystems).
+
+
+import argparse
+import csv
+import glob
+import os
+import select
+import statistics
+import struct
+import sys
+import threading
+import time
+import usb.core
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'End-to-end latency benchmark')
+    parser.add_argument('-n', '--count', type = int, default = 500, help = 'number of presses')
+    parser.add_argument('-k', '--key', type = int, default = 0, help = 'key to press (0..2)')
+    parser.add_argument('--input', choices = ('hidraw', 'evdev'), default = 'hidraw')
+    parser.add_argument('--label', default = '', help = 'free text stored with the results')
+    parser.add_argument('--csv', help = 'append results to this CSV file')
+    parser.add_argument('--baseline', help = 'CSV file with a previous run to compare to')
+    parser.add_argument('--tolerance', type = float, default = 10.0,
+                        help = 'allowed p99 regression against baseline in percent')
+    args = parser.parse_args()
+
+    try:
+        bench  = Bench(args.key, args.input)
+        result = bench.run(args.count)
+    except Exception as ex:
+        sys.stderr.write('ERROR: ' + str(ex) + '!\n')
+        sys.exit(1)
+
+    result['label'] = args.label
+    print_result(result)
+    if args.csv:
+        write_csv(args.csv, result)
+    if args.baseline:
+        sys.exit(0 if compare(args.baseline, result, args.tolerance) else 2)
+    sys.exit(0)
+
+# ===================================================================================
+# Output Functions
+# ===================================================================================
+
+FIELDS = ('label', 'mode', 'poll_ms', 'fcpu_mhz', 'scan_hz', 'debounce', 'samples',
+          'p50_ms', 'p99_ms', 'p999_ms', 'jitter_ms', 'rate_hz',
+          'fw_edge_queue_ms', 'fw_queue_ack_ms', 'fw_min_ms', 'fw_max_ms',
+          'host_ms', 'dropped', 'coalesced', 'irq_off_max_us')
+
+def print_result(r):
+    print('Configuration: %s mode, %d ms poll, %d MHz, %d Hz scan, debounce %d' %
+          (r['mode'], r['poll_ms'], r['fcpu_mhz'], r['scan_hz'], r['debounce']))
+    print('Samples:       %d' % r['samples'])
+    print('Host latency:  p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, jitter %.3f ms' %
+          (r['p50_ms'], r['p99_ms'], r['p999_ms'], r['jitter_ms']))
+    print('Report rate:   %.1f reports/s' % r['rate_hz'])
+    if r['fw_edge_queue_ms'] is not None:
+        print('Firmware:      edge->queue %.3f ms, queue->ACK %.3f ms (min %.3f, max %.3f)' %
+              (r['fw_edge_queue_ms'], r['fw_queue_ack_ms'], r['fw_min_ms'], r['fw_max_ms']))
+        print('Host side:     %.3f ms (request, debounce and host stack excluded from firmware)'
+              % r['host_ms'])
+        print('Queue:         %d dropped, %d coalesced, longest EA=0 %d us' %
+              (r['dropped'], r['coalesced'], r['irq_off_max_us']))
+    else:
+        print('Firmware:      instrumentation not enabled (PERF_ENABLE)')
+    if r.get('ready_ms'):
+        print('Boot:          touch screen usable %d ms after power-up' % r['ready_ms'])
+    if r.get('recovery'):
+        cause, wdt, reattach = r['recovery']
+        print('Recovery:      last reset by %s, %d watchdog resets, %d USB re-attaches' %
+              (RESET_CAUSES.get(cause, 'unknown'), wdt, reattach))
+
+def write_csv(filename, r):
+    new = not os.path.exists(filename)
+    with open(filename, 'a', newline = '') as f:
+        w = csv.DictWriter(f, fieldnames = FIELDS, extrasaction = 'ignore')
+        if new: w.writeheader()
+        w.writerow(r)
+
+# Compare p99 with the last baseline row of the same configuration
+def compare(filename, r, tolerance):
+    base = None
+    with open(filename, newline = '') as f:
+        for row in csv.DictReader(f):
+            if (row['mode'], int(row['poll_ms']), int(row['fcpu_mhz'])) == \
+               (r['mode'], r['poll_ms'], r['fcpu_mhz']):
+                base = row
+    if base is None:
+        print('Baseline:      no run with the same configuration')
+        return True
+    limit = float(base['p99_ms']) * (1 + tolerance / 100)
+    ok = r['p99_ms'] <= limit
+    print('Baseline:      p99 %.3f ms, limit %.3f ms -> %s' %
+          (float(base['p99_ms']), limit, 'OK' if ok else 'REGRESSION'))
+    return ok
+
+def percentile(data, p):
+    data = sorted(data)
+    k = (len(data) - 1) * p / 100
+    lo = int(k)
+    hi = min(lo + 1, len(data) - 1)
+    return data[lo] + (data[hi] - data[lo]) * (k - lo)
+
+# ===================================================================================
+# Bench Class
+# ===================================================================================
+
+class Bench:
+    def __init__(self, key, inputmode):
+        self.dev = usb.core.find(idVendor = FW_USB_VENDOR_ID, idProduct = FW_USB_PRODUCT_ID)
+        if self.dev is None:
+            raise Exception('Device not found')
+        self.key    = key
+        self.info   = self.__read_info()
+        self.id     = self.__in(VEN_GET_MAP, 6 * (key + 1))[6 * key]   # contact ID of key
+        self.reader = HidrawReader(self.info['contact_size']) if inputmode == 'hidraw' \
+                      else EvdevReader()
+
+    # Press and release the key count times
+    def run(self, count):
+        self.__out(VEN_RESET_PERF)
+        self.reader.start()
+        latencies = []
+        settle = 2 * (self.info['debounce'] * 1000 / self.info['scan_hz'] +
+                      self.info['poll_ms']) / 1000 + 0.005
+        try:
+            for i in range(count):
+                for pressed in (1, 0):
+                    self.reader.flush()
+                    t = time.perf_counter()
+                    self.__out(VEN_SELF_TEST, (pressed << 8) | self.key)
+                    rx = self.reader.wait(self.id, pressed, t + 1.0)
+                    if rx is None:
+                        raise Exception('No report for %s %d' %
+                                        ('press' if pressed else 'release', i))
+                    latencies.append(rx - t)
+                    time.sleep(settle)
+        finally:
+            self.__out(VEN_SELF_TEST, self.key)     # make sure the key is released
+            self.reader.stop()
+        perf = self.__read_perf()
+
+        ms = [l * 1000 for l in latencies]
+        r  = dict(self.info)
+        r['samples']   = len(ms)
+        r['p50_ms']    = percentile(ms, 50)
+        r['p99_ms']    = percentile(ms, 99)
+        r['p999_ms']   = percentile(ms, 99.9)
+        r['jitter_ms'] = statistics.pstdev(ms)
+        r['rate_hz']   = self.reader.rate()
+        r['fw_edge_queue_ms'] = r['fw_queue_ack_ms'] = r['fw_min_ms'] = None
+        r['fw_max_ms'] = r['host_ms'] = None
+        r['dropped'] = r['coalesced'] = r['irq_off_max_us'] = 0
+        r['ready_ms'] = perf['ready'] if self.info['perf'] else None
+        r['recovery'] = perf['recovery'] if self.info['perf'] else None
+        if self.info['perf'] and perf['count']:
+            ring = perf['ring'][:min(perf['count'], len(perf['ring']))]
+            avg  = perf['sum'] / perf['count'] / 1000
+            r['fw_edge_queue_ms'] = statistics.mean(s[0] for s in ring) / 1000
+            r['fw_queue_ack_ms']  = statistics.mean(s[1] for s in ring) / 1000
+            r['fw_min_ms']        = perf['min'] / 1000
+            r['fw_max_ms']        = perf['max'] / 1000
+            r['host_ms']          = statistics.mean(ms) - avg - \
+                                    self.info['debounce'] * 1000 / self.info['scan_hz']
+            r['dropped']          = perf['dropped']
+            r['coalesced']        = perf['coalesced']
+            r['irq_off_max_us']   = perf['irq_off_max']
+        return r
+
+    def __out(self, request, value = 0, index = 0):
+        self.dev.ctrl_transfer(VEN_REQ_OUT, request, value, index, None, FW_USB_TIMEOUT)
+
+    def __in(self, request, length):
+        return bytes(self.dev.ctrl_transfer(VEN_REQ_IN, request, 0, 0, length, FW_USB_TIMEOUT))
+
+    def __read_info(self):
+        d = self.__in(VEN_GET_INFO, 9)
+        return {'mode':     'parallel' if d[1] & 0x01 else 'hybrid',
+                'perf':     bool(d[1] & 0x02),
+                'poll_ms':  d[2],
+                'fcpu_mhz': d[3],
+                'scan_hz':  d[4] | (d[5] << 8),
+                'debounce': d[6],
+                'contact_size': d[8] if len(d) > 8 else 7}   # older firmware: 7
+
+    # PERF_STATS (src/perf.h), packed little-endian
+    def __read_perf(self):
+        d = self.__in(VEN_GET_PERF, PERF_STATS_SIZE)
+        v = struct.unpack_from('<HHHI8HHHHIB', d)
+        ring = [struct.unpack_from('<HH', d, PERF_RING_OFFSET + 4 * i)
+                for i in range(PERF_SAMPLES)]
+        head = v[16]
+        ring = ring[head:] + ring[:head]                  # oldest first
+        return {'count': v[0], 'min': v[1], 'max': v[2], 'sum': v[3],
+                'hist': v[4:12], 'dropped': v[12], 'coalesced': v[13],
+                'irq_off_max': v[14], 'irq_off_sum': v[15], 'ring': ring[::-1],
+                'ready': struct.unpack_from('<H', d, PERF_READY_OFFSET)[0]
+                         if len(d) >= PERF_RESET_OFFSET else None,   # older firmware: none
+                'recovery': struct.unpack_from('<BBB', d, PERF_RESET_OFFSET)
+                            if len(d) >= PERF_STATS_SIZE else None}
+
+# ===================================================================================
+# Input Readers
+# ===================================================================================
+
+# Reader thread base: timestamps every touch report, keeps contact states
+class Reader:
+    def __init__(self):
+        self.cond    = threading.Condition()
+        self.events  = []                                # (time, id, touching)
+        self.times   = []                                # arrival of every report
+        self.running = False
+
+    def start(self):
+        self.running = True
+        self.thread  = threading.Thread(target = self.loop, daemon = True)
+        self.thread.start()
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+
+    def flush(self):
+        with self.cond: self.events = []
+
+    def post(self, t, contacts):
+        with self.cond:
+            self.times.append(t)
+            for cid, touching in contacts:
+                self.events.append((t, cid, touching))
+            self.cond.notify_all()
+
+    # Wait for contact cid to reach state touching, returns host timestamp
+    def wait(self, cid, touching, deadline):
+        with self.cond:
+            while True:
+                for t, c, s in self.events:
+                    if c == cid and s == bool(touching):
+                        return t
+                left = deadline - time.perf_counter()
+                if left <= 0:
+                    return None
+                self.cond.wait(left)
+
+    # Highest sustained report rate seen (median of the shortest intervals)
+    def rate(self):
+        d = sorted(b - a for a, b in zip(self.times, self.times[1:]) if b > a)
+        if not d:
+            return 0.0
+        return 1 / statistics.median(d[:max(1, len(d) // 10)])
+
+# Raw HID reports from /dev/hidrawN
+class HidrawReader(Reader):
+    def __init__(self, contact_size):
+        super().__init__()
+        self.size = contact_size
+        self.fd = None
+        for path in glob.glob('/sys/class/hidraw/hidraw*/device/uevent'):
+            # composite device: the touch screen is interface 0 (...:1.0)
+            if not os.path.realpath(os.path.dirname(path)).split('/')[-2].endswith('.%d' % FW_ITF_TOUCH):
+                continue
+            with open(path) as f:
+                if 'HID_ID=0003:%08X:%08X' % (FW_USB_VENDOR_ID, FW_USB_PRODUCT_ID) in f.read():
+                    self.fd = os.open('/dev/' + path.split('/')[4], os.O_RDONLY)
+        if self.fd is None:
+            raise Exception('hidraw device not found')
+
+    def loop(self):
+        while self.running:
+            if not select.select([self.fd], [], [], 0.1)[0]:
+                continue
+            data = os.read(self.fd, 64)
+            t = time.perf_counter()
+            if data[0] != REPORT_ID_TOUCH:
+                continue
+            contacts = []
+            for i in range(2, len(data) - self.size + 1, self.size):  # id, status, ...
+                contacts.append((data[i], bool(data[i + 1] & 0x01)))
+            self.post(t, contacts)
+
+# Multitouch events through evdev (includes the kernel input layer)
+class EvdevReader(Reader):
+    def __init__(self):
+        super().__init__()
+        import evdev
+        self.evdev = evdev
+        self.input = None
+        for path in evdev.list_devices():
+            d = evdev.InputDevice(path)
+            if d.info.vendor == FW_USB_VENDOR_ID and d.info.product == FW_USB_PRODUCT_ID \
+               and evdev.ecodes.ABS_MT_SLOT in dict(d.capabilities().get(evdev.ecodes.EV_ABS, [])):
+                self.input = d
+        if self.input is None:
+            raise Exception('evdev touch device not found')
+        self.slots = {}
+
+    def loop(self):
+        e = self.evdev.ecodes
+        slot, contacts = 0, []
+        while self.running:
+            if not select.select([self.input.fd], [], [], 0.1)[0]:
+                continue
+            for ev in self.input.read():
+                if ev.type == e.EV_ABS and ev.code == e.ABS_MT_SLOT:
+                    slot = ev.value
+                elif ev.type == e.EV_ABS and ev.code == e.ABS_MT_TRACKING_ID:
+                    if ev.value >= 0:
+                        # evdev has no contact IDs, slots are assigned in report order
+                        self.slots[slot] = slot + 1
+                        contacts.append((slot + 1, True))
+                    else:
+                        contacts.append((self.slots.get(slot, slot + 1), False))
+                elif ev.type == e.EV_SYN and ev.code == e.SYN_REPORT:
+                    self.post(time.perf_counter(), contacts)
+                    contacts = []
+
+# ===================================================================================
+# Firmware Constants (src/config.h, src/usb_descr.h, src/usb_vendor.h, src/perf.h)
+# ===================================================================================
+
+FW_USB_VENDOR_ID  = 0x6666    # USB_VENDOR_ID
+FW_USB_PRODUCT_ID = 0x6666    # USB_PRODUCT_ID
+FW_USB_TIMEOUT    = 1000      # timeout for control transfers in ms
+
+FW_ITF_TOUCH      = 0         # HID_ITF_TOUCH
+REPORT_ID_TOUCH   = 0x01
+
+VEN_REQ_OUT       = 0x40      # vendor, device, host to device
+VEN_REQ_IN        = 0xc0      # vendor, device, device to host
+VEN_GET_MAP       = 0x01
+VEN_GET_PERF      = 0x08
+VEN_RESET_PERF    = 0x09
+VEN_SELF_TEST     = 0x0a
+VEN_GET_INFO      = 0x0b
+
+PERF_SAMPLES      = 8
+PERF_RING_OFFSET  = 37
+PERF_READY_OFFSET = PERF_RING_OFFSET + 4 * PERF_SAMPLES
+PERF_RESET_OFFSET = PERF_READY_OFFSET + 2
+PERF_STATS_SIZE   = PERF_RESET_OFFSET + 3
+RESET_CAUSES      = {0x00: 'software', 0x10: 'power-on', 0x20: 'watchdog', 0x30: 'RST pin'}
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
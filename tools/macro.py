@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   macro - Macro Program Assembler for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Assembles macro programs (see src/macro.h) from a text file into the program
+# blob of the firmware and writes it to the device by vendor request, where it
+# is stored in data flash. One instruction per line, '#' starts a comment, a
+# line 'key N:' starts the program bound to key N (1..3):
+#
+#   key 1:              # double tap
+#     down 0 1000 1000  # slot x y
+#     wait 30           # ms
+#     up 0
+#     wait 30
+#     loop 2 key 1      # count (0: forever), label to jump back to
+#     end
+#
+# Labels: 'name:' on its own line, 'key N:' is a label as well. Other
+# instructions: move slot x y, key usage, led pixel hue|off.
+#
+# Dependencies:
+# -------------
+# - pyusb
+#
+# Operating Instructions:
+# -----------------------
+# python3 macro.py programs.txt             assemble and write to the device
+# python3 macro.py programs.txt -o out.bin  assemble to a file only
+# python3 macro.py --read                   dump the programs of the device
+# python3 macro.py --reset                  restore the default programs
+
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'Macro program assembler')
+    parser.add_argument('file', nargs = '?', help = 'program source')
+    parser.add_argument('-o', '--output', help = 'write blob to this file instead of the device')
+    parser.add_argument('--read', action = 'store_true', help = 'dump programs of the device')
+    parser.add_argument('--reset', action = 'store_true', help = 'restore default programs')
+    args = parser.parse_args()
+
+    try:
+        if args.file:
+            blob = assemble(open(args.file).read())
+            print('Assembled %d of %d code bytes' % (len(blob.rstrip(b'\x00')) - FW_MAP_KEYS,
+                                                    MAC_CODE_SIZE))
+            if args.output:
+                open(args.output, 'wb').write(blob)
+                return
+        dev = Device()
+        if args.reset:
+            dev.reset()
+        elif args.file:
+            dev.write(blob)
+        if args.read:
+            blob = dev.read()
+            print('Bindings: %s' % ' '.join('%02x' % b for b in blob[:FW_MAP_KEYS]))
+            print('Code:     %s' % blob[FW_MAP_KEYS:].hex(' '))
+    except Exception as ex:
+        sys.stderr.write('ERROR: %s!\n' % str(ex))
+        sys.exit(1)
+
+# ===================================================================================
+# Assembler
+# ===================================================================================
+
+def assemble(text):
+    lines  = []
+    labels = {}
+    binds  = [MAC_NONE] * FW_MAP_KEYS
+    pc     = 0
+    for n, line in enumerate(text.splitlines(), 1):
+        line = line.split('#')[0].strip().lower()
+        if not line:
+            continue
+        m = re.fullmatch(r'(key\s+(\d+)|\w+)\s*:', line)
+        if m:
+            if m.group(2):
+                key = int(m.group(2)) - 1
+                if not 0 <= key < FW_MAP_KEYS:
+                    raise Exception('line %d: no key %s' % (n, m.group(2)))
+                binds[key] = pc
+            labels[re.sub(r'\s+', ' ', line[:-1].strip())] = pc
+            continue
+        words = line.split()
+        if words[0] not in OPCODES:
+            raise Exception('line %d: unknown instruction %s' % (n, words[0]))
+        lines.append((n, pc, words))
+        pc += OPCODES[words[0]][1]
+
+    code = b''
+    for n, pc, words in lines:
+        op, size = OPCODES[words[0]]
+        a = words[1:]
+        try:
+            if words[0] in ('down', 'move'):
+                code += struct.pack('<BBHH', op, int(a[0]), int(a[1]), int(a[2]))
+            elif words[0] == 'up':
+                code += struct.pack('<BB', op, int(a[0]))
+            elif words[0] == 'wait':
+                code += struct.pack('<BH', op, int(a[0]))
+            elif words[0] == 'key':
+                code += struct.pack('<BB', op, int(a[0], 0))
+            elif words[0] == 'led':
+                code += struct.pack('<BBB', op, int(a[0]), 0xff if a[1] == 'off' else int(a[1]))
+            elif words[0] == 'loop':
+                target = labels[' '.join(a[1:])]
+                if not 0 <= pc - target <= 255:
+                    raise Exception('loop too long')
+                code += struct.pack('<BBB', op, int(a[0]), pc - target)
+            else:
+                code += struct.pack('<B', op)
+        except (IndexError, KeyError, ValueError, struct.error) as ex:
+            raise Exception('line %d: invalid arguments (%s)' % (n, ex))
+    if len(code) > MAC_CODE_SIZE:
+        raise Exception('programs need %d bytes, only %d available' % (len(code), MAC_CODE_SIZE))
+    return bytes(binds) + code + bytes(MAC_CODE_SIZE - len(code))
+
+# ===================================================================================
+# Device Class
+# ===================================================================================
+
+class Device:
+    def __init__(self):
+        import usb.core
+        self.dev = usb.core.find(idVendor = FW_USB_VENDOR_ID, idProduct = FW_USB_PRODUCT_ID)
+        if self.dev is None:
+            raise Exception('Device not found')
+
+    def read(self):
+        return bytes(self.dev.ctrl_transfer(VEN_REQ_IN, VEN_GET_MACRO, 0, 0, MAC_SIZE, FW_USB_TIMEOUT))
+
+    def write(self, blob):
+        self.__wait()
+        self.dev.ctrl_transfer(VEN_REQ_OUT, VEN_SET_MACRO, 0, 0, blob, FW_USB_TIMEOUT)
+        self.__wait()
+        if self.read() != blob:
+            raise Exception('verification failed')
+        print('Programs written')
+
+    def reset(self):
+        self.__wait()
+        self.dev.ctrl_transfer(VEN_REQ_OUT, VEN_RESET_MACRO, 0, 0, None, FW_USB_TIMEOUT)
+        self.__wait()
+        print('Default programs restored')
+
+    # Wait until the last update is stored in data flash
+    def __wait(self):
+        for i in range(100):
+            if not self.dev.ctrl_transfer(VEN_REQ_IN, VEN_GET_STATUS, 0, 0, 1, FW_USB_TIMEOUT)[0] & 0x04:
+                return
+            time.sleep(0.01)
+        raise Exception('device busy')
+
+# ===================================================================================
+# Firmware Constants (src/config.h, src/macro.h, src/usb_vendor.h)
+# ===================================================================================
+
+FW_USB_VENDOR_ID  = 0x6666    # USB_VENDOR_ID
+FW_USB_PRODUCT_ID = 0x6666    # USB_PRODUCT_ID
+FW_USB_TIMEOUT    = 1000      # timeout for control transfers in ms
+FW_MAP_KEYS       = 3         # MAP_KEYS
+
+MAC_NONE          = 0xff
+MAC_SIZE          = 62
+MAC_CODE_SIZE     = MAC_SIZE - FW_MAP_KEYS
+
+OPCODES = {                   # name: (opcode, size)
+    'end':  (0x00, 1),
+    'down': (0x01, 6),
+    'move': (0x02, 6),
+    'up':   (0x03, 2),
+    'wait': (0x04, 3),
+    'key':  (0x05, 2),
+    'led':  (0x06, 3),
+    'loop': (0x07, 3),
+}
+
+VEN_REQ_OUT       = 0x40      # vendor, device, host to device
+VEN_REQ_IN        = 0xc0      # vendor, device, device to host
+VEN_GET_STATUS    = 0x04
+VEN_GET_MACRO     = 0x0d
+VEN_SET_MACRO     = 0x0e
+VEN_RESET_MACRO   = 0x0f
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
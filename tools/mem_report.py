@@ -0,0 +1,362 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   mem_report - Memory Budget Report for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Reads the output of the firmware build and reports where flash, IRAM and XRAM
+# go, then checks it against the budgets:
+# - flash/IRAM/XRAM per module (.rel files of the build)
+# - the largest symbols (functions and tables from the linker map, variables
+#   with their sizes from the .asm files)
+# - the endpoint buffers (EP*_ADDR in src/usb_descr.h) against the packet sizes
+#   of config.h, the DMA rules of the chip and the XRAM the linker placed from
+#   XRAM_LOC on, so no variable silently overlaps a DMA buffer
+# - the worst-case stack depth: main loop plus the deepest interrupt, through the
+#   call graph of the .asm files (return addresses and pushes), function pointer
+#   calls (__sdcc_call_dptr) may reach every function whose address is taken
+# - functions reached from main and from an interrupt that keep their locals in
+#   overlaid IRAM (OSEG), these need #pragma nooverlay as the USB_interrupt()
+#   handlers have
+# Any budget exceeded or layout error fails the run. Functions that are not
+# global (static) show up in the map with the function in front of them.
+#
+# Dependencies:
+# -------------
+# - a firmware build that kept its temporary files (.map, .mem, .asm, .rel)
+#
+# Operating Instructions:
+# -----------------------
+# make mem                                     build and check (see makefile)
+# python3 mem_report.py --map touch.map --mem touch.mem --asm '*.asm' --rel '*.rel'
+# python3 mem_report.py ... --flash 0x3800 --xram 0x300 --stack 16 --top 20
+
+
+import argparse
+import glob
+import os
+import re
+import sys
+
+from sim_bench import AREAS, read_sizes
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'Memory budget report')
+    parser.add_argument('--map', required = True, help = 'linker map of the firmware')
+    parser.add_argument('--mem', required = True, help = 'memory summary of the firmware')
+    parser.add_argument('--asm', default = '*.asm', help = 'assembler files of the firmware build')
+    parser.add_argument('--rel', default = '*.rel', help = 'object files of the firmware build')
+    parser.add_argument('--config', default = 'src/config.h', help = 'endpoint and queue sizes')
+    parser.add_argument('--xram-loc', type = auto_int, default = 0x0100, help = 'start of compiler XRAM')
+    parser.add_argument('--flash', type = auto_int, help = 'flash budget in bytes')
+    parser.add_argument('--xram', type = auto_int, help = 'compiler XRAM budget in bytes')
+    parser.add_argument('--stack', type = auto_int, default = 0, help = 'IRAM bytes left at worst-case stack depth')
+    parser.add_argument('--lib-stack', type = auto_int, default = 4, help = 'stack assumed for library calls')
+    parser.add_argument('--nested', action = 'store_true', help = 'interrupts nest (priorities set)')
+    parser.add_argument('--top', type = int, default = 10, help = 'largest symbols shown per memory')
+    args = parser.parse_args()
+
+    try:
+        areas, symbols = read_map(args.map)
+        stack          = read_stack(args.mem)
+        modules        = read_asm(args.asm)
+        sizes          = read_sizes(args.rel)
+        config         = read_config(args.config)
+    except Exception as ex:
+        sys.stderr.write('ERROR: %s!\n' % str(ex))
+        sys.exit(1)
+
+    errors = []
+    report_modules(sizes)
+    report_symbols(areas, symbols, modules, args.top)
+    total = report_totals(areas, stack, args, errors)
+    report_endpoints(modules, symbols, areas, config, args.xram_loc, errors)
+    margin = report_stack(modules, stack, args, errors)
+
+    if errors:
+        print()
+        for e in errors:
+            print('FAIL: %s' % e)
+        sys.exit(1)
+    print('\nAll budgets met (flash %d, XRAM %d, stack margin %d bytes)' %
+          (total['flash'], total['xram'], margin))
+
+def auto_int(s):
+    return int(s, 0)
+
+# ===================================================================================
+# Build Output
+# ===================================================================================
+
+# Areas and global symbols of the linker map: area -> (addr, size), and
+# [(addr, name, module, area)]
+def read_map(path):
+    areas, symbols, area = {}, [], None
+    for line in open(path):
+        m = re.match(r'^(\w+)\s+([0-9A-Fa-f]{4,8})\s+([0-9A-Fa-f]{4,8})\s+=\s+\d+\.\s+bytes', line)
+        if m:
+            area = m.group(1)
+            areas[area] = (int(m.group(2), 16), int(m.group(3), 16))
+            continue
+        m = re.match(r'^\s*(?:[A-Z]:)?\s*([0-9A-Fa-f]{4,8})\s+([_.$\w]+)\s+(\w+)\s*$', line)
+        if m and area:
+            symbols.append((int(m.group(1), 16), m.group(2), m.group(3), area))
+    if not areas:
+        raise Exception('no areas in %s, link with the map enabled' % path)
+    return areas, symbols
+
+def read_stack(path):
+    m = re.search(r'Stack starts at:\s*0x([0-9A-Fa-f]+).*?with\s+(\d+)\s+bytes available',
+                  open(path).read(), re.S)
+    if not m:
+        raise Exception('no stack information in %s' % path)
+    return {'start': int(m.group(1), 16), 'free': int(m.group(2))}
+
+# Numeric defines of config.h (endpoint and queue sizes)
+def read_config(path):
+    return {m.group(1): int(m.group(2), 0) for m in
+            re.finditer(r'^#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)\b', open(path).read(), re.M)}
+
+# Variables, absolute addresses and functions of every module:
+# {'data': [(name, area, size)], 'abs': {name: addr}, 'funcs': {name: FUNC}}
+def read_asm(pattern):
+    modules = {}
+    for path in sorted(glob.glob(pattern)):
+        mod = {'data': [], 'abs': {}, 'funcs': {}}
+        area = label = func = None
+        for line in open(path):
+            m = re.match(r'^;\s+function\s+(\w+)', line)
+            if m:
+                func = mod['funcs'][m.group(1)] = {'body': [], 'module': os.path.basename(path)}
+                continue
+            m = re.match(r'^\s+\.area\s+(\w+)', line)
+            if m:
+                area, label = m.group(1), None
+                if area not in ('CSEG', 'HOME'): func = None
+                continue
+            m = re.match(r'^(_\w+)\s*=\s*(0x[0-9A-Fa-f]+|\d+)', line)
+            if m:
+                mod['abs'][m.group(1)] = int(m.group(2), 0)
+                continue
+            m = re.match(r'^(_\w+)::?\s*$', line)
+            if m:
+                label = m.group(1)
+                continue
+            m = re.match(r'^\s+\.ds\s+(0x[0-9A-Fa-f]+|\d+)', line)
+            if m and label and area in AREAS:
+                mod['data'].append((label, area, int(m.group(1), 0)))
+                label = None
+                continue
+            if func is not None and not line.startswith(';'):
+                func['body'].append(line.split(';')[0].strip())
+        modules[os.path.splitext(os.path.basename(path))[0]] = mod
+    if not modules:
+        raise Exception('no assembler files match %s, build the firmware first' % pattern)
+    return modules
+
+# ===================================================================================
+# Modules, Symbols and Totals
+# ===================================================================================
+
+def report_modules(sizes):
+    print('%-16s %6s %6s %6s' % ('Module', 'FLASH', 'IRAM', 'XRAM'))
+    for module in sorted(sizes):
+        s = sizes[module]
+        print('%-16s %6d %6d %6d' % (module, s['flash'], s['iram'], s['xram']))
+
+# Functions and tables sized by the distance to the next global in their area
+def code_symbols(areas, symbols):
+    result = []
+    for area, (start, size) in areas.items():
+        if AREAS.get(area, ('',))[0] != 'flash' or not size:
+            continue
+        syms = sorted((a, n, m) for a, n, m, ar in symbols if ar == area and start <= a < start + size)
+        for i, (addr, name, module) in enumerate(syms):
+            end = syms[i + 1][0] if i + 1 < len(syms) else start + size
+            result.append((end - addr, name, module, area))
+    return result
+
+def report_symbols(areas, symbols, modules, top):
+    mem = {'flash': code_symbols(areas, symbols), 'iram': [], 'xram': []}
+    for module, mod in modules.items():
+        for name, area, size in mod['data']:
+            kind, bits = AREAS[area]
+            mem[kind].append(((size * bits + 7) // 8, name, module, area))
+    for kind in ('flash', 'iram', 'xram'):
+        print('\nLargest %s symbols:' % kind.upper())
+        for size, name, module, area in sorted(mem[kind], reverse = True)[:top]:
+            print('  %6d  %-28s %-14s %s' % (size, name.lstrip('_'), module, area))
+
+def report_totals(areas, stack, args, errors):
+    total = {'flash': 0, 'iram': 0, 'xram': 0}
+    for area, (start, size) in areas.items():
+        if area in AREAS and not area.endswith('ABS'):
+            kind, bits = AREAS[area]
+            total[kind] += (size * bits + 7) // 8
+    print('\nFLASH: %5d bytes%s' % (total['flash'], budget(total['flash'], args.flash)))
+    print('XRAM:  %5d bytes%s' % (total['xram'], budget(total['xram'], args.xram)))
+    print('IRAM:  %5d bytes below the stack (stack from 0x%02x, %d bytes free)' %
+          (stack['start'], stack['start'], stack['free']))
+    if args.flash is not None and total['flash'] > args.flash:
+        errors.append('flash %d of %d bytes' % (total['flash'], args.flash))
+    if args.xram is not None and total['xram'] > args.xram:
+        errors.append('XRAM %d of %d bytes' % (total['xram'], args.xram))
+    return total
+
+def budget(used, limit):
+    return '' if limit is None else ' of %d (%d left)' % (limit, limit - used)
+
+# ===================================================================================
+# Endpoint Buffers
+# ===================================================================================
+
+# Buffers are contiguous by construction (EP*_ADDR), the distance to the next
+# buffer is the size, EP_bufferEnd marks the end of the last one
+def report_endpoints(modules, symbols, areas, config, xram_loc, errors):
+    addr = {}
+    for mod in modules.values():
+        addr.update(mod['abs'])
+    for a, name, module, area in symbols:
+        addr.setdefault(name, a)
+    bufs = sorted((addr[n], n[1:]) for n in addr if re.match(r'^_EP\d_buffer$', n))
+    if not bufs or '_EP_bufferEnd' not in addr:
+        errors.append('endpoint buffers not found in the build output')
+        return
+    end = addr['_EP_bufferEnd']
+    need = {'EP0_buffer': 64}
+    for ep in (2, 3, 4):
+        need['EP%d_buffer' % ep] = config.get('EP%d_SIZE' % ep, 8)
+
+    print('\n%-12s %6s %6s %6s' % ('Endpoint', 'addr', 'size', 'end'))
+    for i, (a, name) in enumerate(bufs):
+        nxt  = bufs[i + 1][0] if i + 1 < len(bufs) else end
+        size = nxt - a
+        print('%-12s 0x%04x %6d 0x%04x' % (name, a, size, nxt))
+        if a & 1:
+            errors.append('%s at odd address 0x%04x (DMA)' % (name, a))
+        if size < need.get(name, 0):
+            errors.append('%s holds %d bytes, needs %d' % (name, size, need[name]))
+    if addr.get('_EP4_buffer', 64) - addr.get('_EP0_buffer', 0) != 64:
+        errors.append('EP4_buffer must follow EP0_buffer at +64 (UEP0_DMA + 64)')
+    if '_EP1_buffer' in addr and config.get('HID_QUEUE_SIZE'):
+        span = end - addr['_EP1_buffer']
+        print('EP1 queue:   %d slots of %d bytes' % (config['HID_QUEUE_SIZE'],
+                                                    span // config['HID_QUEUE_SIZE']))
+    print('Free below XRAM_LOC (0x%04x): %d bytes' % (xram_loc, xram_loc - end))
+    if end > xram_loc:
+        errors.append('endpoint buffers end at 0x%04x, above XRAM_LOC 0x%04x' % (end, xram_loc))
+    for area, (start, size) in areas.items():
+        if AREAS.get(area, ('',))[0] == 'xram' and not area.endswith('ABS') and size \
+           and start < max(end, xram_loc):
+            errors.append('%s at 0x%04x below XRAM_LOC, overlaps the endpoint buffers'
+                          % (area, start))
+
+# ===================================================================================
+# Stack Depth
+# ===================================================================================
+
+# Deepest stack use of every function: pushes on the way plus the return
+# address and the depth of every callee, recursion is reported as an error
+def stack_depths(funcs, lib_stack, errors):
+    calls, taken = {}, set()
+    for name, f in funcs.items():
+        calls[name] = []
+        for ins in f['body']:
+            m = re.match(r'^(?:[al]call|[als]jmp)\s+_+(\w+)$', ins)
+            if m:
+                calls[name].append(m.group(1))
+            else:
+                taken.update(t for t in re.findall(r'#\(?_(\w+)', ins) if t in funcs)
+    depth, active = {}, set()
+
+    def visit(name):
+        if name in depth:
+            return depth[name]
+        if name not in funcs:                   # library routine
+            return lib_stack
+        if name in active:
+            errors.append('recursion through %s, stack depth unbounded' % name)
+            return 0
+        active.add(name)
+        cur = deepest = 0
+        for ins in funcs[name]['body']:
+            op = ins.split()[0] if ins else ''
+            if op == 'push':
+                cur += 1
+            elif op == 'pop':
+                cur = max(cur - 1, 0)
+            elif op in ('acall', 'lcall'):
+                target = re.sub(r'^_+', '', ins.split()[1])
+                callees = taken if target == 'sdcc_call_dptr' else [target]
+                inner = max([visit(c) for c in callees] or [0])
+                deepest = max(deepest, cur + 2 + inner)
+            elif op in ('ajmp', 'ljmp', 'sjmp') and ins.split()[1].lstrip('_') in funcs:
+                deepest = max(deepest, cur + visit(ins.split()[1].lstrip('_')))   # tail call
+            deepest = max(deepest, cur)
+        active.discard(name)
+        depth[name] = deepest
+        return deepest
+
+    for name in funcs:
+        visit(name)
+    return depth, calls, taken
+
+def reach(root, calls, taken):
+    seen, todo = set(), [root]
+    while todo:
+        name = todo.pop()
+        if name in seen or name not in calls:
+            continue
+        seen.add(name)
+        for c in calls[name]:
+            todo.extend(taken if c == 'sdcc_call_dptr' else [c])
+    return seen
+
+def report_stack(modules, stack, args, errors):
+    funcs, overlay = {}, {}
+    for mod in modules.values():
+        funcs.update(mod['funcs'])
+        for name, area, size in mod['data']:
+            if area == 'OSEG':
+                overlay[name] = overlay.get(name, 0) + size
+    if 'main' not in funcs:
+        errors.append('main() not found in the assembler files')
+        return 0
+    depth, calls, taken = stack_depths(funcs, args.lib_stack, errors)
+    isrs = [n for n, f in funcs.items() if 'reti' in f['body']]
+
+    print('\n%-16s %6s' % ('Entry', 'stack'))
+    print('%-16s %6d' % ('main', depth['main']))
+    for name in sorted(isrs):
+        print('%-16s %6d  (interrupt, +2 return address)' % (name, depth[name] + 2))
+    irq = [depth[n] + 2 for n in isrs]
+    worst = depth['main'] + (sum(irq) if args.nested else max(irq or [0]))
+    margin = stack['free'] - worst
+    print('Worst case:      %d bytes of %d free (%d left)%s' % (worst, stack['free'], margin,
+          ', interrupts nested' if args.nested else ''))
+    if margin < args.stack:
+        errors.append('stack margin %d bytes, %d required' % (margin, args.stack))
+
+    # Overlaid locals are shared between functions the compiler sees as never
+    # active at once, an interrupt breaks that for functions main calls as well
+    main = reach('main', calls, taken)
+    for isr in isrs:
+        for name in sorted(reach(isr, calls, taken) & main):
+            owned = [s for s in overlay if s.startswith('_%s_' % name)]
+            if owned:
+                errors.append('%s is called from main and %s with overlaid locals (%s), '
+                              'add #pragma nooverlay' % (name, isr, ', '.join(o[1:] for o in owned)))
+    return margin
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
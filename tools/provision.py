@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   provision - Bulk Configuration and Flashing Tool for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Provisions all connected units in parallel, one worker per USB device:
+# - Units running the firmware are asked for the CRC16 of the image area. If it
+#   matches the local image, code flash is left alone. Otherwise the unit is sent
+#   to the bootloader by vendor request (no BOOT button needed).
+# - Units in bootloader mode only get the pages covered by the image erased and
+#   only non-blank packets written. Instead of the bootloader's verify pass (which
+#   streams the whole image again), the image is verified by CRC16 once the new
+#   firmware is running.
+# - A touch map is pushed to data flash via vendor request, without reflashing.
+# The time spent on every unit is reported.
+#
+# Dependencies:
+# -------------
+# - pyusb, chprog.py (same folder)
+#
+# Operating Instructions:
+# -----------------------
+# python3 provision.py [-f firmware.bin] [-m map.json] [--force]
+#
+# map.json is a list of entries, one per key, e.g.:
+# [{"id": 1, "pressure": 127, "x": 1018, "y": 500}, ...]
+# The gestures stored on the unit are kept then. To set them as well, use an
+# object with one gesture per key plus encoder clockwise and counter-clockwise:
+# {"keys": [...], "gestures": [{"type": "swipe", "frames": 20, "dx": 0, "dy": -3000}, ...]}
+# Gesture types are tap, hold, swipe and flick, frames/dx/dy default to 0.
+#
+# Linux users need permission to access the firmware as well, e.g.:
+# echo 'SUBSYSTEM=="usb", ATTR{idVendor}=="6666", ATTR{idProduct}=="6666", MODE="666"' | sudo tee /etc/udev/rules.d/99-touch.rules
+
+
+import argparse
+import binascii
+import concurrent.futures
+import json
+import struct
+import sys
+import time
+import usb.core
+import usb.util
+
+from chprog import Programmer, CH_USB_VENDOR_ID, CH_USB_PRODUCT_ID
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'Provision CH552 Touch Play units')
+    parser.add_argument('-f', '--firmware', help = 'firmware .bin to flash if it differs')
+    parser.add_argument('-m', '--map', help = 'touch map (.json) to write to data flash')
+    parser.add_argument('--force', action = 'store_true', help = 'flash even if the CRC matches')
+    args = parser.parse_args()
+
+    if args.firmware is None and args.map is None:
+        sys.stderr.write('ERROR: Nothing to do, use -f and/or -m!\n')
+        sys.exit(1)
+
+    image = None
+    if args.firmware:
+        with open(args.firmware, 'rb') as f: image = f.read()
+    touchmap = None
+    if args.map:
+        with open(args.map, 'r') as f: touchmap = pack_map(json.load(f))
+
+    ports = find_units()
+    if not ports:
+        sys.stderr.write('ERROR: No units found!\n')
+        sys.exit(1)
+    print('Found', len(ports), 'unit(s), provisioning ...')
+
+    failed = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers = len(ports)) as pool:
+        jobs = {pool.submit(Unit(port).provision, image, touchmap, args.force): port
+                for port in ports}
+        for job in concurrent.futures.as_completed(jobs):
+            port = jobs[job]
+            try:
+                steps, total = job.result()
+                print('%-12s OK    %7.1f ms  (%s)' % (port_name(port), total * 1000,
+                      ', '.join('%s %.1f ms' % (s, t * 1000) for s, t in steps)))
+            except Exception as ex:
+                failed += 1
+                print('%-12s ERROR %s' % (port_name(port), ex))
+
+    print('DONE:', len(ports) - failed, 'of', len(ports), 'unit(s) provisioned.')
+    sys.exit(1 if failed else 0)
+
+# ===================================================================================
+# Helper Functions
+# ===================================================================================
+
+# Find all units (firmware or bootloader), identified by their USB port
+def find_units():
+    ports = set()
+    for vid, pid in ((FW_USB_VENDOR_ID, FW_USB_PRODUCT_ID),
+                     (CH_USB_VENDOR_ID, CH_USB_PRODUCT_ID)):
+        for dev in usb.core.find(find_all = True, idVendor = vid, idProduct = pid):
+            ports.add(port_of(dev))
+    return sorted(ports)
+
+# Port path stays the same while a unit re-enumerates as bootloader or firmware
+def port_of(dev):
+    return (dev.bus, tuple(dev.port_numbers or ()))
+
+def port_name(port):
+    return '%d-%s' % (port[0], '.'.join(str(p) for p in port[1]))
+
+# Wait for a device with vid/pid to show up on port
+def wait_for(port, vid, pid):
+    end = time.monotonic() + FW_ENUM_TIMEOUT
+    while time.monotonic() < end:
+        for dev in usb.core.find(find_all = True, idVendor = vid, idProduct = pid):
+            if port_of(dev) == port:
+                return dev
+        time.sleep(0.02)
+    raise Exception('Device did not enumerate on port %s' % port_name(port))
+
+# Pack touch map entries: id, pressure, x, y (little-endian, as in MAP_ENTRY),
+# followed by the gestures if given: type, frames, dx, dy (as in MAP_GESTURE)
+GESTURE_TYPES = {'tap': 0, 'hold': 1, 'swipe': 2, 'flick': 3}
+
+def pack_map(touchmap):
+    if isinstance(touchmap, list):
+        touchmap = {'keys': touchmap}
+    data = b''
+    for e in touchmap['keys']:
+        data += struct.pack('<BBHH', e['id'], e.get('pressure', 127), e['x'], e['y'])
+    for g in touchmap.get('gestures', []):
+        data += struct.pack('<BHhh', GESTURE_TYPES[g.get('type', 'tap')],
+                            g.get('frames', 0), g.get('dx', 0), g.get('dy', 0))
+    return data
+
+# CRC16-CCITT, initial value 0xFFFF (same as VEN_poll() in the firmware)
+def crc16(data):
+    return binascii.crc_hqx(data, 0xffff)
+
+# ===================================================================================
+# Unit Class
+# ===================================================================================
+
+class Unit:
+    def __init__(self, port):
+        self.port  = port
+        self.steps = []
+
+    # Run all required steps, returns (steps, total time)
+    def provision(self, image, touchmap, force):
+        start = time.monotonic()
+        if image is not None:
+            dev = self.__find_firmware()
+            if dev is None or force or self.__crc(dev, len(image)) != crc16(image):
+                self.__flash(dev, image)
+                dev = self.__timed('enumerate', wait_for, self.port,
+                                   FW_USB_VENDOR_ID, FW_USB_PRODUCT_ID)
+                if self.__timed('verify', self.__crc, dev, len(image)) != crc16(image):
+                    raise Exception('CRC mismatch after flashing')
+            else:
+                self.steps.append(('up to date', 0.0))
+        if touchmap is not None:
+            dev = self.__find_firmware() or wait_for(self.port,
+                                                     FW_USB_VENDOR_ID, FW_USB_PRODUCT_ID)
+            self.__timed('map', self.__write_map, dev, touchmap)
+        return self.steps, time.monotonic() - start
+
+    def __timed(self, name, func, *args):
+        t = time.monotonic()
+        result = func(*args)
+        self.steps.append((name, time.monotonic() - t))
+        return result
+
+    def __find_firmware(self):
+        for dev in usb.core.find(find_all = True, idVendor = FW_USB_VENDOR_ID,
+                                 idProduct = FW_USB_PRODUCT_ID):
+            if port_of(dev) == self.port:
+                return dev
+        return None
+
+    # Vendor control transfers
+    def __out(self, dev, request, value = 0, index = 0, data = None):
+        dev.ctrl_transfer(VEN_REQ_OUT, request, value, index, data, FW_USB_TIMEOUT)
+
+    def __in(self, dev, request, length):
+        return bytes(dev.ctrl_transfer(VEN_REQ_IN, request, 0, 0, length, FW_USB_TIMEOUT))
+
+    def __wait_idle(self, dev, mask):
+        end = time.monotonic() + FW_BUSY_TIMEOUT
+        while self.__in(dev, VEN_GET_STATUS, 1)[0] & mask:
+            if time.monotonic() > end:
+                raise Exception('Device busy')
+            time.sleep(0.001)
+
+    # CRC16 over code flash calculated by the firmware
+    def __crc(self, dev, length):
+        self.__wait_idle(dev, VEN_STATUS_CRC)
+        self.__out(dev, VEN_START_CRC, 0, length)
+        end = time.monotonic() + FW_BUSY_TIMEOUT
+        while True:
+            reply = self.__in(dev, VEN_GET_CRC, 3)
+            if not reply[0]:
+                return reply[1] | (reply[2] << 8)
+            if time.monotonic() > end:
+                raise Exception('CRC calculation timed out')
+            time.sleep(0.001)
+
+    # Enter bootloader (if needed), erase the image area, write non-blank packets
+    def __flash(self, dev, image):
+        if dev is not None:
+            self.__out(dev, VEN_BOOT)
+            usb.util.dispose_resources(dev)
+        boot = self.__timed('bootloader', wait_for, self.port,
+                            CH_USB_VENDOR_ID, CH_USB_PRODUCT_ID)
+        isp = Programmer(boot)
+        isp.detect()
+        self.__timed('erase', isp.erase, len(image))
+        self.__timed('write', isp.flash_data, image, True)
+        isp.exit()
+        usb.util.dispose_resources(boot)
+
+    # Write touch map, wait until the firmware stored it in data flash
+    def __write_map(self, dev, touchmap):
+        self.__wait_idle(dev, VEN_STATUS_MAP)
+        self.__out(dev, VEN_SET_MAP, 0, 0, touchmap)
+        self.__wait_idle(dev, VEN_STATUS_MAP)
+        if self.__in(dev, VEN_GET_MAP, len(touchmap)) != touchmap:
+            raise Exception('Touch map read-back mismatch')
+
+# ===================================================================================
+# Firmware Constants (src/config.h, src/usb_vendor.h)
+# ===================================================================================
+
+FW_USB_VENDOR_ID  = 0x6666    # USB_VENDOR_ID
+FW_USB_PRODUCT_ID = 0x6666    # USB_PRODUCT_ID
+FW_USB_TIMEOUT    = 1000      # timeout for control transfers in ms
+FW_BUSY_TIMEOUT   = 2.0       # timeout for CRC/map operations in s
+FW_ENUM_TIMEOUT   = 5.0       # timeout for re-enumeration in s
+
+VEN_REQ_OUT       = 0x40      # vendor, device, host to device
+VEN_REQ_IN        = 0xc0      # vendor, device, device to host
+
+VEN_GET_MAP       = 0x01
+VEN_SET_MAP       = 0x02
+VEN_RESET_MAP     = 0x03
+VEN_GET_STATUS    = 0x04
+VEN_START_CRC     = 0x05
+VEN_GET_CRC       = 0x06
+VEN_BOOT          = 0x07
+
+VEN_STATUS_MAP    = 0x01      # touch map update in progress
+VEN_STATUS_CRC    = 0x02      # CRC calculation in progress
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   relay - Host Driven Touch Frames for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Streams contact frames to the relay output report of the touch screen
+# interface (EP2 OUT, see src/usb_relay.h). The firmware forwards every frame
+# to the touch screen report from the USB interrupt, so the device under test
+# sees the contacts within about a millisecond. Frames are read as JSON lines
+# from a file or stdin, one frame per line:
+#
+#   {"contacts": [{"id": 1, "x": 5000, "y": 5000, "touch": true, "p": 127}], "ms": 8}
+#
+# "ms" is the time to wait after the frame (default: --interval). With --pixels
+# x/y are screen pixels, mapped by the selected display profile of the firmware
+# (see src/screen.h), otherwise logical coordinates. A tap or a
+# swipe can also be generated from the command line. Relay mode ends after
+# the last frame, the firmware statistics (frames, sequence gaps, overruns,
+# malformed frames) are printed at the end.
+#
+# Dependencies:
+# -------------
+# - Linux (hidraw), pyusb for the statistics (--stats)
+#
+# Operating Instructions:
+# -----------------------
+# python3 relay.py frames.jsonl
+# python3 relay.py --tap 5000 5000
+# python3 relay.py --tap 540 1080 --pixels
+# python3 relay.py --swipe 2000 8000 2000 2000 --frames 30 --stats
+#
+# Run as root or add a udev rule for 6666:6666 (usb and hidraw subsystems).
+
+
+import argparse
+import glob
+import json
+import os
+import struct
+import sys
+import time
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'Stream touch frames through relay mode')
+    parser.add_argument('file', nargs = '?', help = 'JSON lines with frames (default: stdin)')
+    parser.add_argument('--tap', nargs = 2, type = int, metavar = ('X', 'Y'))
+    parser.add_argument('--swipe', nargs = 4, type = int, metavar = ('X0', 'Y0', 'X1', 'Y1'))
+    parser.add_argument('--frames', type = int, default = 20, help = 'frames of a swipe')
+    parser.add_argument('--interval', type = float, default = 8.0, help = 'ms between frames')
+    parser.add_argument('--id', type = int, default = 1, help = 'contact ID of tap/swipe')
+    parser.add_argument('--pixels', action = 'store_true', help = 'x/y are screen pixels')
+    parser.add_argument('--stats', action = 'store_true', help = 'print firmware statistics')
+    args = parser.parse_args()
+
+    if args.tap:
+        frames = tap(args.id, *args.tap)
+    elif args.swipe:
+        frames = swipe(args.id, *args.swipe, args.frames)
+    else:
+        f = open(args.file) if args.file else sys.stdin
+        frames = (json.loads(line) for line in f if line.strip())
+
+    try:
+        relay = Relay(RLY_PIXELS if args.pixels else 0)
+        count = relay.run(frames, args.interval)
+        print('Sent %d frames' % count)
+        if args.stats:
+            s = read_stats()
+            print('Device: %d frames, %d gaps, %d overruns, %d errors' %
+                  (s['frames'], s['gaps'], s['overruns'], s['errors']))
+    except Exception as ex:
+        sys.stderr.write('ERROR: %s!\n' % str(ex))
+        sys.exit(1)
+
+# ===================================================================================
+# Frame Generators
+# ===================================================================================
+
+def contact(id, x, y, touch = True, p = 127):
+    return {'id': id, 'x': x, 'y': y, 'touch': touch, 'p': p}
+
+def tap(id, x, y):
+    return [{'contacts': [contact(id, x, y)], 'ms': 50},
+            {'contacts': [contact(id, x, y, False, 0)]}]
+
+def swipe(id, x0, y0, x1, y1, frames):
+    for i in range(frames + 1):
+        yield {'contacts': [contact(id, x0 + (x1 - x0) * i // frames,
+                                        y0 + (y1 - y0) * i // frames)]}
+    yield {'contacts': [contact(id, x1, y1, False, 0)]}
+
+# ===================================================================================
+# Relay Class
+# ===================================================================================
+
+class Relay:
+    def __init__(self, flags = 0):
+        self.fd    = None
+        self.seq   = 0
+        self.flags = flags
+        for path in glob.glob('/sys/class/hidraw/hidraw*/device/uevent'):
+            # composite device: the touch screen is interface 0 (...:1.0)
+            if not os.path.realpath(os.path.dirname(path)).split('/')[-2].endswith('.%d' % FW_ITF_TOUCH):
+                continue
+            with open(path) as f:
+                if 'HID_ID=0003:%08X:%08X' % (FW_USB_VENDOR_ID, FW_USB_PRODUCT_ID) in f.read():
+                    self.fd = os.open('/dev/' + path.split('/')[4], os.O_WRONLY)
+        if self.fd is None:
+            raise Exception('hidraw device not found')
+
+    # Send all frames, the last one ends relay mode
+    def run(self, frames, interval):
+        count = 0
+        last  = None
+        for frame in frames:
+            if last is not None:
+                self.send(last, False)
+                count += 1
+                time.sleep(last.get('ms', interval) / 1000)
+            last = frame
+        if last is not None:
+            self.send(last, True)
+            count += 1
+        return count
+
+    def send(self, frame, end):
+        contacts = frame.get('contacts', [])
+        if len(contacts) > FW_MAX_CONTACTS:
+            raise Exception('more than %d contacts in a frame' % FW_MAX_CONTACTS)
+        report = struct.pack('<BBB', REPORT_ID_RELAY, self.seq, len(contacts) | (RLY_END if end else 0))
+        for c in contacts:
+            report += struct.pack('<BBHHB', c['id'], self.flags | (RLY_TOUCH if c.get('touch', True) else 0),
+                                  c['x'], c['y'], c.get('p', 127))
+        report += bytes(RLY_REPORT_SIZE - len(report))
+        os.write(self.fd, report)
+        self.seq = (self.seq + 1) & 0xff
+
+# ===================================================================================
+# Firmware Statistics
+# ===================================================================================
+
+def read_stats():
+    import usb.core
+    dev = usb.core.find(idVendor = FW_USB_VENDOR_ID, idProduct = FW_USB_PRODUCT_ID)
+    if dev is None:
+        raise Exception('Device not found')
+    d = bytes(dev.ctrl_transfer(VEN_REQ_IN, VEN_GET_RELAY, 0, 0, 9, FW_USB_TIMEOUT))
+    frames, gaps, overruns, errors, seq = struct.unpack('<HHHHB', d)
+    return {'frames': frames, 'gaps': gaps, 'overruns': overruns, 'errors': errors, 'seq': seq}
+
+# ===================================================================================
+# Firmware Constants (src/config.h, src/usb_descr.h, src/usb_relay.h, src/usb_vendor.h)
+# ===================================================================================
+
+FW_USB_VENDOR_ID  = 0x6666    # USB_VENDOR_ID
+FW_USB_PRODUCT_ID = 0x6666    # USB_PRODUCT_ID
+FW_USB_TIMEOUT    = 1000      # timeout for control transfers in ms
+FW_ITF_TOUCH      = 0         # HID_ITF_TOUCH
+FW_MAX_CONTACTS   = 3         # MT_MAX_CONTACTS
+
+REPORT_ID_RELAY   = 0x06
+RLY_CONTACT_SIZE  = 7
+RLY_REPORT_SIZE   = 3 + FW_MAX_CONTACTS * RLY_CONTACT_SIZE
+RLY_TOUCH         = 0x01
+RLY_PIXELS        = 0x02
+RLY_END           = 0x80
+
+VEN_REQ_IN        = 0xc0      # vendor, device, device to host
+VEN_GET_RELAY     = 0x0c
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   sim_bench - Simulator Benchmarks for CH552 Touch Play
+# Version:   v1.0
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Runs the benchmark firmware (bench/bench.c) in the ucsim 8051 simulator and
+# reports the machine cycles of every benchmark (fastest and slowest call) and
+# the worst-case interrupt path, plus flash/IRAM/XRAM use per module from the
+# .rel files of the firmware build. The results are compared against a stored
+# baseline, any benchmark or module that grew by more than the tolerance fails
+# the run, so does a missing baseline (store one with --update first). The
+# simulator counts classic 8051 machine cycles, the numbers are a yardstick for
+# changes, not CH552 clocks.
+#
+# Dependencies:
+# -------------
+# - SDCC with ucsim (s51)
+#
+# Operating Instructions:
+# -----------------------
+# make bench                                   build, run and compare (see makefile)
+# python3 sim_bench.py --ihx bench.ihx --map bench.map --rel '*.rel' --baseline base.csv
+# python3 sim_bench.py ... --update            store the results as new baseline
+
+
+import argparse
+import csv
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+# ===================================================================================
+# Main Function
+# ===================================================================================
+
+def _main():
+    parser = argparse.ArgumentParser(description = 'Simulator benchmarks')
+    parser.add_argument('--sim', default = 's51', help = 'ucsim 8051 simulator binary')
+    parser.add_argument('--ihx', required = True, help = 'benchmark firmware')
+    parser.add_argument('--map', required = True, help = 'linker map of the benchmark firmware')
+    parser.add_argument('--table', default = 'bench/bench.h', help = 'benchmark table')
+    parser.add_argument('--rel', default = '*.rel', help = 'object files of the firmware build')
+    parser.add_argument('--baseline', help = 'baseline CSV to compare against')
+    parser.add_argument('--tolerance', type = float, default = 2.0, help = 'allowed growth in percent')
+    parser.add_argument('--update', action = 'store_true', help = 'store results as baseline')
+    args = parser.parse_args()
+
+    try:
+        base    = read_baseline(args.baseline) if args.baseline and not args.update else None
+        names   = read_table(args.table)
+        results = run_sim(args.sim, args.ihx, args.map, names)
+        sizes   = read_sizes(args.rel)
+    except Exception as ex:
+        sys.stderr.write('ERROR: %s!\n' % str(ex))
+        sys.exit(1)
+
+    print('%-14s %6s %8s %8s' % ('Benchmark', 'calls', 'min', 'max'))
+    for name, isr in names:
+        r = results[name]
+        print('%-14s %6d %8d %8d%s' % (name, r['calls'], r['min'], r['max'], '  (ISR)' if isr else ''))
+    worst = max((results[n]['max'], n) for n, isr in names if isr)
+    print('Worst-case ISR: %d cycles (%s)' % worst)
+    print()
+    print('%-16s %6s %6s %6s' % ('Module', 'FLASH', 'IRAM', 'XRAM'))
+    for module in sorted(sizes):
+        s = sizes[module]
+        print('%-16s %6d %6d %6d' % (module, s['flash'], s['iram'], s['xram']))
+    total = {k: sum(s[k] for s in sizes.values()) for k in ('flash', 'iram', 'xram')}
+    print('%-16s %6d %6d %6d' % ('total', total['flash'], total['iram'], total['xram']))
+
+    rows = [('cycles', n, results[n]['max']) for n, isr in names]
+    rows.append(('cycles', 'worst_isr', worst[0]))
+    for module in sorted(sizes):
+        for k in ('flash', 'iram', 'xram'):
+            rows.append((k, module, sizes[module][k]))
+
+    if not args.baseline:
+        return
+    if args.update:
+        with open(args.baseline, 'w', newline = '') as f:
+            csv.writer(f).writerows([('kind', 'name', 'value')] + rows)
+        print('\nBaseline written to %s' % args.baseline)
+        return
+    failed = compare(rows, base, args.tolerance)
+    if failed:
+        print('\n%d regression(s) against %s (tolerance %.1f%%)' % (failed, args.baseline, args.tolerance))
+        sys.exit(1)
+    print('\nNo regressions against %s' % args.baseline)
+
+# ===================================================================================
+# Benchmark Table and Simulator Run
+# ===================================================================================
+
+def read_table(path):
+    names = re.findall(r'^\s*BENCH\((\w+),\s*(\d)\)', open(path).read(), re.M)
+    if not names:
+        raise Exception('no benchmarks in %s' % path)
+    return [(n, int(isr)) for n, isr in names]
+
+def symbol(mapfile, name):
+    m = re.search(r'\b([0-9A-Fa-f]{4,8})\s+%s\b' % re.escape(name), open(mapfile).read())
+    if not m:
+        raise Exception('symbol %s not found in %s' % (name, mapfile))
+    return int(m.group(1), 16)
+
+def run_sim(sim, ihx, mapfile, names):
+    done   = symbol(mapfile, '_BENCH_done')
+    result = symbol(mapfile, '_BENCH_result')
+    size   = 6 * len(names)                     # BENCH_RESULT: calls, min, max
+    with tempfile.NamedTemporaryFile('w', suffix = '.cmd', delete = False) as f:
+        f.write('break 0x%04x\nrun\ndump xram 0x%04x 0x%04x\nquit\n' % (done, result, result + size - 1))
+        cmd = f.name
+    try:
+        out = subprocess.run([sim, '-t', '8052', '-C', cmd, ihx], capture_output = True,
+                             text = True, timeout = 120).stdout
+    except FileNotFoundError:
+        raise Exception('simulator %s not found (set SIM=...)' % sim)
+    except subprocess.TimeoutExpired:
+        raise Exception('simulator did not reach BENCH_done')
+    finally:
+        os.unlink(cmd)
+
+    data = {}
+    for m in re.finditer(r'^\s*(?:0x)?([0-9a-fA-F]{4,})\s+((?:[0-9a-fA-F]{2}\s+)+)', out, re.M):
+        addr = int(m.group(1), 16)
+        for i, b in enumerate(m.group(2).split()):
+            data[addr + i] = int(b, 16)
+    raw = bytes(data.get(result + i, 0) for i in range(size))
+    if len(data) < size:
+        raise Exception('no results read from the simulator:\n%s' % out)
+    results = {}
+    for i, (name, isr) in enumerate(names):
+        calls, lo, hi = (raw[6*i + 2*k] | raw[6*i + 2*k + 1] << 8 for k in range(3))
+        results[name] = {'calls': calls, 'min': lo, 'max': hi}
+    return results
+
+# ===================================================================================
+# Module Sizes
+# ===================================================================================
+
+AREAS = {                                       # area: (memory, unit in bits)
+    'CSEG': ('flash', 8), 'CONST': ('flash', 8), 'HOME': ('flash', 8),
+    'GSINIT': ('flash', 8), 'GSFINAL': ('flash', 8), 'XINIT': ('flash', 8),
+    'CABS': ('flash', 8), 'DSEG': ('iram', 8), 'OSEG': ('iram', 8),
+    'ISEG': ('iram', 8), 'IABS': ('iram', 8), 'BSEG': ('iram', 1),
+    'XSEG': ('xram', 8), 'PSEG': ('xram', 8), 'XISEG': ('xram', 8), 'XABS': ('xram', 8),
+}
+
+def read_sizes(pattern):
+    sizes = {}
+    for path in sorted(glob.glob(pattern)):
+        s = {'flash': 0, 'iram': 0, 'xram': 0}
+        for m in re.finditer(r'^A\s+(\w+)\s+size\s+([0-9A-Fa-f]+)', open(path).read(), re.M):
+            if m.group(1) in AREAS:
+                mem, bits = AREAS[m.group(1)]
+                s[mem] += (int(m.group(2), 16) * bits + 7) // 8
+        sizes[os.path.splitext(os.path.basename(path))[0]] = s
+    if not sizes:
+        raise Exception('no object files match %s, build the firmware first' % pattern)
+    return sizes
+
+# ===================================================================================
+# Baseline Comparison
+# ===================================================================================
+
+def read_baseline(path):
+    if not os.path.exists(path):
+        raise Exception('baseline %s not found, store it with --update (make bench-baseline)' % path)
+    return {(r['kind'], r['name']): int(r['value']) for r in csv.DictReader(open(path))}
+
+def compare(rows, base, tolerance):
+    failed = 0
+    for kind, name, value in rows:
+        old = base.get((kind, name))
+        if old is None:
+            print('new:        %s %s = %d' % (kind, name, value))
+            continue
+        if value > old * (1 + tolerance / 100):
+            print('REGRESSION: %s %s %d -> %d (%+.1f%%)' % (kind, name, old, value,
+                                                         100.0 * (value - old) / max(old, 1)))
+            failed += 1
+        elif value < old:
+            print('improved:   %s %s %d -> %d' % (kind, name, old, value))
+    return failed
+
+# ===================================================================================
+
+if __name__ == "__main__":
+    _main()
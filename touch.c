@@ -1,5 +1,5 @@
 // ===================================================================================
-// Project:   CAPS bLOCK for CH551, CH552 and CH554
+// Project:   Touch Play for CH551, CH552 and CH554
 // Version:   v1.1
 // Year:      2023
 // Author:    Stefan Wagner
@@ -10,10 +10,12 @@
 //
 // Description:
 // ------------
-// Tired of accidentally hitting the CAPS-LOCK key? It doesn't have to be.
-// CAPS bLOCK identifies itself as a USB HID keyboard and constantly monitors
-// the state of CAPS LOCK. It immediately deactivates it if it has been
-// activated.
+// Touch Play identifies itself as a USB HID multitouch touch screen. Keys,
+// the rotary encoder and the optional key matrix are mapped to contact slots
+// at fixed screen positions, so pressing a key touches the screen there.
+// Held keys can drive gestures and macros, a boot keyboard and a consumer
+// interface come along on the same device, and the host can stream touch
+// frames itself (relay mode) or reconfigure it through vendor requests.
 //
 // References:
 // -----------
@@ -39,25 +41,52 @@
 // Operating Instructions:
 // -----------------------
 // - Connect the board via USB to your PC. It should be detected as a HID
-// keyboard.
-// - Activate/deactivate the blocking function by pressing the ACT button. The
-//   built-in LED lights up when the function is activated.
+//   touch screen (plus keyboard and consumer control).
+// - Press the keys to touch the screen at their mapped positions. The built-in
+//   LED lights up once the firmware is running.
 
 // ===================================================================================
 // Libraries, Definitions and Macros
 // ===================================================================================
 
 // Libraries
+#include "src/anim.h"   // pixel animations
 #include "src/config.h" // user configurations
-#include "src/delay.h"  // delay functions
+#include "src/gesture.h" // gesture engine
 #include "src/gpio.h"   // GPIO functions
+#include "src/macro.h"  // macro programs bound to keys
 #include "src/neo.h"    // NeoPixel functions
+#include "src/perf.h"   // latency instrumentation
+#include "src/power.h"  // idle and suspend handling
+#include "src/scan.h"   // input scan engine
+#include "src/screen.h" // display profiles
+#include "src/supervisor.h" // watchdog and USB recovery
 #include "src/system.h" // system functions
-#include "usb_hid.h"
+#include "src/timebase.h" // microsecond timebase
+#include "src/touchkey.h" // capacitive touch keys
+#include "src/touchmap.h" // key to touch contact map
+#include "src/usb_multitouch.h" // multitouch report functions
+#include "src/usb_relay.h" // host driven touch frames (relay mode)
+#include "src/usb_vendor.h" // vendor requests (configuration)
 
 // Prototypes for used interrupts
 void USB_interrupt(void);
 void USB_ISR(void) __interrupt(INT_NO_USB) { USB_interrupt(); }
+void SCAN_interrupt(void);
+void SCAN_ISR(void) __interrupt(INT_NO_TMR0) { SCAN_interrupt(); }
+void TB_interrupt(void);
+void TB_ISR(void) __interrupt(INT_NO_TMR2) { TB_interrupt(); }
+#ifdef TOUCH_ENABLE
+void TK_interrupt(void);
+void TK_ISR(void) __interrupt(INT_NO_TKEY) { TK_interrupt(); }
+#endif
+
+// ===================================================================================
+// Timer Callbacks
+// ===================================================================================
+void LED_on(void) {
+  PIN_low(PIN_LED); // light up LED - firmware running
+}
 
 // ===================================================================================
 // Main Function
@@ -65,193 +94,101 @@ void USB_ISR(void) __interrupt(INT_NO_USB) { USB_interrupt(); }
 void main(void) {
   __idata uint8_t i; // temp variable
 
-  NEO_init(); // init NeoPixels
+  // Clock and timebase first, everything below runs at full speed. Nothing
+  // waits on the way to USB, the LED and the pixels come last.
+  CLK_config(); // configure system clock
+  TB_init();    // start timebase, delays and the pixel latch depend on it
+  NEO_init();   // init NeoPixels
 
   // Boot Flash if key 1 is held
   if (!PIN_read(PIN_KEY1)) { // key 1 pressed?
     NEO_latch();             // make sure pixels are ready
     for (i = 9; i; i--)
       NEO_sendByte(127); // light up all pixels
+    WDT_stop();          // may still run after a watchdog reset
     BOOT_now();          // enter bootloader
   }
 
   // Setup
-  CLK_config(); // configure system clock
-  HID_init();
-  DLY_ms(10);       // wait for clock to settle
-  PIN_low(PIN_LED); // light up LED - blocking activated
-  __xdata unsigned char touchDownReport1[] = {
-      0x01,       // Contact Count
-      0x01,       // Contact Identifier
-      0x03,       // Tip Switch and In Range
-      0x7F,       // Pressure
-      0xfa, 0x03, // x / 10000
-      0xf4, 0x01, // y / 10000
-  };
-
-  __xdata unsigned char touchUpReport1[] = {
-      0x00,       // Contact Count
-      0x01,       // Contact Identifier
-      0x00,       // Not in Range
-      0x00,       // No pressure
-      0x00, 0x00, // Disregarded
-      0x00, 0x00, // Disregarded
-  };
-  __xdata unsigned char touchDownReport2[] = {
-      0x01,       // Contact Count
-      0x02,       // Contact Identifier
-      0x03,       // Tip Switch and In Range
-      0x7F,       // Pressure
-      0x88, 0x13, // x / 10000, 5000
-      0x88, 0x13, // y / 10000, 5000
-  };
-
-  __xdata unsigned char touchUpReport2[] = {
-      0x00,       // Contact Count
-      0x02,       // Contact Identifier
-      0x00,       // Not in Range
-      0x00,       // No pressure
-      0x00, 0x00, // Disregarded
-      0x00, 0x00, // Disregarded
-  };
-  __xdata unsigned char touchDownReport3[] = {
-      0x01,       // Contact Count
-      0x03,       // Contact Identifier
-      0x03,       // Tip Switch and In Range
-      0x7F,       // Pressure
-      0xf3, 0x20, // x / 10000
-      0x39, 0x24, // y / 10000
-  };
-
-  __xdata unsigned char touchUpReport3[] = {
-      0x00,       // Contact Count
-      0x03,       // Contact Identifier
-      0x00,       // Not in Range
-      0x00,       // No pressure
-      0x00, 0x00, // Disregarded
-      0x00, 0x00, // Disregarded
-  };
-
-  __xdata unsigned int touchCount = 0;
-  __xdata int lampLight = 0;
-  __xdata int keysChanged = 0;
-  // Track key states. Only send updates if the key state has changed.
-  __xdata int key1Pressed = 0;
-  __xdata int key2Pressed = 0;
-  __xdata int key3Pressed = 0;
-  // 0 for clockwise, 1 for counter-clockwise
-  __xdata int knobDirection = 0;
-  __xdata int keyDirty = 0;
-
-  NEO_clearAll(); // clear NeoPixels
+  // Set when an input event arrived, the slots then go through the gesture engine
+  __xdata uint8_t keyDirty = 0;
+  __xdata uint8_t ev;
+  __xdata uint8_t k, held;
+  __xdata int8_t steps;
+  __xdata int16_t wheel = 0; // encoder steps not yet reported
+  __xdata int8_t *wheelReport; // built right in the EP4 buffer
+
+  SCR_load();     // load selected display profile from data flash
+  MAP_load();     // load touch map from data flash
+  MAC_load();     // load macro programs from data flash
+  GES_init();     // release all contacts, first frame once configured
+  PERF_reset();   // clear latency statistics
+  HID_init();     // attach to USB, the host may enumerate from here on
+  SCAN_init();    // start sampling keys and encoder
+  TK_init();      // start sampling touch keys (if enabled)
+  TB_start(TB_TMR_LED, 10 + 1, 0, LED_on); // light up LED once clock settled
+  NEO_clearAll(); // clear NeoPixels (non-blocking)
+  ANIM_init();    // start pixel animation frames
+  SUP_init();     // record reset cause, start watchdog (after PERF_reset)
 
   // Loop
   while (1) {
-    keyDirty = 0;
-    touchCount = 0;
-
-    PIN_toggle(PIN_LED); // toggle LED and function state
-
-    DLY_ms(10); // debounce
-    // Touch down report
-
-    // Check if PIN_KEY1 is pressed
-    if (!PIN_read(PIN_KEY1)) { // key 1 pressed?
-      if (!key1Pressed) {
-        key1Pressed = 1;
-        keyDirty = 1;
-        touchCount += 1;
-      }
-    } else {
-      if (key1Pressed) {
-        key1Pressed = 0;
-        keyDirty = 1;
-      }
-    }
-    // Check if PIN_KEY2 is pressed
-    if (!PIN_read(PIN_KEY2)) { // key 2 pressed?
-      if (!key2Pressed) {
-        key2Pressed = 1;
-        keyDirty = 1;
-        touchCount += 1;
-      }
-    } else {
-      if (key2Pressed) {
-        key2Pressed = 0;
-        keyDirty = 1;
-      }
-    }
-    // Check if PIN_KEY3 or PIN_ENC_SW is pressed
-    if (!PIN_read(PIN_KEY3) || !PIN_read(PIN_ENC_SW)) {
-      // key 3 / encoder switch pressed?
-      if (!key3Pressed) {
-        key3Pressed = 1;
-        keyDirty = 1;
-        touchCount += 1;
-      }
-    } else {
-      if (key3Pressed) {
-        key3Pressed = 0;
-        keyDirty = 1;
-      }
+    PWR_idle(); // nothing can change before the next scan tick
+    SUP_poll(); // feed watchdog, re-attach if USB got stuck
+    TB_poll();  // run expired software timers (gesture frames, LED, bootloader)
+    RLY_poll(); // hand the touch screen back after relay mode
+
+    // Drain the input events posted by the scan engine, a press starts the
+    // macro program of the contact slot of the key if one is bound
+    while (SCAN_available()) {
+      ev = SCAN_read();
+      if (SCAN_EV_IS_PRESS(ev))
+        MAC_start(SCAN_slot[SCAN_EV_KEY(ev)]);
+      PIN_toggle(PIN_LED); // toggle LED on input activity
+      keyDirty = 1;
     }
 
-    // Check if PIN_ENC_A, PIN_ENC_B is pressed or not and update knobDirection
-    if (!PIN_read(PIN_ENC_A)) {
-      if(PIN_read(PIN_ENC_B)) {
-        lampLight = 1;  // clockwise?
-      }
-      else {
-        lampLight = 0;  // counter-clockwise?
+    // Hand the contact slots to the gesture engine, a slot is held while any
+    // of its keys (see SCAN_INPUTS) is pressed
+    if (keyDirty) {
+      for (i = 0; i < GES_SLOTS; i++) {
+        held = 0;
+        for (k = 0; k < SCAN_KEYS; k++)
+          if (SCAN_slot[k] == i && SCAN_isPressed(k))
+            held = 1;
+        GES_hold(i, held && !MAC_bound(i));
       }
-      DLY_ms(10);                                    // debounce
-      while(!PIN_read(PIN_ENC_A));                   // wait until next detent
-      keyDirty = 1;
+      keyDirty = 0;
     }
 
-    // Change the first byte of each report to the number of fingers
-    touchDownReport1[0] = touchCount;
-    touchUpReport1[0] = touchCount;
-    touchDownReport2[0] = touchCount;
-    touchUpReport2[0] = touchCount;
-    touchDownReport3[0] = touchCount;
-    touchUpReport3[0] = touchCount;
+    // Encoder detents start a gesture if one is mapped, else they are
+    // reported as mouse wheel on EP4, at most one report per poll
+    steps = SCAN_readEncoder();
+    if (!GES_encoder(steps))
+      wheel += steps;
+    if (wheel && (wheelReport = (__xdata int8_t *)HID_consumerBuffer())) {
+      wheelReport[0] = REPORT_ID_WHEEL;
+      wheelReport[1] = 0;
+      wheelReport[2] = 0;
+      wheelReport[3] = wheel > 127 ? 127 : wheel < -127 ? -127 : wheel;
+      HID_commitConsumer(WHEEL_REPORT_SIZE);
+      wheel -= wheelReport[3];
+      PWR_reportQueued();
+    }
 
-    if (keyDirty) {
-      if (key1Pressed) {
-        NEO_writeColor(0, 25, 19, 0);
-        HID_sendReport(touchDownReport1, sizeof(touchDownReport1));
-      } else {
-        if (lampLight) {
-          NEO_writeColor(0, 15, 5, 0);
-        } else {
-          NEO_clearPixel(0);
-        }
-        HID_sendReport(touchUpReport1, sizeof(touchUpReport1));
-      }
-      if (key2Pressed) {
-        NEO_writeColor(1, 25, 19, 0);
-        HID_sendReport(touchDownReport2, sizeof(touchDownReport2));
-      } else {
-        if (lampLight) {
-          NEO_writeColor(1, 15, 5, 0);
-        } else {
-          NEO_clearPixel(1);
-        }
-        HID_sendReport(touchUpReport2, sizeof(touchUpReport2));
-      }
-      if (key3Pressed) {
-        NEO_writeColor(2, 25, 19, 0);
-        HID_sendReport(touchDownReport3, sizeof(touchDownReport3));
-      } else {
-        if (lampLight) {
-          NEO_writeColor(2, 15, 5, 0);
-        } else {
-          NEO_clearPixel(2);
-        }
-        HID_sendReport(touchUpReport3, sizeof(touchUpReport3));
-      }
+    // Send a frame with all contacts if a key or gesture changed anything
+    if (GES_dirty) {
+      for (i = 0; i < GES_SLOTS; i++)
+        ANIM_key(i, GES_touching(i));
+      if (GES_sendFrame())
+        PWR_reportQueued(); // otherwise retry on the next pass
     }
-    NEO_update(); // update NeoPixels
+    MAP_poll();   // apply and store touch map updates from USB
+    MAC_poll();   // apply and store macro program updates from USB
+    SCR_poll();   // store display profile selection from USB
+    VEN_poll();   // CRC calculation and bootloader requests from USB
+    MT_idle();    // repeat unchanged frame if the host set an idle rate
+    ANIM_poll();  // render animation frames and send changed pixels, waits
+                  // while a touch report is pending
   }
 }